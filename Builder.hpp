@@ -5,15 +5,44 @@
 #include "compactds/Sequence_Hybrid.hpp"
 #include "compactds/Sequence_RunBlock.hpp"
 #include "compactds/Sequence_RunBlockOneTree.hpp"
+#include "compactds/Sequence_Interleaved.hpp"
 #include "compactds/FMBuilder.hpp"
 #include "compactds/FMIndex.hpp"
+#include "compactds/DS_DocumentListing.hpp"
 #include "compactds/Alphabet.hpp"
 #include "compactds/SequenceCompactor.hpp"
 #include "Taxonomy.hpp"
+#include "IndexMeta.hpp"
+
+#include <pthread.h>
 
 // Holds various method regarding building index
 using namespace compactds ; 
 
+// The information of a reference sequence from the sizing pass
+struct _refSeqRecord
+{
+  size_t seqId ; // >= GetSeqCount() if the sequence is not in the conversion table
+  size_t len ; // compacted length
+  size_t offset ; // the start position in the concatenated genomes. -1 if the sequence is filtered.
+  char *name ; // only kept for the sequence not in the conversion table
+} ;
+
+struct _builderIngestThreadArg
+{
+  int tid ;
+  int threadCnt ;
+
+  ReadFiles *refGenomeFile ; // only used for the file names
+  bool conversionTableAtFileLevel ;
+  Taxonomy *taxonomy ;
+  SequenceCompactor *seqCompactor ;
+  std::vector< std::vector<struct _refSeqRecord> > *fileRecords ; // records for each file
+
+  FixedSizeElemArray *genomes ;
+  std::vector< std::pair<size_t, int> > skipped ; // (position, code) for the chars sharing the word with the previous sequence
+} ;
+
 template <class FMseqclass>
 class Builder
 {
@@ -22,6 +51,327 @@ private:
   Taxonomy _taxonomy ;
   std::map<size_t, size_t> _seqLength ; // we use map here is for the case that a seq show up in the conversion table but not in the actual genome file.
   bool _protein ;
+  int _shardId ; // which shard to build. 
+  int _shardCnt ; // the number of shards that partition the input genomes. 1 for no sharding.
+
+  std::string _bwtLayout ; // the BWT representation recorded in .4.cfr. Empty for the default run-block BWT.
+  std::string _baseTaxonomyFile ; // the taxonomy of the existing index for --add-to. Empty if building from scratch.
+  std::map<size_t, int> _baseSeqIds ; // the seqIds indexed in the shards of the existing index
+
+  bool _buildDocList ;
+  DS_DocumentListing _docList ; // the seqIds of the BWT positions, for listing the seqIds of a hit range
+
+  bool _concatSameTaxIdSeqs ; // whether the seqIds are tax IDs from --concat-tax-genome
+
+  // Map the current reference sequence to its sequence id.
+  // @return: the seqid. Will be >= GetSeqCount() if the sequence is not in the conversion table.
+  size_t GetRefSeqId(ReadFiles &refGenomeFile, bool conversionTableAtFileLevel, char *fileNameBuffer)
+  {
+    if (conversionTableAtFileLevel)
+    {
+      Utils::GetFileBaseName(refGenomeFile.GetFileName( refGenomeFile.GetCurrentFileInd() ).c_str(), 
+          "fna|fa|fasta|faa", fileNameBuffer) ;
+      return _taxonomy.SeqNameToId(fileNameBuffer) ;
+    }
+    else
+      return _taxonomy.SeqNameToId(refGenomeFile.id) ;
+  }
+
+  // The filters shared by all the ways of reading the genomes. May add seqid as extra sequence name.
+  // name: the sequence name used when the seqid is not in the conversion table
+  // @return: whether to keep the sequence
+  bool SelectRefSeq(size_t &seqid, const char *name, bool conversionTableAtFileLevel, bool ignoreUncategorizedSeqs, 
+      uint64_t subsetTax, std::map<size_t, int> &selectedTaxIds, std::map<size_t, int> &taxIdShard)
+  {
+    if (subsetTax != 0)
+    {
+      size_t taxid = _taxonomy.SeqIdToTaxId(seqid) ;
+      if (selectedTaxIds.find(taxid) == selectedTaxIds.end())
+        return false ;
+    }
+
+    if (_baseSeqIds.find(seqid) != _baseSeqIds.end()) // already in the existing index
+      return false ;
+
+    if (!conversionTableAtFileLevel && _seqLength.find(seqid) != _seqLength.end()) // Assume there is no duplicated seqid. Though this happens a lot in the protein database...we handle that by promoting the seqid's corresponding taxID to LCA, so we only need to store that sequence once.
+      return false ;
+
+    if (seqid >= _taxonomy.GetSeqCount())
+    {
+      fprintf(stderr, "WARNING: taxonomy id doesn't exist for %s!\n", name) ;
+      if (!ignoreUncategorizedSeqs)
+        seqid = _taxonomy.AddExtraSeqName((char *)name) ;
+      else
+        return false ;
+    }
+
+    // The filter is after adding the extra sequence names, so every shard 
+    //   has the same seqId assignment and taxonomy structure.
+    if (taxIdShard.size() > 0 && taxIdShard[ _taxonomy.SeqIdToTaxId(seqid) ] != _shardId)
+      return false ;
+    return true ;
+  }
+
+  // Each thread reads whole files, and records the id and the compacted length of each sequence
+  static void *SizeRefSeqs_Thread(void *arg)
+  {
+    struct _builderIngestThreadArg *pArg = (struct _builderIngestThreadArg *)arg ;
+    int f ;
+    int fileCnt = pArg->refGenomeFile->GetFileCount() ;
+    char fileNameBuffer[1024] ;
+    Taxonomy &taxonomy = *(pArg->taxonomy) ;
+    for (f = pArg->tid ; f < fileCnt ; f += pArg->threadCnt)
+    {
+      ReadFiles reader ;
+      std::string fileName = pArg->refGenomeFile->GetFileName(f) ;
+      reader.AddReadFile(fileName.c_str(), false) ;
+      
+      size_t fileSeqId = 0 ;
+      if (pArg->conversionTableAtFileLevel)
+      {
+        Utils::GetFileBaseName(fileName.c_str(), "fna|fa|fasta|faa", fileNameBuffer) ;
+        fileSeqId = taxonomy.SeqNameToId(fileNameBuffer) ;
+      }
+
+      std::vector<struct _refSeqRecord> &records = (*pArg->fileRecords)[f] ;
+      while (reader.Next())
+      {
+        struct _refSeqRecord r ;
+        r.seqId = pArg->conversionTableAtFileLevel ? fileSeqId : taxonomy.SeqNameToId(reader.id) ;
+        r.len = pArg->seqCompactor->GetCompactLength(reader.seq) ;
+        r.offset = (size_t)-1 ;
+        r.name = NULL ;
+        if (r.seqId >= taxonomy.GetSeqCount())
+          r.name = strdup(pArg->conversionTableAtFileLevel ? fileNameBuffer : reader.id) ;
+        records.push_back(r) ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Each thread reads whole files again, and compacts the selected sequences into their reserved range
+  static void *CompactRefSeqs_Thread(void *arg)
+  {
+    struct _builderIngestThreadArg *pArg = (struct _builderIngestThreadArg *)arg ;
+    int f ;
+    size_t i ;
+    int fileCnt = pArg->refGenomeFile->GetFileCount() ;
+    FixedSizeElemArray &genomes = *(pArg->genomes) ;
+    const size_t l = genomes.GetElemLength() ;
+    int skipped[WORDBITS + 1] ;
+    for (f = pArg->tid ; f < fileCnt ; f += pArg->threadCnt)
+    {
+      ReadFiles reader ;
+      reader.AddReadFile(pArg->refGenomeFile->GetFileName(f).c_str(), false) ;
+      
+      const std::vector<struct _refSeqRecord> &records = (*pArg->fileRecords)[f] ;
+      size_t k = 0 ;
+      while (reader.Next())
+      {
+        const struct _refSeqRecord &r = records[k] ;
+        ++k ;
+        if (r.offset == (size_t)-1)
+          continue ;
+        
+        // Leave the chars sharing the word with the previous sequence 
+        //   to be written after all the threads finish.
+        size_t skip = 0 ;
+        if (r.offset > 0)
+        {
+          size_t prevLastWord = (r.offset * l - 1) / WORDBITS ;
+          while (skip < r.len && (r.offset + skip) * l / WORDBITS <= prevLastWord)
+            ++skip ;
+        }
+        pArg->seqCompactor->CompactAt(reader.seq, genomes, r.offset, skip, skipped) ;
+        for (i = 0 ; i < skip ; ++i)
+          pArg->skipped.push_back( std::pair<size_t, int>(r.offset + i, skipped[i]) ) ;
+      }
+    }
+    pthread_exit(NULL) ;
+  }
+
+  // Read the genomes with a sizing pass first, so the sequences can be 
+  //   compacted in parallel into their final positions in genomes. 
+  //   For concatSameTaxIdSeqs, the sequences with the same tax ID are placed 
+  //   next to each other directly without the per-tax ID copies.
+  void ReadGenomesWithSizingPass(ReadFiles &refGenomeFile, bool conversionTableAtFileLevel, bool concatSameTaxIdSeqs, 
+      bool ignoreUncategorizedSeqs, uint64_t subsetTax, std::map<size_t, int> &selectedTaxIds, std::map<size_t, int> &taxIdShard, 
+      int threadCnt, int minLen, SequenceCompactor &seqCompactor, const char *alphabetList, 
+      FixedSizeElemArray &genomes, std::vector<size_t> &genomeSeqIds, std::vector<size_t> &genomeLens)
+  {
+    int i ;
+    size_t j ;
+    int fileCnt = refGenomeFile.GetFileCount() ;
+    if (threadCnt > fileCnt)
+      threadCnt = fileCnt ;
+    if (threadCnt < 1)
+      threadCnt = 1 ;
+
+    std::vector< std::vector<struct _refSeqRecord> > fileRecords(fileCnt) ;
+    struct _builderIngestThreadArg *args = new struct _builderIngestThreadArg[threadCnt] ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(*threads) * threadCnt) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      args[i].tid = i ;
+      args[i].threadCnt = threadCnt ;
+      args[i].refGenomeFile = &refGenomeFile ;
+      args[i].conversionTableAtFileLevel = conversionTableAtFileLevel ;
+      args[i].taxonomy = &_taxonomy ;
+      args[i].seqCompactor = &seqCompactor ;
+      args[i].fileRecords = &fileRecords ;
+      args[i].genomes = &genomes ;
+    }
+    
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, SizeRefSeqs_Thread, (void *)(args + i)) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+
+    // Select the sequences in the input order, and decide their positions
+    size_t totalLen = 0 ;
+    std::map<size_t, size_t> taxIdLength ;
+    for (i = 0 ; i < fileCnt ; ++i)
+    {
+      size_t recordCnt = fileRecords[i].size() ;
+      for (j = 0 ; j < recordCnt ; ++j)
+      {
+        struct _refSeqRecord &r = fileRecords[i][j] ;
+        size_t seqid = r.seqId ;
+        if (r.name != NULL) // the name could be added as extra sequence name by previous sequence
+          seqid = _taxonomy.SeqNameToId(r.name) ;
+        if (!SelectRefSeq(seqid, r.name, conversionTableAtFileLevel, ignoreUncategorizedSeqs, 
+              subsetTax, selectedTaxIds, taxIdShard))
+          continue ;
+        
+        if (r.len < (size_t)minLen) // A genome too short
+        {
+          fprintf(stderr, "WARNING: %s is filtered due to its short length (could be from masker)!\n", 
+              r.name != NULL ? r.name : _taxonomy.SeqIdToName(seqid).c_str()) ;
+          continue ;
+        }
+        
+        r.seqId = seqid ;
+        if (!concatSameTaxIdSeqs)
+        {
+          r.offset = totalLen ;
+          totalLen += r.len ;
+          if (_seqLength.find(seqid) == _seqLength.end() )
+          {
+            _seqLength[seqid] = r.len ;
+            genomeSeqIds.push_back(seqid) ;
+            genomeLens.push_back(r.len) ;
+          }
+          else // This should only happen when conversionTableAtFileLevel is true 
+          {
+            _seqLength[seqid] += r.len ;
+            genomeLens[ genomeLens.size() - 1 ] += r.len ;
+          }
+        }
+        else
+        {
+          r.offset = 0 ; // mark as selected, the actual offset is set after knowing the size of each tax ID 
+          taxIdLength[ _taxonomy.SeqIdToTaxId(seqid) ] += r.len ;
+          _seqLength[seqid] = r.len ;
+        }
+      }
+    }
+
+    if (concatSameTaxIdSeqs)
+    {
+      std::map<size_t, size_t> taxIdOffset ;
+      _seqLength.clear() ;
+      for (std::map<size_t, size_t>::iterator iter = taxIdLength.begin() ; 
+          iter != taxIdLength.end() ; ++iter)
+      {
+        taxIdOffset[iter->first] = totalLen ;
+        totalLen += iter->second ;
+        genomeSeqIds.push_back(iter->first) ;
+        genomeLens.push_back(iter->second) ;
+        _seqLength[iter->first] = iter->second ;
+      }
+
+      for (i = 0 ; i < fileCnt ; ++i)
+      {
+        size_t recordCnt = fileRecords[i].size() ;
+        for (j = 0 ; j < recordCnt ; ++j)
+        {
+          struct _refSeqRecord &r = fileRecords[i][j] ;
+          if (r.offset == (size_t)-1)
+            continue ;
+          size_t taxid = _taxonomy.SeqIdToTaxId(r.seqId) ;
+          r.offset = taxIdOffset[taxid] ;
+          taxIdOffset[taxid] += r.len ;
+        }
+      }
+      
+      // In this case, seqId essentially is taxId
+      _taxonomy.SetTaxIdAsSeqId() ;
+    }
+
+    seqCompactor.Init(alphabetList, genomes, totalLen) ;
+    genomes.SetSize(totalLen) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_create(&threads[i], NULL, CompactRefSeqs_Thread, (void *)(args + i)) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      size_t size = args[i].skipped.size() ;
+      for (j = 0 ; j < size ; ++j)
+        genomes.Write(args[i].skipped[j].first, args[i].skipped[j].second) ;
+    }
+
+    for (i = 0 ; i < fileCnt ; ++i)
+    {
+      size_t recordCnt = fileRecords[i].size() ;
+      for (j = 0 ; j < recordCnt ; ++j)
+        if (fileRecords[i][j].name != NULL)
+          free(fileRecords[i][j].name) ;
+    }
+    free(threads) ;
+    delete[] args ;
+  }
+
+  // Scan the genome files once, and assign each tax ID to a shard. The genomes
+  //   with the same tax ID are always in the same shard, so that the 
+  //   --concat-tax-genome option still works. The tax IDs are assigned greedily from the 
+  //   largest to the smallest to the shard with the least total length.
+  void AssignShards(ReadFiles &refGenomeFile, bool conversionTableAtFileLevel, std::map<size_t, int> &taxIdShard)
+  {
+    int i ;
+    char fileNameBuffer[1024] ;
+    std::map<size_t, size_t> taxIdLength ; 
+    while (refGenomeFile.Next())
+    {
+      size_t seqid = GetRefSeqId(refGenomeFile, conversionTableAtFileLevel, fileNameBuffer) ;
+      // Uncategorized sequences all have the tax ID _nodeCnt, and will be in the same shard.
+      taxIdLength[ _taxonomy.SeqIdToTaxId(seqid) ] += strlen(refGenomeFile.seq) ;
+    }
+    refGenomeFile.Rewind() ;
+
+    std::vector< std::pair<size_t, size_t> > lengthTaxIds ; 
+    for (std::map<size_t, size_t>::iterator iter = taxIdLength.begin() ; 
+        iter != taxIdLength.end() ; ++iter)
+      lengthTaxIds.push_back( std::pair<size_t, size_t>(iter->second, iter->first) ) ;
+    std::sort(lengthTaxIds.rbegin(), lengthTaxIds.rend()) ;
+    
+    std::vector<size_t> shardLength(_shardCnt, 0) ;
+    size_t taxIdCnt = lengthTaxIds.size() ;
+    size_t shardTaxIdCnt = 0 ;
+    for (size_t j = 0 ; j < taxIdCnt ; ++j)
+    {
+      int minShard = 0 ;
+      for (i = 1 ; i < _shardCnt ; ++i)
+        if (shardLength[i] < shardLength[minShard])
+          minShard = i ;
+      taxIdShard[ lengthTaxIds[j].second ] = minShard ;
+      shardLength[minShard] += lengthTaxIds[j].first ;
+      if (minShard == _shardId)
+        ++shardTaxIdCnt ;
+    }
+    Utils::PrintLog("Shard %d of %d: %lu tax IDs with total length %lu bp.", _shardId, _shardCnt, 
+        shardTaxIdCnt, shardLength[_shardId]) ;
+  }
 
   // SampledSA need to be processed before FMIndex.Init() because the sampledSA is represented by FixedElemLengthArray, which requires the largest element size
   void TransformSampledSAToSeqId(struct _FMBuilderParam &fmBuilderParam, std::vector<size_t> genomeSeqIds,
@@ -71,11 +421,19 @@ private:
   }
 
 public: 
-  Builder() {_protein = false;}
+  Builder() 
+  {
+    _protein = false ;
+    _shardId = 0 ;
+    _shardCnt = 1 ;
+    _buildDocList = false ;
+    _concatSameTaxIdSeqs = false ;
+  }
   ~Builder() 
   {
     _fmIndex.Free() ;
     _taxonomy.Free() ;
+    _docList.Free() ;
   }
 
   void SetRBBWTBlockSize(size_t b)
@@ -83,12 +441,77 @@ public:
     _fmIndex.SetSequenceExtraParameter((void *)b) ;
   }
 
+  void SetShard(int shardId, int shardCnt)
+  {
+    _shardId = shardId ;
+    _shardCnt = shardCnt ;
+  }
+
+  void SetBWTLayout(const char *layout)
+  {
+    _bwtLayout = layout ;
+  }
+
+  void SetDocumentListing(bool docList)
+  {
+    _buildDocList = docList ;
+  }
+
+  // Build the index for the genomes not in the existing index idxPrefix with shardCnt shards.
+  //   The new index keeps the seqIds of the existing index, so it can be searched as one more shard.
+  //   The conversion table of the existing index can list more sequences than it holds,
+  //   so the indexed sequences are read from the sequence lengths (.3.cfr) of the shards.
+  void SetBaseIndex(const char *idxPrefix, int shardCnt)
+  {
+    int i ;
+    char fileName[1100] ;
+    IndexMeta::GetTaxonomyFile(idxPrefix, shardCnt, fileName) ;
+    _baseTaxonomyFile = fileName ;
+    
+    _baseSeqIds.clear() ;
+    for (i = 0 ; i < shardCnt ; ++i)
+    {
+      IndexMeta::GetShardPrefix(idxPrefix, i, shardCnt, fileName) ;
+      strcat(fileName, ".3.cfr") ;
+      FILE *fp = fopen(fileName, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open the sequence length file %s of the existing index.\n", fileName) ;
+        exit(EXIT_FAILURE) ;
+      }
+      size_t tmp[2] ;
+      while (fread(tmp, sizeof(tmp[0]), 2, fp) == 2)
+        _baseSeqIds[tmp[0]] = 1 ;
+      fclose(fp) ;
+    }
+  }
+
   void Build(ReadFiles &refGenomeFile, char *taxonomyFile, char *nameTable, char *conversionTable, bool conversionTableAtFileLevel, bool concatSameTaxIdSeqs, bool ignoreUncategorizedSeqs, uint64_t subsetTax, size_t memoryConstraint, struct _FMBuilderParam &fmBuilderParam, const char *alphabetList)
   {
     size_t i ;
     const int alphabetSize = strlen(alphabetList) ;
+    _concatSameTaxIdSeqs = concatSameTaxIdSeqs ;
   
-    _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ; 
+    if (_baseTaxonomyFile.size() == 0)
+      _taxonomy.Init(taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel)  ; 
+    else
+    {
+      Taxonomy baseTaxonomy ;
+      FILE *fp = fopen(_baseTaxonomyFile.c_str(), "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open the taxonomy file %s of the existing index.\n", _baseTaxonomyFile.c_str()) ;
+        exit(EXIT_FAILURE) ;
+      }
+      baseTaxonomy.Load(fp) ;
+      fclose(fp) ;
+      _taxonomy.InitWithBase(baseTaxonomy, taxonomyFile, nameTable, conversionTable, conversionTableAtFileLevel) ;
+      Utils::PrintLog("Found %lu sequences in the existing index.", _baseSeqIds.size()) ;
+    }
+    
+    std::map<size_t, int> taxIdShard ;
+    if (_shardCnt > 1 && _baseTaxonomyFile.size() == 0)
+      AssignShards(refGenomeFile, conversionTableAtFileLevel, taxIdShard) ;
 
     FixedSizeElemArray genomes ;
     std::map<size_t, FixedSizeElemArray *> taxIdGenomes ; // the genomes from each tax ID. For the concatSameTaxIdSeqs option.
@@ -106,39 +529,30 @@ public:
       _taxonomy.GetChildrenTax(_taxonomy.CompactTaxId(subsetTax), selectedTaxIds) ; 
     std::vector<size_t> genomeSeqIds ;
     std::vector<size_t> genomeLens ; 
-    while (refGenomeFile.Next())
-    {
-      size_t seqid = 0 ;
-      char fileNameBuffer[1024] ;
-      if (conversionTableAtFileLevel)
-      {
-        Utils::GetFileBaseName(refGenomeFile.GetFileName( refGenomeFile.GetCurrentFileInd() ).c_str(), 
-            "fna|fa|fasta|faa", fileNameBuffer) ;
-        seqid = _taxonomy.SeqNameToId(fileNameBuffer) ;
-      }
-      else
-        seqid = _taxonomy.SeqNameToId(refGenomeFile.id) ;
 
-      if (subsetTax != 0)
-      {
-        size_t taxid = _taxonomy.SeqIdToTaxId(seqid) ;
-        if (selectedTaxIds.find(taxid) == selectedTaxIds.end())
-          continue ;
-      }
+    // The sizing pass needs to read the files twice, so it does not work for stdin.
+    bool useSizingPass = concatSameTaxIdSeqs 
+      || (fmBuilderParam.threadCnt > 1 && refGenomeFile.GetFileCount() > 1) ;
+    for (i = 0 ; i < (size_t)refGenomeFile.GetFileCount() ; ++i)
+      if (refGenomeFile.GetFileName(i) == "-")
+        useSizingPass = false ;
+    if (useSizingPass)
+    {
+      ReadGenomesWithSizingPass(refGenomeFile, conversionTableAtFileLevel, concatSameTaxIdSeqs, ignoreUncategorizedSeqs,
+          subsetTax, selectedTaxIds, taxIdShard, fmBuilderParam.threadCnt, fmBuilderParam.precomputeWidth + 1, 
+          seqCompactor, alphabetList, genomes, genomeSeqIds, genomeLens) ;
+      if (concatSameTaxIdSeqs)
+        Utils::PrintLog("Finish concatenating genomes") ; 
+    }
 
-      if (!conversionTableAtFileLevel && _seqLength.find(seqid) != _seqLength.end()) // Assume there is no duplicated seqid. Though this happens a lot in the protein database...we handle that by promoting the seqid's corresponding taxID to LCA, so we only need to store that sequence once.
+    while (!useSizingPass && refGenomeFile.Next())
+    {
+      char fileNameBuffer[1024] ;
+      size_t seqid = GetRefSeqId(refGenomeFile, conversionTableAtFileLevel, fileNameBuffer) ;
+      if (!SelectRefSeq(seqid, conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id, 
+            conversionTableAtFileLevel, ignoreUncategorizedSeqs, subsetTax, selectedTaxIds, taxIdShard))
         continue ;
 
-      if (seqid >= _taxonomy.GetSeqCount())
-      {
-        fprintf(stderr, "WARNING: taxonomy id doesn't exist for %s!\n", 
-            conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
-        if (!ignoreUncategorizedSeqs)
-          seqid = _taxonomy.AddExtraSeqName(conversionTableAtFileLevel ? fileNameBuffer : refGenomeFile.id) ;
-        else
-          continue ;
-      }
-
       if (!concatSameTaxIdSeqs)
       {
         size_t len = seqCompactor.Compact(refGenomeFile.seq, genomes) ;
@@ -185,7 +599,7 @@ public:
       }
     }
 
-    if (concatSameTaxIdSeqs)
+    if (concatSameTaxIdSeqs && !useSizingPass)
     {
       genomes.SetSize(0) ;
       _seqLength.clear() ;
@@ -256,19 +670,51 @@ public:
     FMBuilder::Build(genomes, totalGenomeSize, alphabetSize, BWT, firstISA, fmBuilderParam) ;
 
     genomes.Free() ;
+    FMBuilder::LoadSpilledBWT(BWT, totalGenomeSize, alphabetSize, fmBuilderParam) ;
     Utils::PrintLog("Start to transform sampled SA to sequence ID.") ;
     TransformSampledSAToSeqId(fmBuilderParam, genomeSeqIds, genomeLens, totalGenomeSize) ;
     Utils::PrintLog("Start to compress BWT with RBBWT.") ;
     _fmIndex.Init(BWT, totalGenomeSize, 
         firstISA, fmBuilderParam, alphabetList, alphabetSize) ;
+    if (_buildDocList)
+    {
+      Utils::PrintLog("Start to build the document listing structure.") ;
+      FixedSizeElemArray seqIds ;
+      // The sequences not in the conversion table get the extra seqIds >= GetSeqCount(), 
+      //   and the seqIds are tax IDs with --concat-tax-genome.
+      size_t maxSeqId = _taxonomy.GetAllSeqCount() ;
+      for (i = 0 ; i < genomeSeqIds.size() ; ++i)
+        if (genomeSeqIds[i] > maxSeqId)
+          maxSeqId = genomeSeqIds[i] ;
+      seqIds.Malloc(Utils::Log2Ceil(maxSeqId + 1), totalGenomeSize) ;
+      _fmIndex.ResolveAllSampledSA(seqIds) ;
+      _docList.Init(seqIds, totalGenomeSize) ;
+      if (_docList.IsPlain())
+        Utils::PrintLog("Document listing: the runs are short, store the plain seqId array.") ;
+      else
+        Utils::PrintLog("Document listing: %lu runs over %lu BWT positions.", _docList.GetRunCount(), totalGenomeSize) ;
+    }
     Utils::PrintLog("centrifuger-build finishes.") ;
   }
 
-  void OutputBuilderMeta(FILE *fp, const FMIndex<FMseqclass> &fm) 
+  // isShard: whether the meta is for one shard or for the whole sharded index
+  void OutputBuilderMeta(FILE *fp, const FMIndex<FMseqclass> &fm, bool isShard) 
   {
     fprintf(fp, "version\t" CENTRIFUGER_VERSION "\n") ;
     fprintf(fp, "SA_sample_rate\t%d\n", fm._auxData.sampleRate) ;
     fprintf(fp, "sequence_type\t%s\n", _protein ? "amino_acid" : "nucleotide") ;
+    if (_bwtLayout.size() > 0)
+      fprintf(fp, "bwt_layout\t%s\n", _bwtLayout.c_str()) ;
+    if (_buildDocList)
+      fprintf(fp, "document_listing\trun_length\n") ;
+    if (_concatSameTaxIdSeqs)
+      fprintf(fp, "concat_tax_genome\ttax_id\n") ;
+    if (_shardCnt > 1)
+    {
+      if (isShard)
+        fprintf(fp, "shard_id\t%d\n", _shardId) ;
+      fprintf(fp, "shard_count\t%d\n", _shardCnt) ;
+    }
 
     time_t mytime = time(NULL) ;
     struct tm *localT = localtime( &mytime ) ;
@@ -308,7 +754,27 @@ public:
     // .4.cfr file is tsv file for some version information
     sprintf(outputFileName, "%s.4.cfr", outputPrefix) ;
     fpOutput = fopen(outputFileName, "w") ;
-    OutputBuilderMeta(fpOutput, _fmIndex) ;
+    OutputBuilderMeta(fpOutput, _fmIndex, _shardCnt > 1) ;
+    fclose(fpOutput) ;
+
+    // .5.cfr file is for the document listing structure (optional)
+    if (_buildDocList)
+    {
+      sprintf(outputFileName, "%s.5.cfr", outputPrefix) ;
+      fpOutput = fopen(outputFileName, "w") ;
+      _docList.Save(fpOutput) ;
+      fclose(fpOutput) ;
+    }
+  }
+
+  // The .4.cfr file for the whole sharded index, 
+  //   the classifier uses it to find the shards [outputPrefix].shard[i]
+  void SaveShardMeta(const char *outputPrefix)
+  {
+    char outputFileName[1024] ; 
+    sprintf(outputFileName, "%s.4.cfr", outputPrefix) ;
+    FILE *fpOutput = fopen(outputFileName, "w") ;
+    OutputBuilderMeta(fpOutput, _fmIndex, false) ;
     fclose(fpOutput) ;
   }
 } ;
@@ -4,6 +4,9 @@
 
 #include "argvdefs.h"
 #include "Builder.hpp"
+#include "IndexMeta.hpp"
+
+#define MAX_ADD_TO_SHARD_COUNT 4 // --add-to does not extend an index with this many shards
 
 char usage[] = "./centrifuger-build [OPTIONS]:\n"
   "Required:\n"
@@ -18,15 +21,22 @@ char usage[] = "./centrifuger-build [OPTIONS]:\n"
   "\t-o STRING: output prefix [centrifuger]\n"
   "\t-t INT: number of threads [1]\n"
   "\t--build-mem STR: automatic infer bmax and dcv to match memory constraints, can use T,G,M,K to specify the memory size [not used]\n"
+  "\t--spill-bwt: write the BWT to file [output_prefix]_spill.bwt during suffix sorting, which lowers the peak memory by about the size of the packed genomes. Automatically used if --build-mem is not enough for the text and BWT together [not used]\n"
   "\t--bmax INT: block size for blockwise suffix array sorting [16777216]\n"
   "\t--dcv INT: difference cover period [4096]\n"
   "\t--offrate INT: SA/offset is sampled every (2^<int>) BWT chars [4]\n"
+  "\t--sa-sample STR: sample the SA on the positions of bwt or text. text bounds the locate by 2^offrate-1 steps but uses ~1.25 more bits per base [bwt]\n"
   "\t--ftabchars INT: # of chars consumed in initial lookup (default: 10)\n"
   "\t--rbbwt-b INT: block size for run-block compressed BWT. 0 for auto. 1 for no compression [0]\n"
+  "\t--bwt-layout STR: BWT representation for nucleotide index: runblock (compressed) or interleaved (faster search, larger index) [runblock]\n"
+  "\t--doc-listing: store the seqIDs of the BWT positions in runs ([output_prefix].5.cfr) to list the seqIDs of a hit without locating [not used]\n"
   "\t--subset-tax INT: only consider the subset of input genomes under taxonomy node INT [0]\n"
   "\t--concat-tax-genome: concatenate the genomes with the same taxID and discard the seqID information [not used]\n"
   "\t--ignore-uncategorized-genome: ignore genomes whose seqID or taxID is missing or uncategorized. [include all]\n"
   "\t--checkpoint: add checkpoint (files [output_prefix]_checkpoint.[123]) for resuming index construction. [not used]\n"
+  "\t--shard-count INT: partition the genomes by taxID and size into INT independent indexes [output_prefix].shard[0..INT-1], a few assignments may differ from one index [1]\n"
+  "\t--shard-id INT: only build the INT-th (0-based) shard, so the shards can be built in separate processes [build all]\n"
+  "\t--add-to STRING: add the genomes not in the existing index STRING to it as a new shard, up to 4 shards in total, -o is ignored [not used]\n"
   "\t-h: print this usage message\n"
   ""
   ;
@@ -36,6 +46,7 @@ static struct option long_options[] = {
       { "bmax", required_argument, 0, ARGV_BMAX},
       { "dcv", required_argument, 0, ARGV_DCV},
       { "build-mem", required_argument, 0, ARGV_BUILD_MEMORY},
+      { "spill-bwt", no_argument, 0, ARGV_BUILD_SPILL_BWT},
       { "offrate", required_argument, 0, ARGV_OFFRATE},
       { "ftabchars", required_argument, 0, ARGV_FTABCHARS},
       { "rbbwt-b", required_argument, 0, ARGV_RBBWT_B}, 
@@ -45,11 +56,65 @@ static struct option long_options[] = {
       { "subset-tax", required_argument, 0, ARGV_SUBSET_TAXONOMY},
       { "concat-tax-genome", no_argument, 0, ARGV_BUILD_CONCAT_SAME_TAXID_SEQS},
       { "checkpoint", no_argument, 0, ARGV_BUILD_USE_CHECKPOINT },
+      { "shard-count", required_argument, 0, ARGV_BUILD_SHARD_COUNT },
+      { "shard-id", required_argument, 0, ARGV_BUILD_SHARD_ID },
+      { "add-to", required_argument, 0, ARGV_BUILD_ADD_TO },
+      { "bwt-layout", required_argument, 0, ARGV_BUILD_BWT_LAYOUT },
+      { "doc-listing", no_argument, 0, ARGV_BUILD_DOC_LISTING },
+      { "sa-sample", required_argument, 0, ARGV_BUILD_SA_SAMPLE },
       { "protein", no_argument, 0, ARGV_BUILD_PROTEIN},
       { "ignore-uncategorized-genome", no_argument, 0, ARGV_BUILD_IGNORE_UNCATEGORIZED },
       { (char *)0, 0, 0, 0} 
 } ;
 
+// Move the files of an index without sharding to [prefix].shard0, so more shards can be added.
+static void ConvertToShardedIndex(const char *prefix)
+{
+  int i ;
+  char from[1100] ;
+  char to[1100] ;
+  for (i = 1 ; i <= 3 ; ++i)
+  {
+    sprintf(from, "%s.%d.cfr", prefix, i) ;
+    sprintf(to, "%s.shard0.%d.cfr", prefix, i) ;
+    if (rename(from, to))
+    {
+      fprintf(stderr, "ERROR: failed to rename %s to %s.\n", from, to) ;
+      exit(EXIT_FAILURE) ;
+    }
+  }
+
+  // The optional .5.cfr from --doc-listing
+  sprintf(from, "%s.5.cfr", prefix) ;
+  sprintf(to, "%s.shard0.5.cfr", prefix) ;
+  FILE *fp = fopen(from, "r") ;
+  if (fp != NULL)
+  {
+    fclose(fp) ;
+    if (rename(from, to))
+    {
+      fprintf(stderr, "ERROR: failed to rename %s to %s.\n", from, to) ;
+      exit(EXIT_FAILURE) ;
+    }
+  }
+
+  // The .4.cfr of the shard needs the shard_id. 
+  //   The .4.cfr for the whole index is rewritten by the caller.
+  sprintf(from, "%s.4.cfr", prefix) ;
+  sprintf(to, "%s.shard0.4.cfr", prefix) ;
+  FILE *fpFrom = fopen(from, "r") ;
+  FILE *fpTo = fopen(to, "w") ;
+  char line[1024] ;
+  while (fgets(line, sizeof(line), fpFrom))
+  {
+    if (!strncmp(line, "build_date", 10))
+      fprintf(fpTo, "shard_id\t0\n") ;
+    fputs(line, fpTo) ;
+  }
+  fclose(fpFrom) ;
+  fclose(fpTo) ;
+}
+
 template <class FMseqclass>
 int CentrifugerBuild_main(int argc, char *argv[])
 {
@@ -74,9 +139,13 @@ int CentrifugerBuild_main(int argc, char *argv[])
   bool concatSameTaxIdSeqs = false ;
   bool ignoreUncategorizedSeqs = false ;
   bool protein = false ;
+  int shardCnt = 1 ;
+  int shardId = -1 ; // -1: build all the shards
+  int rbbwtB = -1 ;
+  char *addToPrefix = NULL ; // the existing index for --add-to
+  char bwtLayout[128] = "" ; // empty for the default run-block BWT
+  bool docListing = false ;
 
-  Builder<FMseqclass> builder ;
-  
   struct _FMBuilderParam fmBuilderParam ;
   fmBuilderParam.sampleRate = 16 ;
   while (1)
@@ -148,6 +217,10 @@ int CentrifugerBuild_main(int argc, char *argv[])
     {
       buildMemoryConstraint = Utils::SpaceStringToBytes(optarg) ;
     }
+    else if (c == ARGV_BUILD_SPILL_BWT)
+    {
+      fmBuilderParam.spillBWT = true ;
+    }
     else if (c == ARGV_OFFRATE)
     {
       fmBuilderParam.sampleRate = (1<<atoi(optarg)) ;
@@ -158,7 +231,7 @@ int CentrifugerBuild_main(int argc, char *argv[])
     }
     else if (c == ARGV_RBBWT_B)
     {
-      builder.SetRBBWTBlockSize(atoi(optarg)) ;
+      rbbwtB = atoi(optarg) ;
     }
     else if (c == ARGV_SUBSET_TAXONOMY)
     {
@@ -180,6 +253,43 @@ int CentrifugerBuild_main(int argc, char *argv[])
     {
       protein = true ;
     }
+    else if (c == ARGV_BUILD_SHARD_COUNT)
+    {
+      shardCnt = atoi(optarg) ;
+    }
+    else if (c == ARGV_BUILD_SHARD_ID)
+    {
+      shardId = atoi(optarg) ;
+    }
+    else if (c == ARGV_BUILD_ADD_TO)
+    {
+      addToPrefix = strdup(optarg) ;
+    }
+    else if (c == ARGV_BUILD_BWT_LAYOUT)
+    {
+      if (strcmp(optarg, "runblock") && strcmp(optarg, "interleaved"))
+      {
+        fprintf(stderr, "Unknown --bwt-layout %s.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
+      strcpy(bwtLayout, !strcmp(optarg, "runblock") ? "" : optarg) ;
+    }
+    else if (c == ARGV_BUILD_DOC_LISTING)
+    {
+      docListing = true ;
+    }
+    else if (c == ARGV_BUILD_SA_SAMPLE)
+    {
+      if (!strcmp(optarg, "bwt"))
+        fmBuilderParam.sampleStrategy = FMBUILDER_SAMPLE_ON_SA ;
+      else if (!strcmp(optarg, "text"))
+        fmBuilderParam.sampleStrategy = FMBUILDER_SAMPLE_ON_T ;
+      else
+      {
+        fprintf(stderr, "Unknown --sa-sample %s.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
+    }
     else
     {
       fprintf( stderr, "%s", usage ) ;
@@ -211,11 +321,66 @@ int CentrifugerBuild_main(int argc, char *argv[])
     }
   }
 
-  if (fmBuilderParam.hasCheckpointFile)
+  if (shardCnt < 1 || shardId < -1 || shardId >= shardCnt)
+  {
+    fprintf(stderr, "Invalid --shard-count %d or --shard-id %d.\n", shardCnt, shardId) ;
+    return EXIT_FAILURE ;
+  }
+
+  if (protein && bwtLayout[0])
+  {
+    fprintf(stderr, "--bwt-layout only works for nucleotide index.\n") ;
+    return EXIT_FAILURE ;
+  }
+  if (protein)
+    strcpy(bwtLayout, "wavelet_matrix") ; // the protein index built before has no bwt_layout
+
+  int baseShardCnt = 0 ; // the number of shards in the existing index for --add-to
+  if (addToPrefix != NULL)
   {
-    std::string tmp = outputPrefix ;
-    tmp += "_checkpoint" ;
-    fmBuilderParam.checkpointFilePrefix = tmp ;
+    char val[128] ;
+    if (concatSameTaxIdSeqs || shardCnt > 1 || shardId != -1)
+    {
+      fprintf(stderr, "--add-to can not be used with --concat-tax-genome, --shard-count or --shard-id.\n") ;
+      return EXIT_FAILURE ;
+    }
+    if (!IndexMeta::Get(addToPrefix, "sequence_type", val))
+    {
+      fprintf(stderr, "Failed to read the index meta file %s.4.cfr.\n", addToPrefix) ;
+      return EXIT_FAILURE ;
+    }
+    if (protein != !strcmp(val, "amino_acid"))
+    {
+      fprintf(stderr, "The sequence type does not match the existing index %s.\n", addToPrefix) ;
+      return EXIT_FAILURE ;
+    }
+    if (IndexMeta::Get(addToPrefix, "concat_tax_genome", val))
+    {
+      fprintf(stderr, "%s is built with --concat-tax-genome, whose seqIds are tax IDs, and can not be extended with --add-to.\n", addToPrefix) ;
+      return EXIT_FAILURE ;
+    }
+    if (IndexMeta::Get(addToPrefix, "shard_id", val))
+    {
+      fprintf(stderr, "%s is one shard of an index, please use the prefix of the whole index for --add-to.\n", addToPrefix) ;
+      return EXIT_FAILURE ;
+    }
+    // All the shards need the same BWT layout, which is also used in main().
+    //   This overrides the default wavelet matrix for the old protein index.
+    if (!IndexMeta::Get(addToPrefix, "bwt_layout", val))
+      val[0] = '\0' ;
+    strcpy(bwtLayout, val) ;
+    docListing = IndexMeta::Get(addToPrefix, "document_listing", val) ;
+    baseShardCnt = IndexMeta::GetShardCount(addToPrefix) ;
+    // Every read is searched on each shard, and its strand hits are adjusted between 
+    //   each pair of shards, so the query cost keeps rising with the added shards.
+    if (baseShardCnt >= MAX_ADD_TO_SHARD_COUNT)
+    {
+      fprintf(stderr, "%s already has %d shards, the most --add-to extends. Please rebuild the index with all the genomes, "
+          "the tables can be dumped with centrifuger-inspect --conversion-table, --taxonomy-tree and --name-table.\n", 
+          addToPrefix, baseShardCnt) ;
+      return EXIT_FAILURE ;
+    }
+    strcpy(outputPrefix, addToPrefix) ;
   }
 
   char alphabetList[31] = "ACGT" ;
@@ -226,11 +391,65 @@ int CentrifugerBuild_main(int argc, char *argv[])
       fmBuilderParam.precomputeWidth = 4 ;
   }
 
-  Utils::PrintLog("Start to read in the genome files.") ; 
-  builder.Build(refGenomeFile, taxonomyFile, nameTable, 
-      conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel, concatSameTaxIdSeqs, ignoreUncategorizedSeqs,
-      subsetTax, buildMemoryConstraint, fmBuilderParam, alphabetList) ;
-  builder.Save(outputPrefix) ;
+  for (i = 0 ; i < shardCnt ; ++i)
+  {
+    if (shardId != -1 && i != shardId)
+      continue ;
+
+    char shardPrefix[1100] ;
+    if (addToPrefix != NULL)
+    {
+      sprintf(shardPrefix, "%s.shard%d", outputPrefix, baseShardCnt) ;
+      Utils::PrintLog("Start to build shard %d for the existing index.", baseShardCnt) ;
+    }
+    else if (shardCnt > 1)
+    {
+      sprintf(shardPrefix, "%s.shard%d", outputPrefix, i) ;
+      Utils::PrintLog("Start to build shard %d.", i) ;
+    }
+    else
+      strcpy(shardPrefix, outputPrefix) ;
+
+    // The builder parameters are modified and consumed in building, so each shard uses a copy 
+    struct _FMBuilderParam shardFmBuilderParam = fmBuilderParam ;
+    if (shardFmBuilderParam.hasCheckpointFile)
+    {
+      std::string tmp = shardPrefix ;
+      tmp += "_checkpoint" ;
+      shardFmBuilderParam.checkpointFilePrefix = tmp ;
+    }
+    shardFmBuilderParam.spillFilePrefix = std::string(shardPrefix) + "_spill" ;
+    
+    Builder<FMseqclass> builder ;
+    if (rbbwtB >= 0)
+      builder.SetRBBWTBlockSize(rbbwtB) ;
+    builder.SetBWTLayout(bwtLayout) ;
+    builder.SetDocumentListing(docListing) ;
+    if (addToPrefix != NULL)
+    {
+      builder.SetBaseIndex(outputPrefix, baseShardCnt) ;
+      builder.SetShard(baseShardCnt, baseShardCnt + 1) ;
+    }
+    else
+      builder.SetShard(i, shardCnt) ;
+    if (i > 0)
+      refGenomeFile.Rewind() ;
+
+    Utils::PrintLog("Start to read in the genome files.") ; 
+    builder.Build(refGenomeFile, taxonomyFile, nameTable, 
+        conversionTableAtFileLevel ? fileList : conversionTable, conversionTableAtFileLevel, concatSameTaxIdSeqs, ignoreUncategorizedSeqs,
+        subsetTax, buildMemoryConstraint, shardFmBuilderParam, alphabetList) ;
+    builder.Save(shardPrefix) ;
+    if (addToPrefix != NULL)
+    {
+      // Only touch the existing index after the new shard is built
+      if (baseShardCnt == 1)
+        ConvertToShardedIndex(outputPrefix) ;
+      builder.SaveShardMeta(outputPrefix) ;
+    }
+    else if (shardCnt > 1 && i == 0)
+      builder.SaveShardMeta(outputPrefix) ;
+  }
 
   free(taxonomyFile) ;
   free(nameTable) ;
@@ -238,6 +457,8 @@ int CentrifugerBuild_main(int argc, char *argv[])
     free(conversionTable) ;
   if (fileList)
     free(fileList) ;
+  if (addToPrefix)
+    free(addToPrefix) ;
   Utils::PrintLog("Done.") ; 
 
   return 0 ;
@@ -246,6 +467,9 @@ int CentrifugerBuild_main(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
   bool protein = false ;  
+  bool interleaved = false ;
+  bool waveletMatrix = true ; // for protein index
+  char *addToPrefix = NULL ;
   
   int c, option_index ;
   option_index = 0 ;
@@ -258,6 +482,10 @@ int main(int argc, char *argv[])
     
     if (c == ARGV_BUILD_PROTEIN)
       protein = true ;
+    else if (c == ARGV_BUILD_BWT_LAYOUT)
+      interleaved = !strcmp(optarg, "interleaved") ;
+    else if (c == ARGV_BUILD_ADD_TO)
+      addToPrefix = optarg ;
     else if (c == 'h')
     {
       fprintf( stdout, "%s", usage ) ;
@@ -271,9 +499,23 @@ int main(int argc, char *argv[])
   }
   optind = 1 ;
 
-  if (!protein)
+  if (addToPrefix != NULL)
+  {
+    // The new shard uses the BWT layout of the existing index
+    char val[128] ;
+    if (!IndexMeta::Get(addToPrefix, "bwt_layout", val))
+      val[0] = '\0' ;
+    interleaved = !strcmp(val, "interleaved") ;
+    waveletMatrix = !strcmp(val, "wavelet_matrix") ;
+  }
+
+  if (!protein && interleaved)
+    return CentrifugerBuild_main<Sequence_Interleaved>(argc, argv) ;
+  else if (!protein)
     return CentrifugerBuild_main<Sequence_RunBlock>(argc, argv) ;
+  else if (waveletMatrix)
+    return CentrifugerBuild_main< Sequence_RunBlockOneTree<Sequence_WaveletMatrix> >(argc, argv) ;
   else
-    return CentrifugerBuild_main<Sequence_RunBlockOneTree>(argc, argv) ;
+    return CentrifugerBuild_main< Sequence_RunBlockOneTree<> >(argc, argv) ;
 }
 
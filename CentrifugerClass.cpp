@@ -5,6 +5,7 @@
 #include "argvdefs.h"
 #include "ReadFiles.hpp"
 #include "compactds/Sequence_Hybrid.hpp"
+#include "compactds/Sequence_Interleaved.hpp"
 #include "compactds/FMBuilder.hpp"
 #include "compactds/FMIndex.hpp"
 #include "compactds/Alphabet.hpp"
@@ -13,10 +14,15 @@
 #include "Classifier.hpp"
 #include "ResultWriter.hpp"
 #include "ReadPairMerger.hpp"
+#include "LongReadWindows.hpp"
 #include "ReadFormatter.hpp"
 #include "BarcodeCorrector.hpp"
 #include "BarcodeTranslator.hpp"
 #include "Dustmasker.hpp"
+#include "NumaTopology.hpp"
+#include "ReadDeduplicator.hpp"
+#include "RunStats.hpp"
+#include "ProgressReporter.hpp"
 
 char usage[] = "./centrifuger [OPTIONS] > output.tsv:\n"
   "Required:\n"
@@ -39,12 +45,25 @@ char usage[] = "./centrifuger [OPTIONS] > output.tsv:\n"
   "\t--read-format STR: format for read, barcode and UMI files, e.g. r1:0:-1,r2:0:-1,bc:0:15,um:16:-1 for paired-end files with barcode and UMI\n"
   "\t--no-dust: do not DUST-mask low-complexity regions of reads [mask]\n"
   "\t--min-hitlen INT: minimum length of partial hits [auto]\n"
+  "\t--no-early-exit: search the full minus strand even when a full-length forward hit already outscores it [stop early]\n"
+  "\t--min-score INT: report the reads with score less than <int> as unclassified, skipping their hit resolution when possible [0]\n"
+  "\t--min-hitlen-total INT: report the reads with classified length less than <int> as unclassified, skipping their hit resolution when possible [0]\n"
   "\t--hitk-factor INT: resolve at most <int>*k entries for each hit [40; use 0 for no restriction]\n"
   "\t--consider-secondary STR: in the format INT,FLOAT consider the secondary hit if its hitlen>=INT,score>=FLOAT*best_score [2000,0.995]\n"
   "\t--merge-readpair: merge overlapped paired-end reads and trim adapters [no merge]\n"
   "\t--expand-taxid: output the tax IDs that are promoted to the final report tax ID [no]\n"
   "\t--barcode-whitelist STR: path to the barcode whitelist file\n"
   "\t--barcode-translate STR: path to the barcode translation file\n"
+  "\t--hugepage: place the index in transparent huge pages and report the coverage [not used]\n"
+  "\t--dedup INT: classify each distinct read (pair) once, and reuse the results of the latest <int> distinct reads across batches [not used; 0 for within batch only]\n"
+  "\t--dedup-umi STR: group the reads by barcode and UMI within the --dedup window [1000000] and classify the first read of each group; fanout: report its result for every read; collapse: report the first read only [not used]\n"
+  "\t--long-read INT: split the single-end reads longer than <int> into windows of about <int> bp, searched by different threads [not used]\n"
+  "\t--window-output STR: output the classification of each window of the --long-read reads to file <str> [not used]\n"
+  "\t--batch-bases STR: number of bases (both mates) loaded in each batch, e.g. 8M [1M per thread; 64 windows per thread for --long-read]\n"
+  "\t--batch-memory STR: memory for the batches of reads and results, e.g. 2G; overrides --batch-bases [not used]\n"
+  "\t--stats STR: write the runtime statistics, e.g. the time of each stage and the search work, to file <str> in JSON [not used]\n"
+  "\t--progress INT: report the progress, speed and batches in the pipeline every <int> seconds [not used]\n"
+  "\t--numa STR: replicate: one index copy per NUMA node with the threads pinned to the node of their copy; interleave: interleave the index pages over the nodes [not used]\n"
   "\t-h: print this usage message\n"
   "\t-v: print the version information and quit\n"
   ;
@@ -55,6 +74,9 @@ static struct option long_options[] = {
   { "un", required_argument, 0, ARGV_OUTPUT_UNCLASSIFIED},
   { "cl", required_argument, 0, ARGV_OUTPUT_CLASSIFIED},
   { "no-dust", no_argument, 0, ARGV_NO_DUST},
+  { "no-early-exit", no_argument, 0, ARGV_NO_EARLY_EXIT},
+  { "min-score", required_argument, 0, ARGV_MIN_SCORE},
+  { "min-hitlen-total", required_argument, 0, ARGV_MIN_HITLEN_TOTAL},
   { "min-hitlen", required_argument, 0, ARGV_MIN_HITLEN},
   { "hitk-factor", required_argument, 0, ARGV_MAX_RESULT_PER_HIT_FACTOR},
   { "consider-secondary", required_argument, 0, ARGV_CONSIDER_SECONDARY_HITS},
@@ -65,6 +87,16 @@ static struct option long_options[] = {
   { "UMI", required_argument, 0, ARGV_UMI},
   { "barcode-whitelist", required_argument, 0, ARGV_BARCODE_WHITELIST},
   { "barcode-translate", required_argument, 0, ARGV_BARCODE_TRANSLATE},
+  { "hugepage", no_argument, 0, ARGV_HUGEPAGE},
+  { "numa", required_argument, 0, ARGV_NUMA},
+  { "dedup", required_argument, 0, ARGV_DEDUP},
+  { "dedup-umi", required_argument, 0, ARGV_DEDUP_UMI},
+  { "long-read", required_argument, 0, ARGV_LONG_READ},
+  { "window-output", required_argument, 0, ARGV_WINDOW_OUTPUT},
+  { "batch-bases", required_argument, 0, ARGV_BATCH_BASES},
+  { "batch-memory", required_argument, 0, ARGV_BATCH_MEMORY},
+  { "stats", required_argument, 0, ARGV_STATS},
+  { "progress", required_argument, 0, ARGV_PROGRESS},
   { (char *)0, 0, 0, 0} 
 } ;
 
@@ -78,6 +110,9 @@ struct _inputThreadArg
   BarcodeTranslator *barcodeTranslator ;
 
   int maxBatchSize ;
+  size_t maxBatchBases ;
+  RunStats *runStats ;
+  ProgressReporter *progress ;
   int *pBatchSize ;
 } ;
 
@@ -91,38 +126,84 @@ struct _threadArg
   ReadPairMerger *readPairMerger ;
 
   bool protein ; // is the classifier for protein or not
-  void *classifier ; // cast to runblock and runblockonetree depending on the protein
+  void *classifier ; // cast to Classifier<FMseqclass> in ClassifyReads_Thread
   struct _classifierResult *results ;
+  int *dedupRep ; // the read holding the result of each read, NULL if no dedup
+  LongReadWindows *longReadWindows ; // the windows of the split reads, NULL if no split
   bool dust ; // dustmasking the read or not
 
   int tid ;
+  int numaNode ; // the index of NUMA node the thread is pinned to
+  size_t readCnt ; // the number of reads classified by this thread so far
+  struct _classifierQueryStats queryStats ; // the work and shortcuts of the reads of this thread
+  double classifyTime ; // the accumulated running time of this thread in seconds
+  double cpuTime ;
+  bool timeStages ; // time the steps below and the ones in queryStats for --stats
+  double dustTime ;
+  double mergeReadPairTime ;
 } ;
 
+struct _loadClassifierThreadArg
+{
+  void *classifier ; // cast to Classifier<FMseqclass>
+  char *idxPrefix ;
+  struct _classifierParam *param ;
+} ;
+
+// The batch has one read per this many bases at most, bounding the number of reads in a batch
+#define BATCH_MIN_AVG_READ_LENGTH 100
+#define BATCH_READ_ID_BYTES 64 // an estimate of the read id and the allocation overhead
+
+// The bytes of one batch: the sequences and qualities of the bases, and the records of the reads
+size_t EstimateBatchMemory(size_t bases, size_t reads, size_t perReadBytes)
+{
+  return 2 * bases + reads * perReadBytes ;
+}
+
+#define NUMA_MODE_NONE 0
+#define NUMA_MODE_REPLICATE 1
+#define NUMA_MODE_INTERLEAVE 2
+
 int GetReadBatch(ReadFiles &reads, struct _Read *readBatch, 
     ReadFiles &mateReads, struct _Read *readBatch2, 
     ReadFiles &barcodeFile, struct _Read *barcodeBatch, 
     ReadFiles &umiFile, struct _Read *umiBatch, 
     ReadFormatter &readFormatter, BarcodeCorrector &barcodeCorrector, 
-    BarcodeTranslator &barcodeTranslator, int maxBatchSize)
+    BarcodeTranslator &barcodeTranslator, int maxBatchSize, size_t maxBatchBases,
+    RunStats &runStats, ProgressReporter &progress)
 {
   int i ;
   int fileInd1, fileInd2, fileIndBc, fileIndUmi ;
   int batchSize ;
+  runStats.StartStage(RUN_STAGE_INPUT) ;
+  progress.StartLoading() ;
+  size_t readBases = maxBatchBases ; // the budget for the first read file
   if (reads.IsInterleaved())
   {
-    batchSize = reads.GetBatch(readBatch, maxBatchSize, fileInd1, true, true, readBatch2) ;
+    batchSize = reads.GetBatch(readBatch, maxBatchSize, fileInd1, true, true, readBatch2, readBases) ;
   }
   else
   {
-    batchSize = reads.GetBatch( readBatch, maxBatchSize, fileInd1, true, true ) ;
+    if (readBatch2 != NULL) // the mates take the other half of the budget
+      readBases = DIV_CEIL(maxBatchBases, 2) ;
+    batchSize = reads.GetBatch( readBatch, maxBatchSize, fileInd1, true, true, NULL, readBases ) ;
+  }
+  size_t batchBases = reads.GetLastBatchBases() ;
+  // If the batch ends early for the base budget, the other files should stop at the same read. 
+  //   Otherwise, reading to the full size keeps checking that the files have the same number of reads.
+  int fileBatchSize = (batchBases >= readBases) ? batchSize : maxBatchSize ;
+  
+  if (!reads.IsInterleaved())
+  {
     if ( readBatch2 != NULL )
     {
-      int tmp = mateReads.GetBatch( readBatch2, maxBatchSize, fileInd2, true, true ) ;
+      int tmp = mateReads.GetBatch( readBatch2, fileBatchSize, fileInd2, true, true ) ;
       if ( tmp != batchSize )
       {
         Utils::PrintLog("ERROR: The two mate-pair read files have different number of reads." ) ;
         exit(EXIT_FAILURE) ;
       }
+      batchBases += mateReads.GetLastBatchBases() ;
     }
   }
 
@@ -130,7 +211,7 @@ int GetReadBatch(ReadFiles &reads, struct _Read *readBatch,
   {
     if (barcodeFile.GetFileCount() > 0)
     {
-      int tmp = barcodeFile.GetBatch( barcodeBatch, maxBatchSize, fileIndBc, true, true ) ;
+      int tmp = barcodeFile.GetBatch( barcodeBatch, fileBatchSize, fileIndBc, true, true ) ;
       if ( tmp != batchSize )
       {
         Utils::PrintLog("ERROR: The barcode file and read file have different number of reads." ) ;
@@ -147,7 +228,7 @@ int GetReadBatch(ReadFiles &reads, struct _Read *readBatch,
   {
     if (umiFile.GetFileCount() > 0)
     {
-      int tmp = umiFile.GetBatch( umiBatch, maxBatchSize, fileIndUmi, true, true ) ;
+      int tmp = umiFile.GetBatch( umiBatch, fileBatchSize, fileIndUmi, true, true ) ;
       if ( tmp != batchSize )
       {
         Utils::PrintLog("ERROR: The UMI file and read file have different number of reads." ) ;
@@ -221,6 +302,17 @@ int GetReadBatch(ReadFiles &reads, struct _Read *readBatch,
       }
     }
   }
+
+  if (batchSize > 0)
+    runStats.AddBatch(batchSize, batchBases) ;
+  runStats.StopStage(RUN_STAGE_INPUT) ;
+  if (progress.IsEnabled())
+  {
+    size_t readBytes = reads.GetReadBytes() ;
+    if (readBatch2 != NULL && !reads.IsInterleaved())
+      readBytes += mateReads.GetReadBytes() ;
+    progress.FinishLoading(batchSize, batchBases, readBytes) ;
+  }
   return batchSize ;
 }
 
@@ -232,19 +324,26 @@ void *LoadReads_Thread(void *pArg)
       *(arg.barcodeFile), arg.barcodeBatch,
       *(arg.umiFile), arg.umiBatch,
       *(arg.readFormatter), *(arg.barcodeCorrector), *(arg.barcodeTranslator),
-      arg.maxBatchSize) ;
+      arg.maxBatchSize, arg.maxBatchBases, *(arg.runStats), *(arg.progress)) ;
 
   pthread_exit(NULL) ;
 }
 
+template <class FMseqclass>
 void *ClassifyReads_Thread(void *pArg)
 {
-  int i, j ;
+  int i ;
   struct _threadArg &arg = *((struct _threadArg *)pArg);
+  Classifier<FMseqclass> &classifier = *((Classifier<FMseqclass> *)arg.classifier) ;
+  struct timespec startTime, endTime ;
+  size_t readCnt = 0 ;
+  struct _classifierQueryStats queryStats ;
+  clock_gettime(CLOCK_MONOTONIC, &startTime) ;
+  double startCpuTime = Utils::GetThreadCpuTime() ;
+  queryStats.timeStages = arg.timeStages ;
+  double stepStartTime = 0 ;
 
   Dustmasker dustmasker ;
-  std::vector<struct _dustmasker_perfect_interval> dustmaskerIntervals ;
-  std::vector<struct _dustmasker_perfect_interval> dustmaskerWindowIntervals ; 
   if (!arg.protein && arg.dust)
     dustmasker.Init("ACGT") ;
 
@@ -252,6 +351,11 @@ void *ClassifyReads_Thread(void *pArg)
   {
     if (i % arg.threadCnt != arg.tid)
       continue ;
+    if (arg.dedupRep != NULL && arg.dedupRep[i] != i)
+      continue ;
+    if (arg.longReadWindows != NULL && arg.longReadWindows->IsSplit(i))
+      continue ;
+    ++readCnt ;
     
     // Merge two read pairs
     char *r1, *q1, *r2, *q2 ;
@@ -270,64 +374,38 @@ void *ClassifyReads_Thread(void *pArg)
 
     int mergeResult = 0 ;
     if (arg.readPairMerger != NULL)
+    {
+      if (arg.timeStages)
+        stepStartTime = Utils::GetWallTime() ;
       mergeResult = arg.readPairMerger->Merge(r1, q1, r2, q2, &rm, &qm) ;
+      if (arg.timeStages)
+        arg.mergeReadPairTime += Utils::GetWallTime() - stepStartTime ;
+    }
 
     // Dustmasking the reads
     if (!arg.protein && arg.dust)
     {
-      int maskRegionSize ;
+      if (arg.timeStages)
+        stepStartTime = Utils::GetWallTime() ;
       if (mergeResult == 0)
       {
-        dustmasker.MaskWithBuffer(r1, strlen(r1), dustmaskerWindowIntervals, dustmaskerIntervals) ;
-        maskRegionSize = dustmaskerIntervals.size() ;
-        for (j = 0 ; j < maskRegionSize ; ++j)
-        {
-          int start = dustmaskerIntervals[j].start ;
-          int end = dustmaskerIntervals[j].end ;
-          for (int k = start ; k <= end ; ++k)
-            r1[k] = 'N' ;
-        }
-
+        dustmasker.MaskInPlace(r1, strlen(r1)) ;
         if (arg.readBatch2)
-        {
-          dustmasker.MaskWithBuffer(r2, strlen(r2), dustmaskerWindowIntervals, dustmaskerIntervals) ;
-          maskRegionSize = dustmaskerIntervals.size() ;
-          for (j = 0 ; j < maskRegionSize ; ++j)
-          {
-            int start = dustmaskerIntervals[j].start ;
-            int end = dustmaskerIntervals[j].end ;
-            for (int k = start ; k <= end ; ++k)
-              r2[k] = 'N' ;
-          }
-        }
+          dustmasker.MaskInPlace(r2, strlen(r2)) ;
       }
       else
-      {
-        dustmasker.MaskWithBuffer(rm, strlen(rm), dustmaskerWindowIntervals, dustmaskerIntervals) ;
-        maskRegionSize = dustmaskerIntervals.size() ;
-        for (j = 0 ; j < maskRegionSize ; ++j)
-        {
-          int start = dustmaskerIntervals[j].start ;
-          int end = dustmaskerIntervals[j].end ;
-          for (int k = start ; k <= end ; ++k)
-            rm[k] = 'N' ;
-        }
-      }
+        dustmasker.MaskInPlace(rm, strlen(rm)) ;
+      if (arg.timeStages)
+        arg.dustTime += Utils::GetWallTime() - stepStartTime ;
     }
 
     if (mergeResult == 0)
     {
-      if (!arg.protein)
-        ((Classifier<Sequence_RunBlock> *)arg.classifier)->Query(r1, r2, arg.results[i]) ;
-      else
-        ((Classifier<Sequence_RunBlockOneTree> *)arg.classifier)->Query(r1, r2, arg.results[i]) ;
+      classifier.Query(r1, r2, arg.results[i], &queryStats) ;
     }
     else
     {
-      if (!arg.protein)
-        ((Classifier<Sequence_RunBlock> *)arg.classifier)->Query(rm, NULL, arg.results[i]) ;
-      else
-        ((Classifier<Sequence_RunBlockOneTree> *)arg.classifier)->Query(rm, NULL, arg.results[i]) ;
+      classifier.Query(rm, NULL, arg.results[i], &queryStats) ;
       
       free(rm) ;
       if (qm)
@@ -336,6 +414,49 @@ void *ClassifyReads_Thread(void *pArg)
 
     //arg.classifier->Query(arg.readBatch[i].seq, arg.readBatch2 ? arg.readBatch2[i].seq : NULL, arg.results[i]) ;
   }
+
+  // The windows of the long reads are spread over the threads, and merged after the threads finish.
+  if (arg.longReadWindows != NULL)
+  {
+    LongReadWindows &windows = *arg.longReadWindows ;
+    int windowCnt = windows.GetWindowCount() ;
+    char *buffer = (char *)malloc(sizeof(char) * (windows.GetWindowSize() + 1)) ;
+    for (i = 0 ; i < windowCnt ; ++i)
+    {
+      if (i % arg.threadCnt != arg.tid)
+        continue ;
+      if (windows.GetWindow(i).windowIdx == 0)
+        ++readCnt ;
+      windows.SearchWindow(i, arg.readBatch, classifier, 
+          (!arg.protein && arg.dust) ? &dustmasker : NULL, buffer, &queryStats) ;
+    }
+    free(buffer) ;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &endTime) ;
+  arg.readCnt += readCnt ;
+  arg.queryStats.Add(queryStats) ;
+  arg.cpuTime += Utils::GetThreadCpuTime() - startCpuTime ;
+  arg.classifyTime += (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9 ;
+  pthread_exit(NULL) ;
+}
+
+// Classify the split reads of the batch from their windows, and output the window results.
+template <class FMseqclass>
+void MergeLongReadWindows(LongReadWindows &windows, const struct _Read *readBatch, 
+    Classifier<FMseqclass> &classifier, struct _classifierResult *results, 
+    struct _classifierQueryStats *stats, FILE *fpWindowOutput)
+{
+  windows.Merge(readBatch, classifier, results, stats) ;
+  if (fpWindowOutput != NULL)
+    windows.OutputWindowResults(fpWindowOutput, readBatch) ;
+}
+
+// The thread pinned to a NUMA node loads the index, so the pages are allocated on that node.
+template <class FMseqclass>
+void *LoadClassifier_Thread(void *pArg)
+{
+  struct _loadClassifierThreadArg &arg = *((struct _loadClassifierThreadArg *)pArg) ;
+  ((Classifier<FMseqclass> *)arg.classifier)->Init(arg.idxPrefix, *arg.param) ;
   pthread_exit(NULL) ;
 }
 
@@ -365,6 +486,20 @@ int CentrifugerClass_main(int argc, char *argv[])
   ReadPairMerger readPairMerger ;
   bool mergeReadPair = false ;
   bool dust = true ;
+  bool hugePage = false ;
+  int numaMode = NUMA_MODE_NONE ;
+  long long dedupCacheSize = -1 ; // <0: no dedup
+  int dedupKeyType = DEDUP_KEY_SEQUENCE ;
+  bool dedupCollapseOutput = false ; // only output the representative of each group
+  ReadDeduplicator readDeduplicator ;
+  size_t longReadWindowSize = 0 ; // 0: no split
+  size_t batchBasesBudget = 0 ; // 0: decided by the thread count
+  size_t batchMemoryBudget = 0 ; // 0: no memory budget
+  char *windowOutputFile = NULL ;
+  char *statsFile = NULL ;
+  RunStats runStats ;
+  int progressInterval = 0 ; // 0: no progress report
+  ProgressReporter progress ;
 
   bool protein = false ;
 
@@ -446,6 +581,101 @@ int CentrifugerClass_main(int argc, char *argv[])
     {
       dust = false ;
     }
+    else if (c == ARGV_NO_EARLY_EXIT)
+    {
+      classifierParam.strandEarlyExit = false ;
+    }
+    else if (c == ARGV_MIN_SCORE)
+    {
+      classifierParam.minScore = strtoull(optarg, NULL, 10) ;
+    }
+    else if (c == ARGV_MIN_HITLEN_TOTAL)
+    {
+      classifierParam.minTotalHitLen = atoi(optarg) ;
+    }
+    else if (c == ARGV_HUGEPAGE)
+    {
+      hugePage = true ;
+    }
+    else if (c == ARGV_NUMA)
+    {
+      if (!strcmp(optarg, "replicate"))
+        numaMode = NUMA_MODE_REPLICATE ;
+      else if (!strcmp(optarg, "interleave"))
+        numaMode = NUMA_MODE_INTERLEAVE ;
+      else
+      {
+        fprintf(stderr, "Unknown --numa %s.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_DEDUP)
+    {
+      dedupCacheSize = atoll(optarg) ;
+      if (dedupCacheSize < 0)
+      {
+        fprintf(stderr, "--dedup needs a non-negative value.\n") ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_DEDUP_UMI)
+    {
+      dedupKeyType = DEDUP_KEY_MOLECULE ;
+      if (!strcmp(optarg, "fanout"))
+        dedupCollapseOutput = false ;
+      else if (!strcmp(optarg, "collapse"))
+        dedupCollapseOutput = true ;
+      else
+      {
+        fprintf(stderr, "Unknown --dedup-umi %s.\n", optarg) ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_LONG_READ)
+    {
+      long long size = atoll(optarg) ;
+      if (size <= 0)
+      {
+        fprintf(stderr, "--long-read needs a positive window size.\n") ;
+        return EXIT_FAILURE ;
+      }
+      longReadWindowSize = size ;
+    }
+    else if (c == ARGV_WINDOW_OUTPUT)
+    {
+      windowOutputFile = strdup(optarg) ;
+    }
+    else if (c == ARGV_BATCH_BASES)
+    {
+      batchBasesBudget = Utils::SpaceStringToBytes(optarg) ;
+      if (batchBasesBudget == 0)
+      {
+        fprintf(stderr, "--batch-bases needs a positive value.\n") ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_BATCH_MEMORY)
+    {
+      batchMemoryBudget = Utils::SpaceStringToBytes(optarg) ;
+      if (batchMemoryBudget == 0)
+      {
+        fprintf(stderr, "--batch-memory needs a positive value.\n") ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_PROGRESS)
+    {
+      progressInterval = atoi(optarg) ;
+      if (progressInterval <= 0)
+      {
+        fprintf(stderr, "--progress needs a positive number of seconds.\n") ;
+        return EXIT_FAILURE ;
+      }
+    }
+    else if (c == ARGV_STATS)
+    {
+      statsFile = strdup(optarg) ;
+    }
     else if (c == ARGV_MERGE_READ_PAIR)
     {
       mergeReadPair = true ;
@@ -562,6 +792,28 @@ int CentrifugerClass_main(int argc, char *argv[])
   if (!hasUmi && readFormatter.GetSegmentCount(FORMAT_UMI) > 0)
       hasUmi = true ;
 
+  if (dedupKeyType == DEDUP_KEY_MOLECULE)
+  {
+    if (!hasUmi)
+    {
+      Utils::PrintLog("--dedup-umi needs the UMI from --UMI or --read-format.") ;
+      return EXIT_FAILURE ;
+    }
+    if (dedupCacheSize < 0)
+      dedupCacheSize = 1000000 ;
+  }
+
+  if (longReadWindowSize > 0 && hasMate)
+  {
+    Utils::PrintLog("--long-read only supports single-end reads.") ;
+    return EXIT_FAILURE ;
+  }
+  if (windowOutputFile != NULL && longReadWindowSize == 0)
+  {
+    Utils::PrintLog("--window-output needs --long-read.") ;
+    return EXIT_FAILURE ;
+  }
+
   if ( hasBarcode && hasBarcodeWhitelist )
   {
     if (barcodeFile.GetFileCount() > 0)
@@ -589,10 +841,73 @@ int CentrifugerClass_main(int argc, char *argv[])
       reads.SetNeedComment(true) ;
   }
 
+  // Open the file early, so a wrong path fails before the classification
+  FILE *fpStats = NULL ;
+  if (statsFile != NULL)
+  {
+    fpStats = fopen(statsFile, "w") ;
+    if (fpStats == NULL)
+    {
+      Utils::PrintLog("ERROR: cannot open %s for writing.", statsFile) ;
+      return EXIT_FAILURE ;
+    }
+    runStats.SetEnabled(true) ;
+  }
+
   if (threadCnt > 1 && readFormatter.GetSegmentCount(FORMAT_CATEGORY_COUNT) > 0)
     readFormatter.AllocateBuffers(4 * threadCnt) ;
   
-  classifier.Init(idxPrefix, classifierParam) ;
+  NumaTopology numaTopology ;
+  numaTopology.Init() ;
+  int numaNodeCnt = (numaMode == NUMA_MODE_NONE) ? 1 : numaTopology.GetNodeCount() ;
+  int replicaCnt = (numaMode == NUMA_MODE_REPLICATE) ? numaNodeCnt : 1 ;
+  Classifier<FMseqclass> **nodeClassifiers = (Classifier<FMseqclass> **)malloc(sizeof(*nodeClassifiers) * replicaCnt) ;
+  nodeClassifiers[0] = &classifier ;
+  for (i = 1 ; i < replicaCnt ; ++i)
+    nodeClassifiers[i] = new Classifier<FMseqclass> ;
+  if (numaMode != NUMA_MODE_NONE)
+    Utils::PrintLog("Found %d NUMA node(s) with CPUs.", numaNodeCnt) ;
+
+  // Only the index memory goes to huge pages
+  runStats.StartStage(RUN_STAGE_LOAD_INDEX) ;
+  Utils::SetHugePage(hugePage) ;
+  if (numaMode == NUMA_MODE_REPLICATE)
+  {
+    for (i = 0 ; i < replicaCnt ; ++i)
+    {
+      pthread_t loadThread ;
+      pthread_attr_t loadAttr ;
+      struct _loadClassifierThreadArg loadArg ;
+      loadArg.classifier = nodeClassifiers[i] ;
+      loadArg.idxPrefix = idxPrefix ;
+      loadArg.param = &classifierParam ;
+
+      pthread_attr_init(&loadAttr) ;
+      if (!numaTopology.SetThreadAttrNode(&loadAttr, i) && numaNodeCnt > 1)
+        fprintf(stderr, "WARNING: failed to pin the thread to NUMA node %d.\n", numaTopology.GetNodeId(i)) ;
+      pthread_create(&loadThread, &loadAttr, LoadClassifier_Thread<FMseqclass>, (void *)&loadArg) ;
+      pthread_join(loadThread, NULL) ;
+      pthread_attr_destroy(&loadAttr) ;
+      if (numaNodeCnt > 1)
+        Utils::PrintLog("Loaded the index copy on NUMA node %d.", numaTopology.GetNodeId(i)) ;
+    }
+  }
+  else 
+  {
+    bool interleaved = (numaMode == NUMA_MODE_INTERLEAVE && numaNodeCnt > 1) ;
+    if (interleaved && !numaTopology.SetInterleave(true))
+    {
+      fprintf(stderr, "WARNING: failed to interleave the memory over the NUMA nodes.\n") ;
+      interleaved = false ;
+    }
+    classifier.Init(idxPrefix, classifierParam) ;
+    if (interleaved)
+      numaTopology.SetInterleave(false) ;
+  }
+  Utils::SetHugePage(false) ;
+  runStats.StopStage(RUN_STAGE_LOAD_INDEX) ;
+  if (hugePage)
+    Utils::PrintHugePageCoverage() ;
   protein = classifier.IsProteinDatabase() ;
   
   if (classifierParam.outputExpandedResult)
@@ -618,8 +933,28 @@ int CentrifugerClass_main(int argc, char *argv[])
   }
   resWriter.OutputHeader() ;
 
-  const int maxBatchSize = 1024 * threadCnt ;
+  LongReadWindows longReadWindows[3] ; // one for each batch buffer
+  FILE *fpWindowOutput = NULL ;
+  struct _classifierQueryStats mergeQueryStats ; // the filters applied when merging the windows
+  if (longReadWindowSize > 0)
+  {
+    for (i = 0 ; i < 3 ; ++i)
+      longReadWindows[i].Init(longReadWindowSize, windowOutputFile != NULL) ;
+    if (windowOutputFile != NULL)
+    {
+      fpWindowOutput = fopen(windowOutputFile, "w") ;
+      if (fpWindowOutput == NULL)
+      {
+        Utils::PrintLog("ERROR: cannot open %s for writing.", windowOutputFile) ;
+        return EXIT_FAILURE ;
+      }
+      LongReadWindows::OutputWindowHeader(fpWindowOutput) ;
+    }
+  }
   int batchSize ;
+  bool dedup = (dedupCacheSize >= 0) ;
+  if (dedup)
+    readDeduplicator.Init(dedupCacheSize, dedupKeyType) ;
   
   int useInputThread = 0 ;
   int useOutputThread = 0 ;
@@ -632,22 +967,76 @@ int CentrifugerClass_main(int argc, char *argv[])
 
   classificationThreadCnt = threadCnt - useInputThread - useOutputThread ;
 
+  // The batches are bounded by their bases, so the memory of the batch buffers
+  //   does not depend on the read length.
+  int batchBufferCnt = 1 + useInputThread + useOutputThread ;
+  size_t perReadBytes = sizeof(struct _Read) * (1 + (hasMate ? 1 : 0) + (hasBarcode ? 1 : 0) + (hasUmi ? 1 : 0))
+    + sizeof(struct _classifierResult) + (dedup ? sizeof(int) : 0) + BATCH_READ_ID_BYTES ;
+  size_t maxBatchBases ;
+  if (batchMemoryBudget > 0)
+  {
+    // Solve EstimateBatchMemory(b, b/BATCH_MIN_AVG_READ_LENGTH)=budget per buffer
+    maxBatchBases = batchMemoryBudget / batchBufferCnt * BATCH_MIN_AVG_READ_LENGTH 
+      / (2 * BATCH_MIN_AVG_READ_LENGTH + perReadBytes) ;
+  }
+  else if (batchBasesBudget > 0)
+    maxBatchBases = batchBasesBudget ;
+  else if (longReadWindowSize > 0) // enough windows for the threads
+    maxBatchBases = longReadWindowSize * 64 * classificationThreadCnt ;
+  else
+    maxBatchBases = 1000000 * classificationThreadCnt ;
+  if (maxBatchBases < 1)
+    maxBatchBases = 1 ;
+  // The reads shorter than BATCH_MIN_AVG_READ_LENGTH make the batch smaller than the budget
+  const int maxBatchSize = (int)MIN(DIV_CEIL(maxBatchBases, BATCH_MIN_AVG_READ_LENGTH), (size_t)(1<<30)) ;
+  Utils::PrintLog("Each batch holds up to %lu bases in at most %d reads, and the %d batch buffers take about %.1lfMB.",
+      maxBatchBases, maxBatchSize, batchBufferCnt, 
+      batchBufferCnt * EstimateBatchMemory(maxBatchBases, maxBatchSize, perReadBytes) / 1e6) ;
+
   pthread_t *threads = (pthread_t *)malloc( sizeof( pthread_t ) * classificationThreadCnt ) ;
   struct _threadArg *args = (struct _threadArg *)malloc( sizeof( struct _threadArg ) * classificationThreadCnt ) ;
   pthread_attr_t attr ;
   pthread_attr_init( &attr ) ;
   pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE ) ;
   
+  // The classification threads are spread over the NUMA nodes and use the index copy on their node
+  pthread_attr_t *classifyAttrs = (pthread_attr_t *)malloc(sizeof(pthread_attr_t) * classificationThreadCnt) ;
   for (i = 0 ; i < classificationThreadCnt ; ++i)
   {
     args[i].threadCnt = classificationThreadCnt ;
     args[i].tid = i ;
+    args[i].numaNode = i % numaNodeCnt ;
+    args[i].readCnt = 0 ;
+    args[i].queryStats = _classifierQueryStats() ;
+    args[i].classifyTime = 0 ;
+    args[i].cpuTime = 0 ;
+    args[i].timeStages = runStats.IsEnabled() ;
+    args[i].dustTime = 0 ;
+    args[i].mergeReadPairTime = 0 ;
     args[i].protein = protein ;
     args[i].dust = dust ;
-    args[i].classifier = &classifier ;
+    args[i].dedupRep = NULL ;
+    args[i].longReadWindows = NULL ;
+    args[i].classifier = nodeClassifiers[args[i].numaNode % replicaCnt] ;
+    pthread_attr_init(&classifyAttrs[i]) ;
+    pthread_attr_setdetachstate(&classifyAttrs[i], PTHREAD_CREATE_JOINABLE) ;
+    if (numaNodeCnt > 1)
+      numaTopology.SetThreadAttrNode(&classifyAttrs[i], args[i].numaNode) ;
     args[i].readPairMerger = mergeReadPair ? &readPairMerger : NULL ;
   }
 
+  if (progressInterval > 0)
+  {
+    // The ETA needs the sizes of all the read files
+    size_t totalBytes = reads.GetTotalBytes() ;
+    if (hasMate && !reads.IsInterleaved())
+    {
+      size_t mateBytes = mateReads.GetTotalBytes() ;
+      totalBytes = (totalBytes > 0 && mateBytes > 0) ? totalBytes + mateBytes : 0 ;
+    }
+    progress.Start(progressInterval, totalBytes) ;
+  }
+
   //useLoadOutputThreads = false ;
   if (!useInputThread && !useOutputThread)
   {
@@ -661,37 +1050,80 @@ int CentrifugerClass_main(int argc, char *argv[])
       umiBatch = ( struct _Read *)calloc( sizeof( struct _Read ), maxBatchSize ) ;
     
     struct _classifierResult *classifierBatchResults = new struct _classifierResult[maxBatchSize] ;
+    int *dedupRep = NULL ;
+    if (dedup)
+      dedupRep = (int *)malloc(sizeof(int) * maxBatchSize) ;
     
     for ( i = 0 ; i < classificationThreadCnt ; ++i )
     {
       args[i].readBatch = readBatch ;
       args[i].readBatch2 = readBatch2 ;
       args[i].results = classifierBatchResults ;
+      args[i].dedupRep = dedupRep ;
+      args[i].longReadWindows = longReadWindowSize > 0 ? &longReadWindows[0] : NULL ;
     }
     
     while ( 1 )
     {
       batchSize = GetReadBatch(reads, readBatch, mateReads, readBatch2, 
           barcodeFile, barcodeBatch, umiFile, umiBatch,
-          readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize) ;
+          readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize, maxBatchBases, runStats, progress) ;
       
       if ( batchSize == 0 )
         break ; 
+      
+      if (dedup)
+      {
+        runStats.StartStage(RUN_STAGE_DEDUP) ;
+        readDeduplicator.Collapse(readBatch, readBatch2, barcodeBatch, umiBatch, batchSize, 
+            classifierBatchResults, dedupRep) ;
+        runStats.StopStage(RUN_STAGE_DEDUP) ;
+      }
+      if (longReadWindowSize > 0)
+        longReadWindows[0].Split(readBatch, batchSize, dedupRep) ;
 
+      runStats.StartStage(RUN_STAGE_CLASSIFY) ;
+      progress.StartClassifying() ;
       for ( i = 0 ; i < classificationThreadCnt ; ++i )
       {
         args[i].batchSize = batchSize ;
-        pthread_create( &threads[i], &attr, ClassifyReads_Thread, (void *)&args[i] ) ;
+        pthread_create( &threads[i], &classifyAttrs[i], ClassifyReads_Thread<FMseqclass>, (void *)&args[i] ) ;
       }
 
       for ( i = 0 ; i < classificationThreadCnt ; ++i )
         pthread_join( threads[i], NULL ) ;
+      runStats.StopStage(RUN_STAGE_CLASSIFY) ;
+      progress.FinishClassifying() ;
+      
+      if (longReadWindowSize > 0)
+      {
+        runStats.StartStage(RUN_STAGE_MERGE_WINDOWS) ;
+        MergeLongReadWindows(longReadWindows[0], readBatch, classifier, classifierBatchResults,
+            &mergeQueryStats, fpWindowOutput) ;
+        runStats.StopStage(RUN_STAGE_MERGE_WINDOWS) ;
+      }
+      if (dedup)
+      {
+        runStats.StartStage(RUN_STAGE_DEDUP) ;
+        readDeduplicator.Update(readBatch, readBatch2, classifierBatchResults) ;
+        runStats.StopStage(RUN_STAGE_DEDUP) ;
+      }
 
+      // The duplicates take the result (and the masked sequences) from the read holding the result
+      runStats.StartStage(RUN_STAGE_OUTPUT) ;
       for (i = 0 ; i < batchSize ; ++i)
-        resWriter.Output(readBatch[i].id, readBatch[i].seq, readBatch[i].qual,
-            hasMate ? readBatch2[i].seq : NULL, hasMate ? readBatch2[i].qual : NULL, 
+      {
+        if (dedupCollapseOutput && !ReadDeduplicator::IsRepresentative(dedupRep, i))
+          continue ;
+        int k = ReadDeduplicator::GetResultIndex(dedupRep, i) ;
+        int ks = readDeduplicator.GetSequenceIndex(dedupRep, i) ;
+        resWriter.Output(readBatch[i].id, readBatch[ks].seq, readBatch[i].qual,
+            hasMate ? readBatch2[ks].seq : NULL, hasMate ? readBatch2[i].qual : NULL, 
             hasBarcode ? barcodeBatch[i].seq : NULL,
-            hasUmi ? umiBatch[i].seq : NULL, classifierBatchResults[i]) ;
+            hasUmi ? umiBatch[i].seq : NULL, classifierBatchResults[k]) ;
+      }
+      runStats.StopStage(RUN_STAGE_OUTPUT) ;
+      progress.FinishOutput(batchSize) ;
     }
     
     reads.FreeBatch(readBatch, maxBatchSize) ;
@@ -712,6 +1144,8 @@ int CentrifugerClass_main(int argc, char *argv[])
       free(umiBatch) ;
     }
     delete[] classifierBatchResults ;
+    if (dedup)
+      free(dedupRep) ;
   }
   else if (useInputThread == 1 && useOutputThread == 0)
   {
@@ -723,6 +1157,7 @@ int CentrifugerClass_main(int argc, char *argv[])
     struct _Read *barcodeBatch[2] ;
     struct _Read *umiBatch[2] ;
     struct _classifierResult *classifierBatchResults[2] ;
+    int *dedupRep[2] ;
     
     for (i = 0 ; i < 2 ; ++i)
     {
@@ -743,6 +1178,7 @@ int CentrifugerClass_main(int argc, char *argv[])
         umiBatch[i] = NULL ;
 
       classifierBatchResults[i] = new struct _classifierResult[maxBatchSize] ;
+      dedupRep[i] = dedup ? (int *)malloc(sizeof(int) * maxBatchSize) : NULL ;
     }
     int batchSize[2] ;
     
@@ -750,7 +1186,7 @@ int CentrifugerClass_main(int argc, char *argv[])
     // Load in the first batch
     batchSize[0] = GetReadBatch(reads, readBatch[0], mateReads, readBatch2[0], 
         barcodeFile, barcodeBatch[0], umiFile, umiBatch[0],
-        readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize) ;
+        readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize, maxBatchBases, runStats, progress) ;
     
     int tag = 0 ; // which batch to use
     inputThreadArg.reads = &reads ;
@@ -761,6 +1197,9 @@ int CentrifugerClass_main(int argc, char *argv[])
     inputThreadArg.barcodeCorrector = &barcodeCorrector ;
     inputThreadArg.barcodeTranslator = &barcodeTranslator ;
     inputThreadArg.maxBatchSize = maxBatchSize ;
+    inputThreadArg.maxBatchBases = maxBatchBases ;
+    inputThreadArg.runStats = &runStats ;
+    inputThreadArg.progress = &progress ;
 
     while (1)
     {
@@ -781,6 +1220,17 @@ int CentrifugerClass_main(int argc, char *argv[])
       pthread_create(&inputThread, &attr, LoadReads_Thread, (void *)&inputThreadArg) ;
 
       // Process the current batch
+      if (dedup)
+      {
+        runStats.StartStage(RUN_STAGE_DEDUP) ;
+        readDeduplicator.Collapse(readBatch[tag], readBatch2[tag], 
+            barcodeBatch[tag], umiBatch[tag], batchSize[tag], classifierBatchResults[tag], dedupRep[tag]) ;
+        runStats.StopStage(RUN_STAGE_DEDUP) ;
+      }
+      if (longReadWindowSize > 0)
+        longReadWindows[tag].Split(readBatch[tag], batchSize[tag], dedupRep[tag]) ;
+      runStats.StartStage(RUN_STAGE_CLASSIFY) ;
+      progress.StartClassifying() ;
       for ( i = 0 ; i < classificationThreadCnt ; ++i )
       {
         args[i].readBatch = readBatch[tag] ;
@@ -788,19 +1238,46 @@ int CentrifugerClass_main(int argc, char *argv[])
         //args[i].barcodeBatch = barcodeBatch[tag] ;
         //args[i].umiBatch = umiBatch[tag] ;
         args[i].results = classifierBatchResults[tag] ;
+        args[i].dedupRep = dedupRep[tag] ;
+        args[i].longReadWindows = longReadWindowSize > 0 ? &longReadWindows[tag] : NULL ;
         args[i].batchSize = batchSize[tag] ;
 
-        pthread_create( &threads[i], &attr, ClassifyReads_Thread, (void *)&args[i] ) ;
+        pthread_create( &threads[i], &classifyAttrs[i], ClassifyReads_Thread<FMseqclass>, (void *)&args[i] ) ;
       }
 
       for (i = 0 ; i < classificationThreadCnt ; ++i)
         pthread_join(threads[i], NULL) ;
+      runStats.StopStage(RUN_STAGE_CLASSIFY) ;
+      progress.FinishClassifying() ;
 
+      if (longReadWindowSize > 0)
+      {
+        runStats.StartStage(RUN_STAGE_MERGE_WINDOWS) ;
+        MergeLongReadWindows(longReadWindows[tag], readBatch[tag], classifier, classifierBatchResults[tag],
+            &mergeQueryStats, fpWindowOutput) ;
+        runStats.StopStage(RUN_STAGE_MERGE_WINDOWS) ;
+      }
+      if (dedup)
+      {
+        runStats.StartStage(RUN_STAGE_DEDUP) ;
+        readDeduplicator.Update(readBatch[tag], readBatch2[tag], classifierBatchResults[tag]) ;
+        runStats.StopStage(RUN_STAGE_DEDUP) ;
+      }
+
+      runStats.StartStage(RUN_STAGE_OUTPUT) ;
       for (i = 0 ; i < batchSize[tag] ; ++i)
-        resWriter.Output(readBatch[tag][i].id, readBatch[tag][i].seq, readBatch[tag][i].qual, 
-            hasMate ? readBatch2[tag][i].seq : NULL, hasMate ? readBatch2[tag][i].qual : NULL,
+      {
+        if (dedupCollapseOutput && !ReadDeduplicator::IsRepresentative(dedupRep[tag], i))
+          continue ;
+        int k = ReadDeduplicator::GetResultIndex(dedupRep[tag], i) ;
+        int ks = readDeduplicator.GetSequenceIndex(dedupRep[tag], i) ;
+        resWriter.Output(readBatch[tag][i].id, readBatch[tag][ks].seq, readBatch[tag][i].qual, 
+            hasMate ? readBatch2[tag][ks].seq : NULL, hasMate ? readBatch2[tag][i].qual : NULL,
             hasBarcode ? barcodeBatch[tag][i].seq : NULL,
-            hasUmi ? umiBatch[tag][i].seq : NULL, classifierBatchResults[tag][i]) ;
+            hasUmi ? umiBatch[tag][i].seq : NULL, classifierBatchResults[tag][k]) ;
+      }
+      runStats.StopStage(RUN_STAGE_OUTPUT) ;
+      progress.FinishOutput(batchSize[tag]) ;
 
       started = true ;
       tag = nextTag ;
@@ -826,6 +1303,8 @@ int CentrifugerClass_main(int argc, char *argv[])
         free(umiBatch[i]) ;
       }
       delete[] classifierBatchResults[i] ;
+      if (dedup)
+        free(dedupRep[i]) ;
     }
   }
   else //use both input and output thread
@@ -838,6 +1317,7 @@ int CentrifugerClass_main(int argc, char *argv[])
     struct _Read *barcodeBatch[3] ;
     struct _Read *umiBatch[3] ;
     struct _classifierResult *classifierBatchResults[3] ;
+    int *dedupRep[3] ;
     
     for (i = 0 ; i < 3 ; ++i)
     {
@@ -858,6 +1338,7 @@ int CentrifugerClass_main(int argc, char *argv[])
         umiBatch[i] = NULL ;
       
       classifierBatchResults[i] = new struct _classifierResult[maxBatchSize] ;
+      dedupRep[i] = dedup ? (int *)malloc(sizeof(int) * maxBatchSize) : NULL ;
     }
     int batchSize[3] ;
     
@@ -865,7 +1346,7 @@ int CentrifugerClass_main(int argc, char *argv[])
     // Load in the first batch
     batchSize[0] = GetReadBatch(reads, readBatch[0], mateReads, readBatch2[0], 
         barcodeFile, barcodeBatch[0], umiFile, umiBatch[0],
-        readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize) ;
+        readFormatter, barcodeCorrector, barcodeTranslator, maxBatchSize, maxBatchBases, runStats, progress) ;
     
     int tag = 0 ; // which batch to use
     inputThreadArg.reads = &reads ;
@@ -876,6 +1357,9 @@ int CentrifugerClass_main(int argc, char *argv[])
     inputThreadArg.barcodeCorrector = &barcodeCorrector ;
     inputThreadArg.barcodeTranslator = &barcodeTranslator ;
     inputThreadArg.maxBatchSize = maxBatchSize ;
+    inputThreadArg.maxBatchBases = maxBatchBases ;
+    inputThreadArg.runStats = &runStats ;
+    inputThreadArg.progress = &progress ;
 
     while (1)
     {
@@ -900,30 +1384,68 @@ int CentrifugerClass_main(int argc, char *argv[])
       {
         for (i = 0 ; i < classificationThreadCnt ; ++i)
           pthread_join(threads[i], NULL) ;
+        runStats.StopStage(RUN_STAGE_CLASSIFY) ;
+        progress.FinishClassifying() ;
+        if (longReadWindowSize > 0)
+        {
+          runStats.StartStage(RUN_STAGE_MERGE_WINDOWS) ;
+          MergeLongReadWindows(longReadWindows[prevTag], readBatch[prevTag], classifier, 
+              classifierBatchResults[prevTag], &mergeQueryStats, fpWindowOutput) ;
+          runStats.StopStage(RUN_STAGE_MERGE_WINDOWS) ;
+        }
+        if (dedup)
+        {
+          runStats.StartStage(RUN_STAGE_DEDUP) ;
+          readDeduplicator.Update(readBatch[prevTag], readBatch2[prevTag], classifierBatchResults[prevTag]) ;
+          runStats.StopStage(RUN_STAGE_DEDUP) ;
+        }
       }
       
       if (batchSize[tag] > 0)
       {
+        if (dedup)
+        {
+          runStats.StartStage(RUN_STAGE_DEDUP) ;
+          readDeduplicator.Collapse(readBatch[tag], readBatch2[tag], 
+              barcodeBatch[tag], umiBatch[tag], batchSize[tag], classifierBatchResults[tag], dedupRep[tag]) ;
+          runStats.StopStage(RUN_STAGE_DEDUP) ;
+        }
+        if (longReadWindowSize > 0)
+          longReadWindows[tag].Split(readBatch[tag], batchSize[tag], dedupRep[tag]) ;
+        // The threads are joined in the next iteration, after outputting the previous batch
+        runStats.StartStage(RUN_STAGE_CLASSIFY) ;
+        progress.StartClassifying() ;
         for ( i = 0 ; i < classificationThreadCnt ; ++i )
         {
           args[i].readBatch = readBatch[tag] ;
           args[i].readBatch2 = readBatch2[tag] ;
           args[i].results = classifierBatchResults[tag] ;
+          args[i].dedupRep = dedupRep[tag] ;
+          args[i].longReadWindows = longReadWindowSize > 0 ? &longReadWindows[tag] : NULL ;
           args[i].batchSize = batchSize[tag] ;
 
-          pthread_create( &threads[i], &attr, ClassifyReads_Thread, (void *)&args[i] ) ;
+          pthread_create( &threads[i], &classifyAttrs[i], ClassifyReads_Thread<FMseqclass>, (void *)&args[i] ) ;
         }
       }
 
       // Output the previous batch
       if (started)
       {
+        runStats.StartStage(RUN_STAGE_OUTPUT) ;
         for (i = 0 ; i < batchSize[prevTag] ; ++i)
+        {
+          if (dedupCollapseOutput && !ReadDeduplicator::IsRepresentative(dedupRep[prevTag], i))
+            continue ;
+          int k = ReadDeduplicator::GetResultIndex(dedupRep[prevTag], i) ;
+          int ks = readDeduplicator.GetSequenceIndex(dedupRep[prevTag], i) ;
           resWriter.Output(readBatch[prevTag][i].id, 
-              readBatch[prevTag][i].seq, readBatch[prevTag][i].qual,
-              hasMate ? readBatch2[prevTag][i].seq : NULL, hasMate ? readBatch2[prevTag][i].qual : NULL,
+              readBatch[prevTag][ks].seq, readBatch[prevTag][i].qual,
+              hasMate ? readBatch2[prevTag][ks].seq : NULL, hasMate ? readBatch2[prevTag][i].qual : NULL,
               hasBarcode ? barcodeBatch[prevTag][i].seq : NULL,
-              hasUmi ? umiBatch[prevTag][i].seq : NULL, classifierBatchResults[prevTag][i]) ;
+              hasUmi ? umiBatch[prevTag][i].seq : NULL, classifierBatchResults[prevTag][k]) ;
+        }
+        runStats.StopStage(RUN_STAGE_OUTPUT) ;
+        progress.FinishOutput(batchSize[prevTag]) ;
       }
       
       if (batchSize[tag] == 0)
@@ -953,13 +1475,94 @@ int CentrifugerClass_main(int argc, char *argv[])
         free(umiBatch[i]) ;
       }
       delete[] classifierBatchResults[i] ;
+      if (dedup)
+        free(dedupRep[i]) ;
     }
   } // end of if-else for use input output thread
+  progress.Stop() ;
+  
+  if (dedup)
+    readDeduplicator.PrintStats() ;
   
+  size_t totalReadCnt = 0 ;
+  struct _classifierQueryStats queryStats = mergeQueryStats ;
+  for (i = 0 ; i < classificationThreadCnt ; ++i)
+  {
+    totalReadCnt += args[i].readCnt ;
+    queryStats.Add(args[i].queryStats) ;
+  }
+  if (!protein && classifierParam.strandEarlyExit)
+    Utils::PrintLog("Stopped the minus-strand search early for %lu of %lu classified read fragments (%.2lf%%) with full-length hits.",
+        queryStats.earlyExitCnt, totalReadCnt, totalReadCnt > 0 ? 100.0 * queryStats.earlyExitCnt / totalReadCnt : 0.0) ;
+  if (classifierParam.minScore > 0 || classifierParam.minTotalHitLen > 0)
+    Utils::PrintLog("%lu read fragments are unclassified by --min-score or --min-hitlen-total, %lu of them without resolving the hits.",
+        queryStats.filteredCnt, queryStats.filteredBeforeLocateCnt) ;
+  const struct _batchStats &batchStats = runStats.GetBatchStats() ;
+  if (batchStats.batchCnt > 0)
+    Utils::PrintLog("Loaded %lu batches, on average %.0lf reads and %.0lf bases per batch, at most %lu bases. Peak memory: %.1lfMB.",
+        batchStats.batchCnt, (double)batchStats.readCnt / batchStats.batchCnt, 
+        (double)batchStats.bases / batchStats.batchCnt, batchStats.maxBases,
+        Utils::GetPeakMemory() / 1e6) ;
+  if (numaMode != NUMA_MODE_NONE)
+  {
+    for (int node = 0 ; node < numaNodeCnt ; ++node)
+    {
+      int nodeThreadCnt = 0 ;
+      size_t nodeReadCnt = 0 ;
+      double nodeTime = 0 ;
+      for (i = 0 ; i < classificationThreadCnt ; ++i)
+      {
+        if (args[i].numaNode != node)
+          continue ;
+        ++nodeThreadCnt ;
+        nodeReadCnt += args[i].readCnt ;
+        nodeTime += args[i].classifyTime ;
+      }
+      Utils::PrintLog("NUMA node %d: %d threads classified %lu reads, %.1lf reads per thread-second.",
+          numaTopology.GetNodeId(node), nodeThreadCnt, nodeReadCnt, 
+          nodeTime > 0 ? nodeReadCnt / nodeTime : 0.0) ;
+    }
+  }
+
+  if (fpStats != NULL)
+  {
+    for (i = 0 ; i < classificationThreadCnt ; ++i)
+    {
+      struct _threadRunStats t ;
+      t.numaNode = numaMode != NUMA_MODE_NONE ? numaTopology.GetNodeId(args[i].numaNode) : -1 ;
+      t.readCnt = args[i].readCnt ;
+      t.busyTime = args[i].classifyTime ;
+      t.cpuTime = args[i].cpuTime ;
+      t.dustTime = args[i].dustTime ;
+      t.mergeReadPairTime = args[i].mergeReadPairTime ;
+      t.queryStats = args[i].queryStats ;
+      runStats.AddThread(t) ;
+    }
+    runStats.SetMergeQueryStats(mergeQueryStats) ;
+    if (dedup)
+      runStats.SetDedupStats(readDeduplicator.GetReadCount(), 
+          readDeduplicator.GetBatchDuplicateCount(), readDeduplicator.GetCacheHitCount()) ;
+    runStats.Output(fpStats) ;
+    fclose(fpStats) ;
+    Utils::PrintLog("Wrote the runtime statistics to %s.", statsFile) ;
+  }
+
   pthread_attr_destroy( &attr ) ;
+  for (i = 0 ; i < classificationThreadCnt ; ++i)
+    pthread_attr_destroy(&classifyAttrs[i]) ;
+  free(classifyAttrs) ;
+  for (i = 1 ; i < replicaCnt ; ++i)
+    delete nodeClassifiers[i] ;
+  free(nodeClassifiers) ;
   free( threads ) ;
   free( args ) ;
   free(idxPrefix) ;
+  if (fpWindowOutput != NULL)
+    fclose(fpWindowOutput) ;
+  if (windowOutputFile != NULL)
+    free(windowOutputFile) ;
+  if (statsFile != NULL)
+    free(statsFile) ;
 
   resWriter.Finalize() ;
 
@@ -970,6 +1573,8 @@ int CentrifugerClass_main(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
   bool protein = false ;  
+  bool interleaved = false ;
+  bool waveletMatrix = false ;
   
   int c, option_index ;
   option_index = 0 ;
@@ -984,6 +1589,12 @@ int main(int argc, char *argv[])
     {
       Classifier<Sequence_RunBlock> tmp ;
       protein = tmp.IsProteinDatabase(optarg) ;
+      
+      char val[128] ;
+      if (!IndexMeta::Get(optarg, "bwt_layout", val))
+        val[0] = '\0' ;
+      interleaved = !strcmp(val, "interleaved") ;
+      waveletMatrix = !strcmp(val, "wavelet_matrix") ;
     }
     else if (c == 'h')
     {
@@ -998,9 +1609,13 @@ int main(int argc, char *argv[])
   }
   optind = 1 ;
 
-  if (!protein)
+  if (!protein && interleaved)
+    return CentrifugerClass_main<Sequence_Interleaved>(argc, argv) ;
+  else if (!protein)
     return CentrifugerClass_main<Sequence_RunBlock>(argc, argv) ;
+  else if (waveletMatrix)
+    return CentrifugerClass_main< Sequence_RunBlockOneTree<Sequence_WaveletMatrix> >(argc, argv) ;
   else
-    return CentrifugerClass_main<Sequence_RunBlockOneTree>(argc, argv) ;
+    return CentrifugerClass_main< Sequence_RunBlockOneTree<> >(argc, argv) ;
 }
 
@@ -4,8 +4,12 @@
 #include "defs.h"
 #include "argvdefs.h"
 #include "Taxonomy.hpp"
+#include "IndexMeta.hpp"
 #include "compactds/FMIndex.hpp"
 #include "compactds/Sequence_RunBlock.hpp"
+#include "compactds/Sequence_Interleaved.hpp"
+#include "compactds/Sequence_RunBlockOneTree.hpp"
+#include "compactds/DS_DocumentListing.hpp"
 
 char usage[] = "./centrifuger-inspect [OPTIONS]:\n"
   "Required:\n"
@@ -18,6 +22,9 @@ char usage[] = "./centrifuger-inspect [OPTIONS]:\n"
   "\t--name-table: print the scientific name for each strain in the database\n"
   "\t--size-table: print the lengths of the sequences belonging to the same taxonomic ID\n"
   "\t--index-size: print the index information\n"
+  "\t--locate-steps: print the histogram of the LF steps to resolve a BWT position to its sampled SA\n"
+  "Optional:\n"
+  "\t--hugepage: with --index-size, place the index in transparent huge pages and report the coverage [not used]\n"
   "\t-h: print this usage message\n"
   ""
   ;
@@ -31,20 +38,72 @@ static struct option long_options[] = {
   {"name-table", no_argument, 0, ARGV_NAME_TABLE},
   {"size-table", no_argument, 0, ARGV_SIZE_TABLE},
   {"index-size", no_argument, 0, ARGV_INSPECT_INDEXSIZE},
+  {"locate-steps", no_argument, 0, ARGV_INSPECT_LOCATESTEPS},
+  {"hugepage", no_argument, 0, ARGV_HUGEPAGE},
   { (char *)0, 0, 0, 0} 
 } ;
 
 using namespace compactds ;
 
+template <class FMseqclass>
+static void InspectFMIndex(FILE *fp, int inspectItem)
+{
+  FMIndex<FMseqclass> fm ;
+  fm.Load(fp) ;
+  if (inspectItem == ARGV_INSPECT_INDEXSIZE)
+  {
+    fm.PrintSpace() ;
+    if (Utils::GetHugePageState().enabled)
+      Utils::PrintHugePageCoverage() ;
+  }
+  else if (inspectItem == ARGV_INSPECT_LOCATESTEPS)
+  {
+    // Resolve about 2^20 evenly spaced BWT positions. 
+    //   The odd step avoids always landing on the positions sampled in BWT order.
+    size_t i ;
+    size_t n = fm.GetSize() ;
+    size_t step = DIV_CEIL(n, 1ull<<20) | 1 ;
+    std::vector<size_t> hist ;
+    size_t total = 0 ;
+    size_t sum = 0 ;
+    for (i = 0 ; i < n ; i += step)
+    {
+      size_t l ;
+      fm.BackwardToSampledSA(i, l) ;
+      if (l >= hist.size())
+        hist.resize(l + 1, 0) ;
+      ++hist[l] ;
+      ++total ;
+      sum += l ;
+    }
+
+    size_t cumulative = 0 ;
+    printf("steps\tcount\tcumulative_fraction\n") ;
+    for (i = 0 ; i < hist.size() ; ++i)
+    {
+      if (hist[i] == 0)
+        continue ;
+      cumulative += hist[i] ;
+      printf("%lu\t%lu\t%.6lf\n", i, hist[i], (double)cumulative / total) ;
+    }
+    Utils::PrintLog("Resolved %lu BWT positions with SA sample rate %d (%s order): mean %.2lf steps, max %lu steps.",
+        total, fm._auxData.sampleRate, 
+        fm._auxData.sampleStrategy == FMBUILDER_SAMPLE_ON_T ? "text" : "BWT", 
+        total > 0 ? (double)sum / total : 0.0, hist.size() > 0 ? hist.size() - 1 : 0) ;
+  }
+}
+
 int main(int argc, char *argv[])
 {
   char buffer[1024] ;
   char *idxPrefix = NULL ; 
+  int i ;
   int c, option_index ;
 	option_index = 0 ;
 
   Taxonomy taxonomy ;
   int inspectItem = -1 ; 
+  bool hugePage = false ;
   while (1)
   {
 		c = getopt_long( argc, argv, short_options, long_options, &option_index ) ;
@@ -56,6 +115,10 @@ int main(int argc, char *argv[])
     {
       idxPrefix = strdup(optarg) ;
     }
+    else if (c == ARGV_HUGEPAGE)
+    {
+      hugePage = true ;
+    }
     else if (c == 'h')
     {
       fprintf(stdout, "%s", usage) ;
@@ -76,18 +139,23 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE ;
   }
   
-  sprintf(buffer, "%s.2.cfr", idxPrefix) ;
+  int shardCnt = IndexMeta::GetShardCount(idxPrefix) ;
+  IndexMeta::GetTaxonomyFile(idxPrefix, shardCnt, buffer) ;
   FILE *fp = fopen(buffer, "r") ;
   taxonomy.Load(fp) ;
   fclose(fp) ;
 
   std::map<size_t, size_t> seqLength ;
-  sprintf(buffer, "%s.3.cfr", idxPrefix) ;
-  fp = fopen(buffer, "r") ;
-  size_t tmp[2] ;
-  while (fread(tmp, sizeof(tmp[0]), 2, fp))
-    seqLength[tmp[0]] = tmp[1] ;
-  fclose(fp) ;
+  for (i = 0 ; i < shardCnt ; ++i)
+  {
+    IndexMeta::GetShardPrefix(idxPrefix, i, shardCnt, buffer) ;
+    strcat(buffer, ".3.cfr") ;
+    fp = fopen(buffer, "r") ;
+    size_t tmp[2] ;
+    while (fread(tmp, sizeof(tmp[0]), 2, fp))
+      seqLength[tmp[0]] += tmp[1] ;
+    fclose(fp) ;
+  }
 
   if (inspectItem == ARGV_INSPECT_SEQNAME)
   {
@@ -133,15 +201,44 @@ int main(int argc, char *argv[])
     }
     free(taxidLength) ;
   }
-  else if (inspectItem == ARGV_INSPECT_INDEXSIZE)
+  else if (inspectItem == ARGV_INSPECT_INDEXSIZE || inspectItem == ARGV_INSPECT_LOCATESTEPS)
   {
-    sprintf(buffer, "%s.1.cfr", idxPrefix) ; 
-    FMIndex<Sequence_RunBlock> fm ;
-    FILE *fp = fopen(buffer, "r") ;
-    fm.Load(fp) ;
-    fclose(fp) ;
+    Utils::SetHugePage(hugePage) ;
+    for (i = 0 ; i < shardCnt ; ++i)
+    {
+      IndexMeta::GetShardPrefix(idxPrefix, i, shardCnt, buffer) ;
+      strcat(buffer, ".1.cfr") ; 
+      FILE *fp = fopen(buffer, "r") ;
+      if (shardCnt > 1)
+        Utils::PrintLog("Shard %d:", i) ;
+      
+      char layout[128] ;
+      char seqType[128] ;
+      if (!IndexMeta::Get(idxPrefix, "bwt_layout", layout))
+        layout[0] = '\0' ;
+      bool protein = IndexMeta::Get(idxPrefix, "sequence_type", seqType) && !strcmp(seqType, "amino_acid") ;
+      if (!protein && !strcmp(layout, "interleaved"))
+        InspectFMIndex<Sequence_Interleaved>(fp, inspectItem) ;
+      else if (!protein)
+        InspectFMIndex<Sequence_RunBlock>(fp, inspectItem) ;
+      else if (!strcmp(layout, "wavelet_matrix"))
+        InspectFMIndex< Sequence_RunBlockOneTree<Sequence_WaveletMatrix> >(fp, inspectItem) ;
+      else
+        InspectFMIndex< Sequence_RunBlockOneTree<> >(fp, inspectItem) ;
+      fclose(fp) ;
 
-    fm.PrintSpace() ;
+      IndexMeta::GetShardPrefix(idxPrefix, i, shardCnt, buffer) ;
+      if (inspectItem == ARGV_INSPECT_INDEXSIZE 
+          && IndexMeta::Get(buffer, "document_listing", layout))
+      {
+        strcat(buffer, ".5.cfr") ;
+        fp = fopen(buffer, "r") ;
+        DS_DocumentListing docList ;
+        docList.Load(fp) ;
+        fclose(fp) ;
+        Utils::PrintLog("Document listing: %llu", docList.GetSpace()) ;
+      }
+    }
   }
   else
   {
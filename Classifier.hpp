@@ -2,9 +2,12 @@
 #define _MOURISL_CLASSIFIER_HEADER
 
 #include <string.h>
+#include <algorithm>
 
 #include "Taxonomy.hpp"
+#include "IndexMeta.hpp"
 #include "compactds/FMIndex.hpp"
+#include "compactds/DS_DocumentListing.hpp"
 #include "compactds/Sequence_Hybrid.hpp"
 #include "compactds/Sequence_RunBlock.hpp"
 #include "compactds/Sequence_RunBlockOneTree.hpp"
@@ -25,6 +28,12 @@ struct _classifierParam
   size_t considerSecondaryHitLen ; 
   double considerSecondaryScoreFactor ; // Consider the secondary hit if the score is x*primary score. Default is 0.995
 
+  bool strandEarlyExit ; // stop the minus-strand search once its score bound loses to a full-length plus-strand hit
+
+  // Reads that cannot reach these are unclassified without locating their hits
+  size_t minScore ;
+  int minTotalHitLen ;
+
   _classifierParam()
   {
     maxResult = 1 ;
@@ -34,6 +43,60 @@ struct _classifierParam
 
     considerSecondaryHitLen = 2000 ;
     considerSecondaryScoreFactor = 0.995 ;
+
+    strandEarlyExit = true ;
+
+    minScore = 0 ;
+    minTotalHitLen = 0 ;
+  }
+} ;
+
+// Counters of the work and the shortcuts of Query. Each thread keeps its own copy.
+struct _classifierQueryStats
+{
+  size_t earlyExitCnt ; // reads skipping the minus-strand search in some shard
+  size_t filteredCnt ; // reads below --min-score or --min-hitlen-total
+  size_t filteredBeforeLocateCnt ; // the filtered reads found before locating the hits
+
+  size_t queryCnt ; // reads (read pairs, windows) searched
+  size_t hitCnt ; // hits kept after the strand selection
+  size_t classifiedCnt ;
+  size_t searchCnt ; // backward searches
+  size_t searchStepCnt ; // LF steps of the backward searches after the precomputed prefix
+  size_t locateCnt ; // BWT positions located by walking to a sampled SA
+  size_t locateStepCnt ; // LF steps of the locating
+  size_t listedHitCnt ; // hits whose sequences are listed from the document array
+
+  bool timeStages ; // measure the time below, reading the clock a few times per read
+  double searchTime ;
+  double locateTime ;
+  double reduceTime ; // selecting the best sequences and their taxonomy
+
+  _classifierQueryStats()
+  {
+    earlyExitCnt = filteredCnt = filteredBeforeLocateCnt = 0 ;
+    queryCnt = hitCnt = classifiedCnt = 0 ;
+    searchCnt = searchStepCnt = locateCnt = locateStepCnt = listedHitCnt = 0 ;
+    timeStages = false ;
+    searchTime = locateTime = reduceTime = 0 ;
+  }
+
+  void Add(const struct _classifierQueryStats &s)
+  {
+    earlyExitCnt += s.earlyExitCnt ;
+    filteredCnt += s.filteredCnt ;
+    filteredBeforeLocateCnt += s.filteredBeforeLocateCnt ;
+    queryCnt += s.queryCnt ;
+    hitCnt += s.hitCnt ;
+    classifiedCnt += s.classifiedCnt ;
+    searchCnt += s.searchCnt ;
+    searchStepCnt += s.searchStepCnt ;
+    locateCnt += s.locateCnt ;
+    locateStepCnt += s.locateStepCnt ;
+    listedHitCnt += s.listedHitCnt ;
+    searchTime += s.searchTime ;
+    locateTime += s.locateTime ;
+    reduceTime += s.reduceTime ;
   }
 } ;
 
@@ -88,12 +151,17 @@ template <class FMseqclass>
 class Classifier
 {
 private:
-  FMIndex<FMseqclass> _fm ;
+  FMIndex<FMseqclass> *_fm ; // one FM index for each shard
+  DS_DocumentListing *_docList ; // the optional seqIds of the BWT positions for each shard
+  int _shardCnt ;
   Taxonomy _taxonomy ;
   std::map<size_t, size_t> _seqLength ;
   _classifierParam _param ;
   int _scoreHitLenAdjust ;
   char _compChar[256] ;
+  char _nucCode[256] ; // 3-bit code of each nucleotide for the codon tables
+  char _codonAa[512] ; // amino acid of the codon with the 3-bit codes packed
+  char _rcCodonAa[512] ; // amino acid of the reverse complement of the codon
   bool _protein ;
   
   void ReverseComplement(char *r, int len)
@@ -116,9 +184,11 @@ private:
     if (_protein)
       mhl = 11 ; // Default in kaiju
 
-    int alphabetSize = _fm.GetAlphabetSize() ; 
+    int alphabetSize = _fm[0].GetAlphabetSize() ; 
     uint64_t kmerspace = Utils::PowerInt(alphabetSize, mhl) / 2 ;
-    uint64_t n = _fm.GetSize() ;
+    uint64_t n = 0 ;
+    for (int s = 0 ; s < _shardCnt ; ++s)
+      n += _fm[s].GetSize() ;
     for ( ; mhl <= 32 ; ++mhl)
     {
       if (kmerspace >= 100 * n)
@@ -270,8 +340,23 @@ private:
     return score ;
   }
 
+  // The backward search of FMIndex, counting its LF steps in stats (can be NULL)
+  int BackwardSearch(FMIndex<FMseqclass> &fm, char *s, int m, size_t &sp, size_t &ep,
+      struct _classifierQueryStats *stats)
+  {
+    int l = fm.BackwardSearch(s, m, sp, ep) ;
+    if (stats)
+    {
+      ++stats->searchCnt ;
+      if (l >= (int)fm._auxData.precomputeWidth)
+        stats->searchStepCnt += l - fm._auxData.precomputeWidth + (l < m ? 1 : 0) ;
+    }
+    return l ;
+  }
+
   //@return: the number of hits 
-  size_t GetHitsFromRead(char *r, size_t len, SimpleVector<struct _BWTHit> &hits) 
+  size_t GetHitsFromRead(FMIndex<FMseqclass> &fm, char *r, size_t len, SimpleVector<struct _BWTHit> &hits,
+      struct _classifierQueryStats *stats) 
   {
     size_t sp = 0, ep = 0 ;
     int l = 0 ;
@@ -279,7 +364,7 @@ private:
     
     while (remaining >= _param.minHitLen)
     {
-      l = _fm.BackwardSearch(r, remaining, sp, ep) ;
+      l = BackwardSearch(fm, r, remaining, sp, ep, stats) ;
       if (l >= _param.minHitLen && sp <= ep)
       {
         struct _BWTHit nh(sp, ep, l, len - remaining, 0) ;
@@ -292,6 +377,67 @@ private:
     return hits.Size() ;
   }
 
+  // Continue the search of GetHitsFromRead from the unsearched prefix of length remaining, 
+  //   one backward search at a time, and update the upper bound of the score of the read's hits.
+  // remaining: set to -1 once the search finishes
+  // scoreBound: the score of the hits so far plus the bound of the unsearched prefix. (size_t)-1 if there is no bound.
+  void ExtendHitsFromRead(FMIndex<FMseqclass> &fm, char *r, int len, int &remaining, SimpleVector<struct _BWTHit> &hits,
+      size_t &score, size_t &scoreBound, struct _classifierQueryStats *stats)
+  {
+    if (remaining >= _param.minHitLen)
+    {
+      size_t sp = 0, ep = 0 ;
+      int l = BackwardSearch(fm, r, remaining, sp, ep, stats) ;
+      if (l >= _param.minHitLen && sp <= ep)
+      {
+        struct _BWTHit nh(sp, ep, l, len - remaining, 0) ;
+        hits.PushBack(nh) ;
+        score += CalculateHitScore(l) ;
+      }
+      remaining -= (l + 1) ;
+    }
+    if (remaining < _param.minHitLen)
+      remaining = -1 ;
+
+    size_t bound = MaxHitsScore(remaining < 0 ? 0 : remaining) ;
+    scoreBound = (bound == (size_t)-1) ? bound : score + bound ;
+  }
+
+  // Search the minus strand of the read (pair): the reverse complement of r1 and r2, 
+  //   and stop once its score is bounded to lose the strand selection in SelectStrandHits 
+  //   against plusScore. 
+  //@return: whether the search stops early. The hits are cleared then.
+  bool SearchMinusStrandWithBound(FMIndex<FMseqclass> &fm, char *rcR1, char *r2, 
+      SimpleVector<struct _BWTHit> &r1Hits, SimpleVector<struct _BWTHit> &r2Hits, size_t plusScore,
+      struct _classifierQueryStats *stats)
+  {
+    int m ;
+    char *reads[2] = {rcR1, r2} ;
+    SimpleVector<struct _BWTHit> *hits[2] = {&r1Hits, &r2Hits} ;
+    int len[2] = {(int)strlen(rcR1), r2 ? (int)strlen(r2) : 0} ;
+    int remaining[2] = {len[0], r2 ? len[1] : -1} ;
+    size_t score[2] = {0, 0} ;
+    size_t scoreBound[2] = {MaxHitsScore(len[0]), r2 ? MaxHitsScore(len[1]) : 0} ;
+
+    for (m = 0 ; m <= 1 ; ++m)
+    {
+      while (remaining[m] >= 0)
+      {
+        ExtendHitsFromRead(fm, reads[m], len[m], remaining[m], *hits[m], score[m], scoreBound[m], stats) ;
+        if (scoreBound[0] == (size_t)-1 || scoreBound[1] == (size_t)-1)
+          continue ;
+        size_t bound = scoreBound[0] + scoreBound[1] ;
+        if (plusScore > bound + bound / 100) // the plus strand is selected for sure
+        {
+          r1Hits.Clear() ;
+          r2Hits.Clear() ;
+          return true ;
+        }
+      }
+    }
+    return false ;
+  }
+
   // The hit search method has strand bias, so we shall use the other strand
   //   information to mitigate the bias. This is important if some strain's 
   //   sequence is reverse-complemented.
@@ -300,28 +446,29 @@ private:
   //   Forward search probably would be ~20bp random hits + ~80 real hit
   //   Reverse-complement search: will be 90bp real hit
   //   As a result, we will lose the forward candidate
-  void AdjustHitBoundaryFromStrandHits(char *r, char *rc, int len, 
-      SimpleVector<struct _BWTHit> *strandHits)
+  // plusFm, minusFm: the indexes (shards) where plusHits and minusHits come from
+  void AdjustHitBoundaryFromStrandHits(FMIndex<FMseqclass> &plusFm, FMIndex<FMseqclass> &minusFm, char *r, char *rc, int len, 
+      SimpleVector<struct _BWTHit> &plusHits, SimpleVector<struct _BWTHit> &minusHits, struct _classifierQueryStats *stats)
   {
     int i, j, k ;
-    if (!strandHits[0].Size() || !strandHits[1].Size())
+    if (!minusHits.Size() || !plusHits.Size())
       return ;
-    int hitSize[2] = {strandHits[0].Size(), strandHits[1].Size()} ;
+    int hitSize[2] = {minusHits.Size(), plusHits.Size()} ;
   
-    size_t sp, ep ;
+    size_t sp = 0, ep = 0 ;
     int l ;
     j = hitSize[0] - 1 ;
     bool needFix[2] = {false, false} ;
     for (i = 0 ; i < hitSize[1] ; ++i)
     {
       int left, right ; // range on the read, original read
-      right = len - strandHits[1][i].offset - 1 ; 
-      left = right - strandHits[1][i].l + 1 ;
+      right = len - plusHits[i].offset - 1 ; 
+      left = right - plusHits[i].l + 1 ;
       for ( ; j >= 0 ; --j)
       {
         int rcLeft, rcRight ;
-        rcLeft = strandHits[0][j].offset ;
-        rcRight = rcLeft + strandHits[0][j].l - 1 ;
+        rcLeft = minusHits[j].offset ;
+        rcRight = rcLeft + minusHits[j].l - 1 ;
         
         if (rcLeft >= right) // no overlap yet 
           continue ;
@@ -335,22 +482,22 @@ private:
           break ;
         if (rcRight > right)
         {
-          l = _fm.BackwardSearch(r, rcRight + 1, sp, ep) ;
+          l = BackwardSearch(plusFm, r, rcRight + 1, sp, ep, stats) ;
           if (rcRight - l + 1 == left && sp <= ep)
           {
             struct _BWTHit nh(sp, ep, l, len - rcRight - 1, 1) ;
-            strandHits[1][i] = nh ;
+            plusHits[i] = nh ;
             needFix[1] = true ;
           }
         }
 
         if (left < rcLeft)
         {
-          l = _fm.BackwardSearch(rc, len - left, sp, ep) ;
+          l = BackwardSearch(minusFm, rc, len - left, sp, ep, stats) ;
           if (left + l - 1 == rcRight && sp <= ep)
           {
             struct _BWTHit nh(sp, ep, l, left, -1) ;
-            strandHits[0][j] = nh ;
+            minusHits[j] = nh ;
             needFix[0] = true ;
           }
         }
@@ -360,48 +507,58 @@ private:
     // Trim the hit if there is overlapped caused by boundary adjustment
     for (k = 0 ; k <= 1 ; ++k)
     {
+      SimpleVector<struct _BWTHit> &strandHits = (k == 0 ? minusHits : plusHits) ;
       //for (i = 0 ; i < hitSize[k] ; ++i)
-      //  printf("%d %d: %d %d\n", k, i, strandHits[k][i].offset,
-      //      strandHits[k][i].offset + strandHits[k][i].l - 1) ;
+      //  printf("%d %d: %d %d\n", k, i, strandHits[i].offset,
+      //      strandHits[i].offset + strandHits[i].l - 1) ;
       if (!needFix[k])
         continue ;
-      for (i = 0 ; i < hitSize[k] - 1 ; ++i)
+      TrimOverlappedHits(strandHits) ;
+    } // for k
+  }
+
+  // Shrink the overlapped hits, sorted by offset, so each base is counted once in the score. 
+  //   The shorter hit of the two overlapped hits is shrunk.
+  void TrimOverlappedHits(SimpleVector<struct _BWTHit> &hits)
+  {
+    int i, j ;
+    int hitSize = hits.Size() ;
+    for (i = 0 ; i < hitSize - 1 ; ++i)
+    {
+      int starti = hits[i].offset ; // with respect to the read end (due to backward search) on that strand. Boundary adjustment is moving ahead of the "offset", so it's always the starti moves towards the read end.
+      int endi =  starti + hits[i].l - 1 ;
+      for (j = i + 1 ; j < hitSize ; ++j)
       {
-        int starti = strandHits[k][i].offset ; // with respect to the read end (due to backward search) on that strand. Boundary adjustment is moving ahead of the "offset", so it's always the starti moves towards the read end.
-        int endi =  starti + strandHits[k][i].l - 1 ;
-        for (j = i + 1 ; j < hitSize[k] ; ++j)
-        {
-          int startj = strandHits[k][j].offset ;
-          if (startj > endi)
-            break ;
-          int endj = startj + strandHits[k][j].l - 1 ;
+        int startj = hits[j].offset ;
+        if (startj > endi)
+          break ;
+        int endj = startj + hits[j].l - 1 ;
 
-          // The two hits overlaps
-          if (strandHits[k][j].l >= strandHits[k][i].l)
+        // The two hits overlaps
+        if (hits[j].l >= hits[i].l)
+        {
+          // Shrink i
+          hits[i].l = (startj - starti) ;
+          break ;
+        }
+        else 
+        {
+          // Shrink j
+          if (endj <= endi) // if j is contained in i
+            hits[j].l = 0 ;
+          else
           {
-            // Shrink i
-            strandHits[k][i].l = (startj - starti) ;
+            hits[j].offset = endi + 1 ;
+            hits[j].l = (endj - (endi + 1) + 1) ;
             break ;
           }
-          else 
-          {
-            // Shrink j
-            if (endj <= endi) // if j is contained in i
-              strandHits[k][j].l = 0 ;
-            else
-            {
-              strandHits[k][j].offset = endi + 1 ;
-              strandHits[k][j].l = (endj - (endi + 1) + 1) ;
-              break ;
-            }
-          }
-        } // for j
-      } // for i
-    } // for k
+        }
+      } // for j
+    } // for i
   }
 
   // It seems the performance for synchronize mate pair direction works better
-  size_t SearchForwardAndReverseWithWeakMateDirection(char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
+  size_t SearchForwardAndReverseWithWeakMateDirection(FMIndex<FMseqclass> &fm, char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
   {
     int i, k, ridx ;
     
@@ -425,9 +582,9 @@ private:
       strandHits[0].Clear() ; 
       strandHits[1].Clear() ;
       //Notice that GetHitsFromRead will not clear the hits
-      GetHitsFromRead(r, rlen, strandHits[1]) ;
-      GetHitsFromRead(rc, rlen, strandHits[0]) ;
-      AdjustHitBoundaryFromStrandHits(r, rc, rlen, strandHits) ;
+      GetHitsFromRead(fm, r, rlen, strandHits[1], NULL) ;
+      GetHitsFromRead(fm, rc, rlen, strandHits[0], NULL) ;
+      AdjustHitBoundaryFromStrandHits(fm, fm, r, rc, rlen, strandHits[1], strandHits[0], NULL) ;
       
       size_t strandScore[2] ;
       //int strandLongestHit[2] = {0, 0} ;
@@ -460,134 +617,297 @@ private:
     return hits.Size() ;
   }
 
-  size_t TranslatedSearch(char *r, int rlen, SimpleVector<struct _BWTHit> &hits)
+  void InitCodonTables()
   {
-    int i, k ;
-    int frame ; 
-    char *aa = strdup(r) ; // amino acid sequence
-    SimpleVector<struct _BWTHit> frameHits[3] ;
-    for (frame = 0 ; frame < 3 ; ++frame)
+    int i, j, k ;
+    // Besides ACGTN, DnaToAa treats other characters as T, while their complement is N.
+    const char codeNuc[6] = {'A', 'C', 'G', 'T', 'N', 'X'} ;
+    for (i = 0 ; i < 256 ; ++i)
+      _nucCode[i] = 5 ;
+    for (i = 0 ; i < 5 ; ++i)
+      _nucCode[(int)codeNuc[i]] = i ;
+
+    memset(_codonAa, '?', sizeof(_codonAa)) ;
+    memset(_rcCodonAa, '?', sizeof(_rcCodonAa)) ;
+    for (i = 0 ; i < 6 ; ++i)
+      for (j = 0 ; j < 6 ; ++j)
+        for (k = 0 ; k < 6 ; ++k)
+        {
+          int code = (i << 6) | (j << 3) | k ;
+          _codonAa[code] = DnaToAa(codeNuc[i], codeNuc[j], codeNuc[k]) ;
+          _rcCodonAa[code] = DnaToAa(_compChar[(int)codeNuc[k]], _compChar[(int)codeNuc[j]],
+              _compChar[(int)codeNuc[i]]) ;
+        }
+  }
+
+  // Translate the three frames of r and of its reverse complement in one pass over r.
+  // frames[f], f<3: frame f of r; frames[3+f]: frame f of the reverse complement.
+  // buffer: holds at least 2*rlen+6 characters
+  void TranslateSixFrames(const char *r, int rlen, char *buffer, char **frames, int *frameLens)
+  {
+    int i, f ;
+    int frameSize = rlen / 3 + 1 ;
+    for (f = 0 ; f < 6 ; ++f)
+    {
+      frames[f] = buffer + f * frameSize ;
+      frameLens[f] = (rlen - f % 3 >= 3) ? (rlen - f % 3) / 3 : 0 ;
+      frames[f][frameLens[f]] = '\0' ;
+    }
+    if (rlen < 3)
+      return ;
+
+    // The codon starting at i is at position j=rlen-3-i on the reverse complement.
+    int code = (_nucCode[(unsigned char)r[0]] << 3) | _nucCode[(unsigned char)r[1]] ;
+    int fi = 0, ki = 0 ; // the frame and the index in the frame of i
+    int j = rlen - 3 ;
+    int fj = j % 3, kj = j / 3 ; 
+    for (i = 0 ; i + 2 < rlen ; ++i)
     {
-      k = 0 ;
-      for (i = frame ; i + 2 < rlen ; i += 3)      
+      code = ((code << 3) | _nucCode[(unsigned char)r[i + 2]]) & 511 ;
+      frames[fi][ki] = _codonAa[code] ;
+      frames[3 + fj][kj] = _rcCodonAa[code] ;
+
+      if (++fi == 3)
+      {
+        fi = 0 ;
+        ++ki ;
+      }
+      if (--fj < 0)
       {
-        aa[k] = DnaToAa(r[i], r[i + 1], r[i + 2]) ;
-        // The backward search will handle these unknown characters.
-        //if (aa[k] == '?' || aa[k] == '_')
-        //  aa[k] = '?' ;
-        ++k ;
+        fj = 2 ;
+        --kj ;
       }
-      aa[k] = '\0' ;
-      GetHitsFromRead(aa, k, frameHits[frame]) ;
     }
+  }
 
-    // Use the frame with the highest score
-    size_t maxScore = 0 ;
-    size_t maxTag = 0 ;
-    size_t ret ;
+  // The largest score the hits from the unsearched prefix of length remaining can add.
+  // The hits are disjoint, so their total score is at most that of one hit covering
+  //   the prefix, as long as no hit is shorter than the score adjustment.
+  size_t MaxHitsScore(int remaining)
+  {
+    if (remaining < _param.minHitLen)
+      return 0 ;
+    if (_param.minHitLen < _scoreHitLenAdjust)
+      return (size_t)-1 ;
+    return CalculateHitScore(remaining) ;
+  }
+
+  // frames: the three translated frames of one strand
+  // The frames are searched in turns, always extending the frame with the highest
+  //   score bound, so the search stops once a finished frame bounds all the others.
+  //   The result is the same as searching every frame fully.
+  size_t TranslatedSearch(FMIndex<FMseqclass> &fm, char **frames, int *frameLens, SimpleVector<struct _BWTHit> &hits,
+      struct _classifierQueryStats *stats)
+  {
+    int frame ; 
+    SimpleVector<struct _BWTHit> frameHits[3] ;
+    int remaining[3] ; // the backward search starts from the 3' end of each frame
+    size_t score[3] ;
+    size_t bound[3] ;
     for (frame = 0 ; frame < 3 ; ++frame)
     {
-      int size = frameHits[frame].Size() ;
-      size_t score = 0 ;
-      for (i = 0 ; i < size ; ++i)
-        score += CalculateHitsScore(frameHits[frame]) ;
-      if (score > maxScore)
+      remaining[frame] = frameLens[frame] ;
+      score[frame] = 0 ;
+      bound[frame] = MaxHitsScore(remaining[frame]) ;
+    }
+
+    // Use the frame with the highest score, the earliest one for ties
+    int maxTag ;
+    while (1)
+    {
+      maxTag = 0 ;
+      for (frame = 1 ; frame < 3 ; ++frame)
+        if (bound[frame] > bound[maxTag])
+          maxTag = frame ;
+      if (remaining[maxTag] < _param.minHitLen)
+        break ;
+
+      // The backward search will handle the unknown characters '?' and the stop codons '_'.
+      size_t sp = 0, ep = 0 ;
+      int len = frameLens[maxTag] ;
+      int l = BackwardSearch(fm, frames[maxTag], remaining[maxTag], sp, ep, stats) ;
+      if (l >= _param.minHitLen && sp <= ep)
       {
-        maxScore = score ;
-        maxTag = frame ;
+        struct _BWTHit nh(sp, ep, l, len - remaining[maxTag], 0) ;
+        frameHits[maxTag].PushBack(nh) ;
+        score[maxTag] += CalculateHitScore(l) ;
       }
+      remaining[maxTag] -= (l + 1) ;
+
+      size_t remainingBound = MaxHitsScore(remaining[maxTag]) ;
+      if (remainingBound == (size_t)-1)
+        bound[maxTag] = remainingBound ;
+      else
+        bound[maxTag] = score[maxTag] + remainingBound ;
     }
 
-    ret = frameHits[maxTag].Size() ;
+    size_t ret = frameHits[maxTag].Size() ;
     hits.PushBack( frameHits[maxTag] ) ;
 
-    free(aa) ;
     return ret ;
   }
 
-  //@return: the size of the hits after selecting the strand 
-  size_t SearchForwardAndReverse(char *r1, char *r2, SimpleVector<struct _BWTHit> &hits)
+  // Search the six frames of r, strandHits[1] for the frames of r and strandHits[0] 
+  //   for the frames of its reverse complement.
+  void TranslatedSearchBothStrands(FMIndex<FMseqclass> &fm, char *r, int rlen, SimpleVector<struct _BWTHit> *strandHits,
+      struct _classifierQueryStats *stats)
   {
-    int i, k ;
-    char *rcR1 = NULL ;
-    char *rcR2 = NULL ;
-    int r1len = strlen(r1) ;
-    rcR1 = strdup(r1) ;
-    ReverseComplement(rcR1, r1len) ;
+    char stackBuffer[2048] ; // enough for the usual short reads
+    char *buffer = stackBuffer ;
+    if (2 * rlen + 6 > (int)sizeof(stackBuffer))
+      buffer = (char *)malloc(sizeof(char) * (2 * rlen + 6)) ;
     
-    SimpleVector<struct _BWTHit> strandHits[2] ; // 0: minus strand, 1: postive strand
+    char *frames[6] ;
+    int frameLens[6] ;
+    TranslateSixFrames(r, rlen, buffer, frames, frameLens) ;
+    TranslatedSearch(fm, frames, frameLens, strandHits[1], stats) ;
+    TranslatedSearch(fm, frames + 3, frameLens + 3, strandHits[0], stats) ;
+
+    if (buffer != stackBuffer)
+      free(buffer) ;
+  }
+
+  // Whether the hits are one hit spanning the whole read
+  bool IsFullLengthHit(const SimpleVector<struct _BWTHit> &hits, int len)
+  {
+    return hits.Size() == 1 && hits[0].l == len ;
+  }
+
+  // Search both strands of the read (pair) on one index, without adjusting the hit boundaries 
+  //   or selecting the strand.
+  // readStrandHits: [0] and [1] get the hits of the reverse complement and the read of r1, [2] and [3] for r2
+  // rcR1, rcR2: the reverse complements of the reads
+  // allowEarlyExit: stop the minus-strand search once it cannot be selected
+  // earlyExit: set to true if the minus-strand search stops early, and its hits are empty
+  // stats: counts the backward searches, can be NULL
+  void SearchForwardAndReverse(FMIndex<FMseqclass> &fm, char *r1, char *rcR1, char *r2, char *rcR2, 
+      SimpleVector<struct _BWTHit> *readStrandHits, bool allowEarlyExit, bool *earlyExit = NULL, 
+      struct _classifierQueryStats *stats = NULL)
+  {
+    if (earlyExit)
+      *earlyExit = false ;
+
+    int r1len = strlen(r1) ;
+    int r2len = r2 ? strlen(r2) : 0 ;
+    SimpleVector<struct _BWTHit> *strandHits = readStrandHits ; // 0: minus strand, 1: postive strand
+    SimpleVector<struct _BWTHit> *r2StrandHits = readStrandHits + 2 ;
    
-    if (!_protein)
-    {
-      GetHitsFromRead(r1, r1len, strandHits[1]) ;
-      GetHitsFromRead(rcR1, r1len, strandHits[0]) ;
-      AdjustHitBoundaryFromStrandHits(r1, rcR1, r1len, strandHits) ;
-    }
-    else
+    if (_protein)
     {
-      TranslatedSearch(r1, r1len, strandHits[1]) ;
-      TranslatedSearch(rcR1, r1len, strandHits[0]) ;
+      TranslatedSearchBothStrands(fm, r1, r1len, strandHits, stats) ;
+      if (r2)
+        TranslatedSearchBothStrands(fm, r2, r2len, r2StrandHits, stats) ;
+      return ;
     }
 
+    GetHitsFromRead(fm, r1, r1len, strandHits[1], stats) ;
     if (r2)
-    {
-      rcR2 = strdup(r2) ;
-      int r2len = strlen(r2) ;
-      ReverseComplement(rcR2, r2len) ;
-      SimpleVector<struct _BWTHit> r2StrandHits[2] ; // 0: minus strand, 1: postive strand
+      GetHitsFromRead(fm, rcR2, r2len, r2StrandHits[0], stats) ;
       
-      if (!_protein)
+    // If the read (and its mate on the other strand) is covered by one hit, the boundary 
+    //   adjustment cannot change the plus-strand hits, so the minus-strand search can stop 
+    //   once its score bound loses to the plus strand by more than 1%.
+    if (allowEarlyExit && IsFullLengthHit(strandHits[1], r1len) 
+        && (r2 == NULL || IsFullLengthHit(r2StrandHits[0], r2len)))
+    {
+      size_t plusScore = CalculateHitsScore(strandHits[1]) + CalculateHitsScore(r2StrandHits[0]) ;
+      if (SearchMinusStrandWithBound(fm, rcR1, r2, strandHits[0], r2StrandHits[1], plusScore, stats))
       {
-        GetHitsFromRead(r2, r2len, r2StrandHits[1]) ;
-        GetHitsFromRead(rcR2, r2len, r2StrandHits[0]) ;
-        AdjustHitBoundaryFromStrandHits(r2, rcR2, r2len, r2StrandHits) ;
+        if (earlyExit)
+          *earlyExit = true ;
       }
-      else
+      return ;
+    }
+
+    GetHitsFromRead(fm, rcR1, r1len, strandHits[0], stats) ;
+    if (r2)
+      GetHitsFromRead(fm, r2, r2len, r2StrandHits[1], stats) ;
+  }
+
+  // Adjust the hit boundaries between the strands of each read, and keep the hits of 
+  //   the strand with the higher score, or both strands if the scores are within 1%.
+  //   The plus-strand hits of every shard are adjusted against the minus-strand hits of 
+  //   every shard, each re-searched on its own shard, and the strand scores are the best over the shards, 
+  //   so the strand is selected once for all the shards. 
+  // shardReadStrandHits: the hits from SearchForwardAndReverse, 4 entries for each shard
+  //@return: whether the minus-strand hits are kept
+  bool SelectStrandHits(char *r1, char *rcR1, char *r2, char *rcR2, 
+      std::vector< SimpleVector<struct _BWTHit> > &shardReadStrandHits,
+      std::vector< SimpleVector<struct _BWTHit> > &shardHits, struct _classifierQueryStats *stats)
+  {
+    int i, k, m, s, t ;
+    char *reads[2] = {r1, r2} ;
+    char *rcReads[2] = {rcR1, rcR2} ;
+    
+    if (!_protein)
+    {
+      for (m = 0 ; m <= 1 ; ++m)
       {
-        TranslatedSearch(r2, r2len, r2StrandHits[1]) ;
-        TranslatedSearch(rcR2, r2len, r2StrandHits[0]) ;
+        if (reads[m] == NULL)
+          break ;
+        int len = strlen(reads[m]) ;
+        for (s = 0 ; s < _shardCnt ; ++s)
+          for (t = 0 ; t < _shardCnt ; ++t)
+            AdjustHitBoundaryFromStrandHits(_fm[s], _fm[t], reads[m], rcReads[m], len, 
+                shardReadStrandHits[4 * s + 2 * m + 1], shardReadStrandHits[4 * t + 2 * m], stats) ;
       }
-
-      for (i = 0 ; i <= 1 ; ++i)
-        strandHits[i].PushBack(r2StrandHits[1 - i]) ;
     }
-    
-    size_t strandScore[2] ;
-    for (k = 0 ; k < 2 ; ++k)
+
+    size_t strandScore[2] = {0, 0} ;
+    std::vector< SimpleVector<struct _BWTHit> > shardStrandHits(2 * _shardCnt) ;
+    for (s = 0 ; s < _shardCnt ; ++s)
     {
-      int size = strandHits[k].Size() ;
-      for (i = 0 ; i < size ; ++i)
-        strandHits[k][i].strand = 2 * k - 1 ; // the strand is with respect to the template, not read
-      strandScore[k] = CalculateHitsScore(strandHits[k]) ;
+      SimpleVector<struct _BWTHit> *strandHits = &shardStrandHits[2 * s] ;
+      SimpleVector<struct _BWTHit> *readStrandHits = &shardReadStrandHits[4 * s] ;
+      for (k = 0 ; k <= 1 ; ++k)
+      {
+        strandHits[k] = readStrandHits[k] ;
+        if (r2)
+          strandHits[k].PushBack(readStrandHits[2 + 1 - k]) ;
+        
+        int size = strandHits[k].Size() ;
+        for (i = 0 ; i < size ; ++i)
+          strandHits[k][i].strand = 2 * k - 1 ; // the strand is with respect to the template, not read
+        size_t score = CalculateHitsScore(strandHits[k]) ;
+        if (score > strandScore[k])
+          strandScore[k] = score ;
+      }
     }
 #ifdef LI_DEBUG
     printf("%s %lu %lu\n", __func__, strandScore[0], strandScore[1]) ;    
 #endif
-  
 
-    if (strandScore[1] > strandScore[0] + strandScore[0] / 100)
-      hits = strandHits[1] ;
-    else if (strandScore[0] > strandScore[1] + strandScore[1] / 100)
-      hits = strandHits[0] ;
-    else
+    bool keepMinus = true ;
+    for (s = 0 ; s < _shardCnt ; ++s)
     {
-      hits = strandHits[1] ;
-      hits.PushBack(strandHits[0]) ;
+      SimpleVector<struct _BWTHit> *strandHits = &shardStrandHits[2 * s] ;
+      if (strandScore[1] > strandScore[0] + strandScore[0] / 100)
+      {
+        shardHits[s] = strandHits[1] ;
+        keepMinus = false ;
+      }
+      else if (strandScore[0] > strandScore[1] + strandScore[1] / 100)
+        shardHits[s] = strandHits[0] ;
+      else
+      {
+        shardHits[s] = strandHits[1] ;
+        shardHits[s].PushBack(strandHits[0]) ;
+      }
     }
-    
-    free(rcR1) ;
-    if (rcR2)
-      free(rcR2) ;
-
-    return hits.Size() ;
+    return keepMinus ;
   }
 
-  size_t GetClassificationFromHits(const SimpleVector<struct _BWTHit> &hits, struct _classifierResult &result)
+  // Accumulate the score of each seqId from the hits on one FM index (shard).
+  //   The records are added to seqIdStrandHitRecord, so hits from several shards can be merged.
+  // stats: counts the located positions, can be NULL
+  void CollectSeqIdHitRecords(FMIndex<FMseqclass> &fm, const DS_DocumentListing &docList, 
+      const SimpleVector<struct _BWTHit> &hits, std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord,
+      struct _classifierQueryStats *stats)
   {
     int i, k ;
     size_t j ;
+    std::vector<size_t> listedSeqIds ;
     int hitCnt = hits.Size() ;
-    std::map<size_t, struct _seqHitRecord > seqIdStrandHitRecord[2] ;
     
     struct _seqHitRecord prevUniqHitRecord ; // record information from previous unique hit 
     prevUniqHitRecord.seqId = 0 ;
@@ -618,18 +938,49 @@ private:
       printf("hit: %d %d sp-ep: %lu %lu %lu offset_l: %d %d\n", i, k, hits[i].sp, hits[i].ep, hits[i].ep - hits[i].sp + 1, hits[i].offset, hits[i].l) ;
 #endif
       const size_t maxEntries = _param.maxResult * _param.maxResultPerHitFactor ;
-      if (hits[i].ep - hits[i].sp + 1 <= maxEntries 
+      if (docList.IsInit())
+      {
+        // Reading a run costs much less than locating a position (up to sampleRate LF steps),
+        //   so list all the seqIds if the runs fit in the budget of locating maxEntries positions.
+        const size_t maxRuns = maxEntries * fm._auxData.sampleRate ;
+        if (docList.GetRangeRunCount(hits[i].sp, hits[i].ep) <= maxRuns
+            || _param.maxResultPerHitFactor <= 0
+            || _param.maxResult <= 0)
+        {
+          listedSeqIds.clear() ;
+          docList.ListRange(hits[i].sp, hits[i].ep, listedSeqIds) ;
+          std::sort(listedSeqIds.begin(), listedSeqIds.end()) ;
+          for (j = 0 ; j < listedSeqIds.size() ; ++j)
+            if (j == 0 || listedSeqIds[j] != listedSeqIds[j - 1])
+              localSeqIdHit[ listedSeqIds[j] ] = 1 ;
+          if (stats)
+            ++stats->listedHitCnt ;
+        }
+        else
+        {
+          size_t step = DIV_CEIL(hits[i].ep - hits[i].sp + 1, maxRuns) ;
+          for (j = hits[i].sp ; j <= hits[i].ep ; j += step)
+            localSeqIdHit[ docList.Access(j) ] = 1 ;
+          localSeqIdHit[ docList.Access(hits[i].ep) ] = 1 ;
+        }
+      }
+      else if (hits[i].ep - hits[i].sp + 1 <= maxEntries 
           || _param.maxResultPerHitFactor <= 0
           || _param.maxResult <= 0)
       {
         for (j = hits[i].sp ; j <= hits[i].ep ; ++j)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("taxId: %lu seqId: %lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) ), seqId) ;
 #endif
           localSeqIdHit[seqId] = 1 ;
+          if (stats)
+          {
+            ++stats->locateCnt ;
+            stats->locateStepCnt += backsearchL ;
+          }
         }
       }
       else
@@ -643,23 +994,33 @@ private:
         for (j = hits[i].sp ; j <= hits[i].ep ; j += step)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("%lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) )) ;
 #endif
           localSeqIdHit[seqId] = 1 ;
           ++resolvedCnt ;
+          if (stats)
+          {
+            ++stats->locateCnt ;
+            stats->locateStepCnt += backsearchL ;
+          }
         }
 
         for (j = hits[i].ep ; j >= hits[i].sp && j <= hits[i].ep ; j -= step)
         {
           size_t backsearchL = 0 ;
-          size_t seqId = _fm.BackwardToSampledSA(j, backsearchL) ;
+          size_t seqId = fm.BackwardToSampledSA(j, backsearchL) ;
 #ifdef LI_DEBUG
           printf("%lu\n", _taxonomy.GetOrigTaxId( _taxonomy.SeqIdToTaxId(seqId) )) ;
 #endif
           localSeqIdHit[seqId] = 1 ;
           ++resolvedCnt ;
+          if (stats)
+          {
+            ++stats->locateCnt ;
+            stats->locateStepCnt += backsearchL ;
+          }
           if (resolvedCnt >= maxEntries)
             break ;
         }
@@ -706,7 +1067,12 @@ private:
         }
       }
     }
+  }
 
+  size_t GetClassificationFromSeqIdHitRecords(std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord, 
+      struct _classifierResult &result)
+  {
+    int i, k ;
     // Select the best score
     size_t bestScore = 0 ;
     size_t secondBestScore = 0 ;
@@ -853,45 +1219,36 @@ public:
     _compChar['C'] = 'G' ;
     _compChar['G'] = 'C' ;
     _compChar['T'] = 'A' ;
+    InitCodonTables() ;
+
+    _fm = NULL ;
+    _docList = NULL ;
+    _shardCnt = 0 ;
   }
 
   ~Classifier() {Free() ;}
 
   void Free()
   {
-    _fm.Free() ;
+    if (_fm != NULL)
+    {
+      delete[] _fm ;
+      delete[] _docList ;
+      _fm = NULL ;
+      _docList = NULL ;
+      _shardCnt = 0 ;
+    }
     _taxonomy.Free() ;
     _seqLength.clear() ;
   }
 
   bool IsProteinDatabase(char *idxPrefix)
   {
-    bool ret = false ;
-
-    // .4.cfr file for some plain text index descrition. We can get the sequence type there
-    char key[128] ;
     char val[128] ;
-    char *nameBuffer = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 17))  ;  
-    sprintf(nameBuffer, "%s.4.cfr", idxPrefix) ;
-    FILE *fp = fopen(nameBuffer, "r") ;
-    if (fp == NULL) // no .4 file exist
-    {
-      free(nameBuffer) ;
-      return ret ;
-    }
-
-    while (fscanf(fp, "%s %s", key, val) != EOF)
-    {
-      if (!strcmp(key, "sequence_type"))
-      {
-        if (!strcmp(val, "amino_acid"))
-          ret = true ;
-      }
-    }
-    fclose(fp) ;
-    
-    free(nameBuffer) ;
-    return ret ;
+    // We can get the sequence type from the .4.cfr file 
+    if (IndexMeta::Get(idxPrefix, "sequence_type", val) && !strcmp(val, "amino_acid"))
+      return true ;
+    return false ;
   }
 
   bool IsProteinDatabase()
@@ -901,17 +1258,51 @@ public:
 
   void Init(char *idxPrefix, struct _classifierParam param)
   {
+    int i ;
     FILE *fp ;
-    char *nameBuffer = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 17))  ;  
+    char *nameBuffer = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 40))  ;  
  
-    // .1.cfr file for FM index
-    sprintf(nameBuffer, "%s.1.cfr", idxPrefix) ;
-    fp = fopen(nameBuffer, "r") ;
-    _fm.Load(fp) ;
-    fclose(fp) ;
+    // The sharded index has the files [idxPrefix].shard[i].*.cfr. 
+    //   All the shards share the same seqId assignment.
+    _shardCnt = IndexMeta::GetShardCount(idxPrefix) ;
+    _fm = new FMIndex<FMseqclass>[_shardCnt] ;
+    _docList = new DS_DocumentListing[_shardCnt] ;
+    char *shardPrefix = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 20)) ;
+    for (i = 0 ; i < _shardCnt ; ++i)
+    {
+      IndexMeta::GetShardPrefix(idxPrefix, i, _shardCnt, shardPrefix) ;
+
+      // .1.cfr file for FM index
+      sprintf(nameBuffer, "%s.1.cfr", shardPrefix) ;
+      fp = fopen(nameBuffer, "r") ;
+      if (fp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to open the index file %s.\n", nameBuffer) ;
+        exit(EXIT_FAILURE) ;
+      }
+      _fm[i].Load(fp) ;
+      fclose(fp) ;
+
+      // .5.cfr file for the document listing, built with --doc-listing
+      char val[128] ;
+      if (IndexMeta::Get(shardPrefix, "document_listing", val))
+      {
+        sprintf(nameBuffer, "%s.5.cfr", shardPrefix) ;
+        fp = fopen(nameBuffer, "r") ;
+        if (fp == NULL)
+        {
+          fprintf(stderr, "ERROR: failed to open the index file %s.\n", nameBuffer) ;
+          exit(EXIT_FAILURE) ;
+        }
+        _docList[i].Load(fp) ;
+        fclose(fp) ;
+      }
+    }
+    if (_shardCnt > 1)
+      Utils::PrintLog("Loaded %d index shards.", _shardCnt) ;
 
     // .2.cfr file is for taxonomy structure
-    sprintf(nameBuffer, "%s.2.cfr", idxPrefix) ;
+    IndexMeta::GetTaxonomyFile(idxPrefix, _shardCnt, nameBuffer) ;
     fp = fopen(nameBuffer, "r") ;
     _taxonomy.SetNeedSeqNameToId(false) ;
     _taxonomy.Load(fp) ;
@@ -943,18 +1334,188 @@ public:
       Utils::PrintLog("Inferred --min-hitlen: %d", _param.minHitLen) ;
     }
 
+    free(shardPrefix) ;
     free(nameBuffer) ;
   }
 
-  // Main function to return the classification results 
-  void Query(char *r1, char *r2, struct _classifierResult &result)
+  // The largest score and hit length any sequence can get from the hits, 
+  //   where the hits on each strand may all go to one sequence.
+  void GetHitsBound(const SimpleVector<struct _BWTHit> &hits, size_t &maxScore, int &maxHitLength)
   {
+    int i, k ;
+    int hitCnt = hits.Size() ;
+    int strandHitLength[2] = {0, 0} ;
+    for (i = 0 ; i < hitCnt ; ++i)
+      if (hits[i].l >= _param.minHitLen)
+        strandHitLength[(hits[i].strand + 1) / 2] += hits[i].l ;
+    
+    for (k = 0 ; k <= 1 ; ++k)
+    {
+      // The adjacent unique hits are scored as one, so use the score of one long hit
+      size_t score = MaxHitsScore(strandHitLength[k]) ;
+      if (score > maxScore)
+        maxScore = score ;
+      if (strandHitLength[k] > maxHitLength)
+        maxHitLength = strandHitLength[k] ;
+    }
+  }
+
+  // Search the read (pair) and collect the hits of each seqId over all the shards.
+  // applyFilters: skip locating the hits if the read cannot pass the score filters 
+  //@return: false if the read is filtered, and the records are not collected
+  bool QuerySeqIdHitRecords(char *r1, char *r2, std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord,
+      bool applyFilters, struct _classifierQueryStats *stats)
+  {
+    int s ;
+    std::vector< SimpleVector<struct _BWTHit> > shardHits(_shardCnt) ;
+    
+    // Each shard is searched independently. The strands are compared over all the 
+    //   shards, and the per-seqId scores are merged before selecting the best hits. 
+    //   The hits are the longest matches in each shard rather than in all the genomes, 
+    //   so the result can differ from the index without sharding.
+    bool earlyExit = false ;
+    size_t maxScore = 0 ;
+    int maxHitLength = 0 ;
+    bool timeStages = (stats != NULL && stats->timeStages) ;
+    double startTime = timeStages ? Utils::GetWallTime() : 0 ;
+    char *rcR1 = strdup(r1) ;
+    ReverseComplement(rcR1, strlen(r1)) ;
+    char *rcR2 = NULL ;
+    if (r2)
+    {
+      rcR2 = strdup(r2) ;
+      ReverseComplement(rcR2, strlen(r2)) ;
+    }
+
+    std::vector< SimpleVector<struct _BWTHit> > shardReadStrandHits(4 * _shardCnt) ;
+    bool allowEarlyExit = _param.strandEarlyExit ;
+    while (1)
+    {
+      // The early exit of one shard only bounds its own minus strand. Across the shards, 
+      //   it is exact if the minus strand is not selected and no plus-strand hit 
+      //   can be adjusted by the skipped minus-strand hits, otherwise search again without it.
+      bool exactExit = true ;
+      earlyExit = false ;
+      for (s = 0 ; s < _shardCnt ; ++s)
+      {
+        bool shardEarlyExit ;
+        shardReadStrandHits[4 * s].Clear() ;
+        shardReadStrandHits[4 * s + 1].Clear() ;
+        shardReadStrandHits[4 * s + 2].Clear() ;
+        shardReadStrandHits[4 * s + 3].Clear() ;
+        SearchForwardAndReverse(_fm[s], r1, rcR1, r2, rcR2, &shardReadStrandHits[4 * s], 
+            allowEarlyExit, &shardEarlyExit, stats) ;
+        earlyExit |= shardEarlyExit ;
+        
+        if ((shardReadStrandHits[4 * s + 1].Size() > 0 && !IsFullLengthHit(shardReadStrandHits[4 * s + 1], strlen(r1)))
+            || (r2 && shardReadStrandHits[4 * s + 2].Size() > 0 
+              && !IsFullLengthHit(shardReadStrandHits[4 * s + 2], strlen(r2))))
+          exactExit = false ;
+      }
+      bool keepMinus = SelectStrandHits(r1, rcR1, r2, rcR2, shardReadStrandHits, shardHits, stats) ;
+      if (!earlyExit || (exactExit && !keepMinus))
+        break ;
+      allowEarlyExit = false ;
+    }
+    
+    free(rcR1) ;
+    if (rcR2)
+      free(rcR2) ;
+    for (s = 0 ; s < _shardCnt ; ++s)
+    {
+      GetHitsBound(shardHits[s], maxScore, maxHitLength) ;
+      if (stats)
+        stats->hitCnt += shardHits[s].Size() ;
+    }
+    if (stats)
+    {
+      ++stats->queryCnt ;
+      if (earlyExit)
+        ++stats->earlyExitCnt ;
+    }
+    if (timeStages)
+    {
+      double endTime = Utils::GetWallTime() ;
+      stats->searchTime += endTime - startTime ;
+      startTime = endTime ;
+    }
+
+    // Locating the hits is the costly part, so skip it if the read is to be filtered anyway.
+    if (applyFilters && (maxScore < _param.minScore || maxHitLength < _param.minTotalHitLen))
+    {
+      if (stats && maxHitLength > 0) // reads without hits are unclassified anyway
+      {
+        ++stats->filteredCnt ;
+        ++stats->filteredBeforeLocateCnt ;
+      }
+      return false ;
+    }
+    
+    for (s = 0 ; s < _shardCnt ; ++s)
+      CollectSeqIdHitRecords(_fm[s], _docList[s], shardHits[s], seqIdStrandHitRecord, stats) ;
+    if (timeStages)
+      stats->locateTime += Utils::GetWallTime() - startTime ;
+    return true ;
+  }
+
+  // Add the records from another part of the read, e.g. a window of a long read
+  void MergeSeqIdHitRecords(std::map<size_t, struct _seqHitRecord> *to, 
+      const std::map<size_t, struct _seqHitRecord> *from)
+  {
+    int k ;
+    for (k = 0 ; k <= 1 ; ++k)
+    {
+      for (std::map<size_t, struct _seqHitRecord>::const_iterator iter = from[k].begin() ;
+          iter != from[k].end() ; ++iter)
+      {
+        std::map<size_t, struct _seqHitRecord>::iterator toIter = to[k].find(iter->first) ;
+        if (toIter == to[k].end())
+          to[k][iter->first] = iter->second ;
+        else
+        {
+          toIter->second.score += iter->second.score ;
+          toIter->second.hitLength += iter->second.hitLength ;
+        }
+      }
+    }
+  }
+
+  // Select the best sequences from the records, and unclassify the results below the score filters.
+  //   The result's queryLength is not set.
+  void ClassifyFromSeqIdHitRecords(std::map<size_t, struct _seqHitRecord> *seqIdStrandHitRecord,
+      struct _classifierResult &result, struct _classifierQueryStats *stats)
+  {
+    double startTime = (stats != NULL && stats->timeStages) ? Utils::GetWallTime() : 0 ;
     result.Clear() ;
+    GetClassificationFromSeqIdHitRecords(seqIdStrandHitRecord, result) ;
+
+    if (result.taxIds.size() > 0 
+        && (result.score < _param.minScore || result.hitLength < _param.minTotalHitLen))
+    {
+      result.Clear() ;
+      if (stats)
+        ++stats->filteredCnt ;
+    }
 
-    SimpleVector<struct _BWTHit> hits ;
+    if (stats)
+    {
+      if (result.taxIds.size() > 0)
+        ++stats->classifiedCnt ;
+      if (stats->timeStages)
+        stats->reduceTime += Utils::GetWallTime() - startTime ;
+    }
+  }
+
+  // Main function to return the classification results 
+  // stats: if not NULL, counts the work and the shortcuts for this read 
+  void Query(char *r1, char *r2, struct _classifierResult &result, struct _classifierQueryStats *stats = NULL)
+  {
+    std::map<size_t, struct _seqHitRecord> seqIdStrandHitRecord[2] ;
+    
+    result.Clear() ;
+    if (QuerySeqIdHitRecords(r1, r2, seqIdStrandHitRecord, true, stats))
+      ClassifyFromSeqIdHitRecords(seqIdStrandHitRecord, result, stats) ;
     
-    SearchForwardAndReverse(r1, r2, hits) ;
-    GetClassificationFromHits(hits, result) ;
     result.queryLength = strlen(r1) ;
     if (r2)
       result.queryLength += strlen(r2) ;
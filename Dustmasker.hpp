@@ -4,7 +4,10 @@
 // SDust algorithm
 // Mask the low-complexity regions in the input sequence. Return the low-complexity intervals (0-based, inclusive on both end) 
 // The algorithm is based on the DUST algorithm described in Morgulis et al. "A Fast and Symmetric DUST Implementation to Mask Low-Complexity DNA Sequences". J Comput Biol. 2006 Apr;13(5):1028-40. doi: 10.1089/cmb.2006.13.1028. PMID: 16646928.
+// The counts, the window and the perfect intervals are kept in the object and reset after each sequence,
+//   so each thread should use its own Dustmasker.
 #include <stdlib.h>
+#include <string.h>
 
 #include <vector>
 #include <algorithm>
@@ -45,19 +48,36 @@ private:
       }
 
       Dustmasker_Queue(int sz)
+      {
+        _s = NULL ;
+        _mask = 0 ;
+        Reserve(sz) ;
+      }
+
+      ~Dustmasker_Queue()
+      {
+        if (_s != NULL)
+          free(_s) ;
+      }
+
+      // Make sure the queue can hold sz elements, and empty it
+      void Reserve(int sz)
       {
         _head = _tail = 0 ;
+        if (_s != NULL && _mask >= sz)
+          return ;
         int capacityBits = 0 ;
         while ((1 << capacityBits) <= sz)
           ++capacityBits ;
+        if (_s != NULL)
+          free(_s) ;
         _s = (int *)malloc(sizeof(int) * (1 << capacityBits)) ;
         _mask = (1 << capacityBits) - 1 ;
       }
 
-      ~Dustmasker_Queue()
+      void Clear()
       {
-        if (_s != NULL)
-          free(_s) ;
+        _head = _tail = 0 ;
       }
 
       int Size()
@@ -89,6 +109,16 @@ private:
       }
   } ;
 
+  // The states of SDust kept across the calls
+  int *_countV ;
+  int *_countW ;
+  int *_codes ; // the triplet codes of the sequence
+  size_t _codesCapacity ;
+  std::vector<struct _dustmasker_perfect_interval> _P ;
+  std::vector<struct _dustmasker_perfect_interval> _windowResult ;
+  std::vector<struct _dustmasker_perfect_interval> _result ;
+  Dustmasker_Queue _window ;
+
   // r is the score without normalize the length. It increase count[tripletCode] when adding a triplet.
   void AddTripletInfo(int tripletCode, int *count, int &r) 
   {
@@ -175,6 +205,10 @@ private:
     int i ;
     int maxScore = 0 ;
     int maxScoreTripletCount = 1 ;
+    // P is sorted by descending start, so the intervals inside the suffix form a prefix of P 
+    //   that only grows as i decreases. The maximum score over the prefix is kept,
+    //   and each interval is scanned once instead of from the beginning for every i.
+    size_t j = 0 ; 
     //int *tmpc = (int *)calloc(64, sizeof(int)) ;
     //int tmpc[512] ;
     //memcpy(tmpc, cv, sizeof(int) * 512) ;
@@ -184,7 +218,6 @@ private:
     {
       int t = window[i] ;
       AddTripletInfo(t, cv, rv) ;
-      std::vector<struct _dustmasker_perfect_interval>::iterator it = P.begin() ;
       //int newScore =  rv * 10 / (window.size() - i - 1) ; // the score of the suffix starting form position i 
       /*{
         int n = window.size() - i ;
@@ -200,14 +233,14 @@ private:
       if (rv * 10 > _T * (window.Size() - i - 1))
       {
         // When the prefect interval is inside of the current suffix
-        while (it != P.end() && it->start >= i + windowStart)
+        while (j < P.size() && P[j].start >= i + windowStart)
         {
-          if ((size_t)it->score * maxScoreTripletCount > maxScore * (it->end - it->start - 2)) 
+          if ((size_t)P[j].score * maxScoreTripletCount > maxScore * (P[j].end - P[j].start - 2)) 
           {
-            maxScore = it->score ;
-            maxScoreTripletCount = it->end - it->start - 2 ;
+            maxScore = P[j].score ;
+            maxScoreTripletCount = P[j].end - P[j].start - 2 ;
           }
-          ++it ;
+          ++j ;
         }
 
         if (rv * maxScoreTripletCount >= maxScore * (window.Size() - i - 1)) // Perfect interval requires that no subinterval has higher score.
@@ -220,7 +253,8 @@ private:
           newPerfectInterval.end = windowStart + window.Size() + 1 ; //+1 is for the triplet
           newPerfectInterval.score = rv ;
           //printf("%lu %lu %d\n", newPerfectInterval.start, newPerfectInterval.end, newPerfectInterval.score) ;
-          P.insert(it, newPerfectInterval) ; // insert the new interval before the iterator position.
+          P.insert(P.begin() + j, newPerfectInterval) ; // insert the new interval before position j.
+          ++j ; // the new interval holds the maximum score
         }
       }
     }
@@ -252,11 +286,21 @@ public:
     {
       _alphabetMap[i] = -1 ;
     }
+    _alphabetSize = _alphabetBit = 0 ;
+    _countV = _countW = _codes = NULL ;
+    _codesCapacity = 0 ;
   }
 
   ~Dustmasker() 
   {
     delete[] _alphabetMap ;
+    if (_countV != NULL)
+    {
+      free(_countV) ;
+      free(_countW) ;
+    }
+    if (_codes != NULL)
+      free(_codes) ;
   }
 
   void SetWindowSize(int w)
@@ -306,6 +350,39 @@ public:
     _alphabetBit = 0 ;
     while ((1 << _alphabetBit) < n)
       ++_alphabetBit ;
+
+    if (_countV != NULL)
+    {
+      free(_countV) ;
+      free(_countW) ;
+    }
+    _countV = (int *)calloc(1 << (3 * _alphabetBit), sizeof(int)) ;
+    _countW = (int *)calloc(1 << (3 * _alphabetBit), sizeof(int)) ;
+  }
+
+  // Encode the triplet starting at each position of S into _codes. 
+  // The character codes are looked up first, so combining them
+  //   into triplets is a plain loop the compiler can vectorize.
+  void EncodeTriplets(const char *S, size_t n)
+  {
+    size_t i ;
+    if (n > _codesCapacity)
+    {
+      if (_codes != NULL)
+        free(_codes) ;
+      _codesCapacity = n + n / 2 ;
+      _codes = (int *)malloc(sizeof(int) * _codesCapacity) ;
+    }
+    
+    int *codes = _codes ;
+    const int *map = _alphabetMap ;
+    for (i = 0 ; i < n ; ++i)
+      codes[i] = map[(unsigned char)S[i]] ;
+    
+    const int shift1 = _alphabetBit ;
+    const int shift2 = 2 * _alphabetBit ;
+    for (i = 0 ; i + 2 < n ; ++i)
+      codes[i] = (codes[i] << shift2) | (codes[i + 1] << shift1) | codes[i + 2] ;
   }
 
   // The sdust algorithm
@@ -316,17 +393,16 @@ public:
 
     size_t wstart, wfinish ;
 
-    int triplet = 0 ;
-    int tripletMask = (1<<(3 * _alphabetBit)) - 1 ; // mask for the triplet code 
-    
-    int *countV = (int *)calloc(tripletMask + 1, sizeof(int) ); // cv: count for the suffix v that satisfy max{c(v)}<=2T
-    int *countW = (int *)calloc(tripletMask + 1, sizeof(int) ); // cw: count for the current window 
+    int *countV = _countV ; // cv: count for the suffix v that satisfy max{c(v)}<=2T
+    int *countW = _countW ; // cw: count for the current window 
     int rv = 0, rw = 0, lv = 0 ;
 
-    Dustmasker_Queue window(_w) ; // store the triplet code in the current window. The actual bases covered by the window is window.size() + 2.
-    std::vector<struct _dustmasker_perfect_interval> P ; 
+    _window.Reserve(_w) ; // store the triplet code in the current window. The actual bases covered by the window is window.size() + 2.
+    Dustmasker_Queue &window = _window ;
+    std::vector<struct _dustmasker_perfect_interval> &P = _P ; 
+    P.clear() ;
     
-    triplet = (_alphabetMap[(int)S[0]] << _alphabetBit) + _alphabetMap[(int)S[1]] ;
+    EncodeTriplets(S, n) ;
     for (wfinish = 2 ; wfinish < n ; ++wfinish)
     {
       size_t wstart = 0 ;
@@ -334,7 +410,7 @@ public:
         wstart = wfinish + 1 - _w ;
       SaveMaskedRegions(result, P, wstart) ;
       
-      triplet = ((triplet << _alphabetBit) & tripletMask) + _alphabetMap[(int)S[wfinish]] ;
+      int triplet = _codes[wfinish - 2] ;
       ShiftWindow(triplet, window, lv, rw, rv, countW, countV) ;
       //printf("%d %d %d. %d %d. %d. %d\n", rw, lv ,_T, wstart, wfinish, triplet, P.size()) ;
       if (rw * 10 > lv * _T) // The current window does not satisfy the condition 2. So it can have perfect interval inside.
@@ -349,8 +425,14 @@ public:
       ++wstart ;
     }
     
-    free(countV) ;
-    free(countW) ;
+    // Only the triplets in the window have non-zero counts
+    int size = window.Size() ;
+    for (int i = 0 ; i < size ; ++i)
+    {
+      countW[window[i]] = 0 ;
+      countV[window[i]] = 0 ;
+    }
+    window.Clear() ;
   }
   
   // The main function to do dustmasking. Handling non-specific characters, like Ns, and conduct merging nearby low-complex intervals based on the _linker function.
@@ -417,14 +499,30 @@ public:
           result[k] = result[i] ;
         }
       }
+      result.resize(k + 1) ;
     }
   }
 
-  // Thread-safe wrapper 
   void Mask(const char *S, size_t n, std::vector<struct _dustmasker_perfect_interval> &result)
   {
-    std::vector<struct _dustmasker_perfect_interval> windowResult ;
-    MaskWithBuffer(S, n, windowResult, result) ;
+    MaskWithBuffer(S, n, _windowResult, result) ;
+  }
+
+  // Overwrite the low-complexity regions of S with c.
+  // return: the number of masked characters
+  size_t MaskInPlace(char *S, size_t n, char c = 'N')
+  {
+    size_t i ;
+    size_t ret = 0 ;
+    MaskWithBuffer(S, n, _windowResult, _result) ;
+    size_t size = _result.size() ;
+    for (i = 0 ; i < size ; ++i)
+    {
+      size_t len = _result[i].end - _result[i].start + 1 ;
+      memset(S + _result[i].start, c, len) ;
+      ret += len ;
+    }
+    return ret ;
   }
 } ;
 
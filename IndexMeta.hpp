@@ -0,0 +1,75 @@
+#ifndef _MOURISL_CENTRIFUGER_INDEX_META
+#define _MOURISL_CENTRIFUGER_INDEX_META
+
+// Access the index description in the .4.cfr file, and the file layout of the sharded index
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class IndexMeta
+{
+public:
+  // Read the value of the key from the .4.cfr file.
+  // @return: whether the key exists
+  static bool Get(const char *idxPrefix, const char *queryKey, char *val)
+  {
+    bool ret = false ;
+
+    // .4.cfr file for some plain text index descrition.
+    char key[128] ;
+    char buffer[128] ;
+    char *nameBuffer = (char *)malloc(sizeof(char) * (strlen(idxPrefix) + 17))  ;
+    sprintf(nameBuffer, "%s.4.cfr", idxPrefix) ;
+    FILE *fp = fopen(nameBuffer, "r") ;
+    if (fp == NULL) // no .4 file exist
+    {
+      free(nameBuffer) ;
+      return ret ;
+    }
+
+    while (fscanf(fp, "%s %s", key, buffer) != EOF)
+    {
+      if (!strcmp(key, queryKey))
+      {
+        strcpy(val, buffer) ;
+        ret = true ;
+        break ;
+      }
+    }
+    fclose(fp) ;
+
+    free(nameBuffer) ;
+    return ret ;
+  }
+
+  // @return: the number of shards of the index. 1 for the index without sharding.
+  static int GetShardCount(const char *idxPrefix)
+  {
+    char val[128] ;
+    if (Get(idxPrefix, "shard_id", val)) // the prefix is for one shard, use it as a standalone index
+      return 1 ;
+    if (Get(idxPrefix, "shard_count", val))
+      return atoi(val) ;
+    return 1 ;
+  }
+
+  // The sharded index has the files [idxPrefix].shard[i].*.cfr.
+  static void GetShardPrefix(const char *idxPrefix, int shardId, int shardCnt, char *shardPrefix)
+  {
+    if (shardCnt > 1)
+      sprintf(shardPrefix, "%s.shard%d", idxPrefix, shardId) ;
+    else
+      strcpy(shardPrefix, idxPrefix) ;
+  }
+
+  // The shards share the seqId assignment, and the taxonomy of a later shard
+  //   extends the earlier ones (--add-to), so the last shard holds the taxonomy for all.
+  static void GetTaxonomyFile(const char *idxPrefix, int shardCnt, char *fileName)
+  {
+    GetShardPrefix(idxPrefix, shardCnt - 1, shardCnt, fileName) ;
+    strcat(fileName, ".2.cfr") ;
+  }
+} ;
+
+#endif
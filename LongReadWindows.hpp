@@ -0,0 +1,192 @@
+#ifndef _MOURISL_LONG_READ_WINDOWS
+#define _MOURISL_LONG_READ_WINDOWS
+
+// Split the long reads of a batch into windows, so the windows of one read are
+//   searched by different threads. The hit records of the windows are merged
+//   to classify the whole read, and the result of each window can be kept
+//   for checking chimeric reads.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+#include "defs.h"
+#include "ReadFiles.hpp"
+#include "Dustmasker.hpp"
+#include "Classifier.hpp"
+
+struct _readWindow
+{
+  int readIdx ; // the read in the batch
+  int windowIdx ; // the index of the window in the read
+  size_t start ; // 0-based, on the read
+  size_t len ;
+} ;
+
+class LongReadWindows
+{
+private:
+  size_t _windowSize ;
+  bool _keepWindowResults ;
+
+  std::vector<struct _readWindow> _windows ;
+  std::vector<int> _readFirstWindow ; // -1 if the read is not split
+  std::vector< std::map<size_t, struct _seqHitRecord> > _windowRecords ; // two strands for each window
+  std::vector<struct _classifierResult> _windowResults ;
+
+public:
+  LongReadWindows()
+  {
+    _windowSize = 0 ;
+    _keepWindowResults = false ;
+  }
+
+  ~LongReadWindows() {}
+
+  // keepWindowResults: classify each window on its own too
+  void Init(size_t windowSize, bool keepWindowResults)
+  {
+    _windowSize = windowSize ;
+    _keepWindowResults = keepWindowResults ;
+  }
+
+  size_t GetWindowSize() const
+  {
+    return _windowSize ;
+  }
+
+  // Plan the windows of the reads longer than the window size, where
+  //   a read of length L gets ceil(L/windowSize) windows of about the same size.
+  // rep: the reads not representing their duplicates are not split, can be NULL
+  void Split(const struct _Read *readBatch, int batchSize, const int *rep)
+  {
+    int i, k ;
+    _windows.clear() ;
+    _readFirstWindow.assign(batchSize, -1) ;
+    for (i = 0 ; i < batchSize ; ++i)
+    {
+      if (rep != NULL && rep[i] != i)
+        continue ;
+      size_t len = strlen(readBatch[i].seq) ;
+      if (len <= _windowSize)
+        continue ;
+
+      int windowCnt = DIV_CEIL(len, _windowSize) ;
+      _readFirstWindow[i] = _windows.size() ;
+      for (k = 0 ; k < windowCnt ; ++k)
+      {
+        struct _readWindow w ;
+        w.readIdx = i ;
+        w.windowIdx = k ;
+        w.start = len * k / windowCnt ;
+        w.len = len * (k + 1) / windowCnt - w.start ;
+        _windows.push_back(w) ;
+      }
+    }
+
+    size_t windowCnt = _windows.size() ;
+    _windowRecords.resize(2 * windowCnt) ;
+    for (size_t j = 0 ; j < 2 * windowCnt ; ++j)
+      _windowRecords[j].clear() ;
+    if (_keepWindowResults)
+      _windowResults.resize(windowCnt) ;
+  }
+
+  bool IsSplit(int readIdx) const
+  {
+    return _readFirstWindow.size() > 0 && _readFirstWindow[readIdx] >= 0 ;
+  }
+
+  int GetWindowCount() const
+  {
+    return _windows.size() ;
+  }
+
+  const struct _readWindow &GetWindow(int w) const
+  {
+    return _windows[w] ;
+  }
+
+  // Search window w of readBatch, and mask the window in place if dustmasker is not NULL.
+  // buffer: holds at least windowSize+1 characters
+  template <class FMseqclass>
+  void SearchWindow(int w, struct _Read *readBatch, Classifier<FMseqclass> &classifier,
+      Dustmasker *dustmasker, char *buffer, struct _classifierQueryStats *stats)
+  {
+    const struct _readWindow &window = _windows[w] ;
+    // Each window is only touched by one thread, so the masked bases can go back to the read
+    char *s = readBatch[window.readIdx].seq + window.start ;
+    memcpy(buffer, s, window.len) ;
+    buffer[window.len] = '\0' ;
+    if (dustmasker)
+    {
+      dustmasker->MaskInPlace(buffer, window.len) ;
+      memcpy(s, buffer, window.len) ;
+    }
+
+    std::map<size_t, struct _seqHitRecord> *records = &_windowRecords[2 * w] ;
+    // The score filters are for the whole read
+    classifier.QuerySeqIdHitRecords(buffer, NULL, records, false, stats) ;
+    if (_keepWindowResults)
+    {
+      classifier.ClassifyFromSeqIdHitRecords(records, _windowResults[w], NULL) ;
+      _windowResults[w].queryLength = window.len ;
+    }
+  }
+
+  // Classify the split reads from the records of their windows
+  template <class FMseqclass>
+  void Merge(const struct _Read *readBatch, Classifier<FMseqclass> &classifier,
+      struct _classifierResult *results, struct _classifierQueryStats *stats)
+  {
+    int w ;
+    int windowCnt = _windows.size() ;
+    for (w = 0 ; w < windowCnt ; )
+    {
+      int readIdx = _windows[w].readIdx ;
+      std::map<size_t, struct _seqHitRecord> records[2] ;
+      for ( ; w < windowCnt && _windows[w].readIdx == readIdx ; ++w)
+        classifier.MergeSeqIdHitRecords(records, &_windowRecords[2 * w]) ;
+      classifier.ClassifyFromSeqIdHitRecords(records, results[readIdx], stats) ;
+      results[readIdx].queryLength = strlen(readBatch[readIdx].seq) ;
+    }
+  }
+
+  static void OutputWindowHeader(FILE *fp)
+  {
+    fprintf(fp, "readID\twindow\tstart\tend\tseqID\ttaxID\tscore\t2ndBestScore\thitLength\tqueryLength\tnumMatches\n") ;
+  }
+
+  // Output the result of each window in the same columns as the classification
+  //   result, with the window index and its range on the read after the read id.
+  void OutputWindowResults(FILE *fp, const struct _Read *readBatch)
+  {
+    int w ;
+    int j ;
+    int windowCnt = _windows.size() ;
+    if (!_keepWindowResults)
+      return ;
+    for (w = 0 ; w < windowCnt ; ++w)
+    {
+      const struct _readWindow &window = _windows[w] ;
+      const struct _classifierResult &r = _windowResults[w] ;
+      const char *readId = readBatch[window.readIdx].id ;
+      int matchCnt = r.taxIds.size() ;
+      if (matchCnt == 0)
+      {
+        fprintf(fp, "%s\t%d\t%lu\t%lu\tunclassified\t0\t0\t0\t0\t%d\t1\n",
+            readId, window.windowIdx, window.start, window.start + window.len - 1, r.queryLength) ;
+        continue ;
+      }
+      for (j = 0 ; j < matchCnt ; ++j)
+        fprintf(fp, "%s\t%d\t%lu\t%lu\t%s\t%lu\t%lu\t%lu\t%d\t%d\t%d\n",
+            readId, window.windowIdx, window.start, window.start + window.len - 1,
+            r.seqStrNames[j].c_str(), r.taxIds[j], r.score, r.secondaryScore,
+            r.hitLength, r.queryLength, matchCnt) ;
+    }
+  }
+} ;
+
+#endif
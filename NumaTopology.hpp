@@ -0,0 +1,146 @@
+#ifndef _MOURISL_CENTRIFUGER_NUMA_TOPOLOGY
+#define _MOURISL_CENTRIFUGER_NUMA_TOPOLOGY
+
+// The NUMA nodes and their CPUs from sysfs, for pinning the threads and
+//   placing the memory without depending on libnuma.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include <vector>
+
+#define NUMA_MPOL_DEFAULT 0
+#define NUMA_MPOL_INTERLEAVE 3
+
+class NumaTopology
+{
+private:
+  std::vector< std::vector<int> > _nodeCpus ; // the CPUs of each node with CPUs
+  std::vector<int> _nodeIds ; // the system node id
+
+  // Parse the cpulist format, e.g. "0-3,8,10-11"
+  static void ParseCpuList(const char *s, std::vector<int> &cpus)
+  {
+    while (*s)
+    {
+      char *end ;
+      int a = strtol(s, &end, 10) ;
+      if (end == s)
+        break ;
+      int b = a ;
+      s = end ;
+      if (*s == '-')
+      {
+        b = strtol(s + 1, &end, 10) ;
+        s = end ;
+      }
+      for ( ; a <= b ; ++a)
+        cpus.push_back(a) ;
+      if (*s == ',')
+        ++s ;
+      else
+        break ;
+    }
+  }
+
+public:
+  NumaTopology() {}
+  ~NumaTopology() {}
+
+  void Init()
+  {
+    int i ;
+    char fileName[128] ;
+    char buffer[4096] ;
+
+    _nodeCpus.clear() ;
+    _nodeIds.clear() ;
+#ifdef __linux__
+    for (i = 0 ; i < 1024 ; ++i)
+    {
+      sprintf(fileName, "/sys/devices/system/node/node%d/cpulist", i) ;
+      FILE *fp = fopen(fileName, "r") ;
+      if (fp == NULL)
+        continue ;
+      std::vector<int> cpus ;
+      if (fgets(buffer, sizeof(buffer), fp))
+        ParseCpuList(buffer, cpus) ;
+      fclose(fp) ;
+
+      if (cpus.size() == 0) // memory-only node
+        continue ;
+      _nodeCpus.push_back(cpus) ;
+      _nodeIds.push_back(i) ;
+    }
+#endif
+    if (_nodeCpus.size() == 0) // treat the machine as one node
+    {
+      std::vector<int> cpus ;
+      _nodeCpus.push_back(cpus) ;
+      _nodeIds.push_back(0) ;
+    }
+  }
+
+  int GetNodeCount() const
+  {
+    return _nodeCpus.size() ;
+  }
+
+  int GetNodeId(int node) const
+  {
+    return _nodeIds[node] ;
+  }
+
+  int GetCpuCount(int node) const
+  {
+    return _nodeCpus[node].size() ;
+  }
+
+  // Make the threads created with attr run on the CPUs of the node.
+  // @return: whether the affinity is set
+  bool SetThreadAttrNode(pthread_attr_t *attr, int node) const
+  {
+#if defined(__linux__) && defined(CPU_SET)
+    if (_nodeCpus[node].size() == 0)
+      return false ;
+    cpu_set_t cpuSet ;
+    CPU_ZERO(&cpuSet) ;
+    size_t i ;
+    for (i = 0 ; i < _nodeCpus[node].size() ; ++i)
+      CPU_SET(_nodeCpus[node][i], &cpuSet) ;
+    return pthread_attr_setaffinity_np(attr, sizeof(cpuSet), &cpuSet) == 0 ;
+#else
+    return false ;
+#endif
+  }
+
+  // Interleave the pages allocated by the calling thread afterwards over all the nodes,
+  //   or go back to the default local allocation.
+  // @return: whether the memory policy is changed
+  bool SetInterleave(bool interleave) const
+  {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    unsigned long mask[16] ; // up to 1024 nodes
+    memset(mask, 0, sizeof(mask)) ;
+    size_t i ;
+    for (i = 0 ; i < _nodeIds.size() ; ++i)
+      mask[_nodeIds[i] / 64] |= (1ul << (_nodeIds[i] % 64)) ;
+    if (interleave)
+      return syscall(SYS_set_mempolicy, NUMA_MPOL_INTERLEAVE, mask, sizeof(mask) * 8) == 0 ;
+    else
+      return syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, NULL, 0) == 0 ;
+#else
+    return false ;
+#endif
+  }
+} ;
+
+#endif
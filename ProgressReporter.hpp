@@ -0,0 +1,245 @@
+#ifndef _MOURISL_PROGRESS_REPORTER
+#define _MOURISL_PROGRESS_REPORTER
+
+// Print the progress of the classification every few seconds from its own thread:
+//   the reads written, the current speed, the batches between the pipeline stages,
+//   and the time to finish when the input size is known.
+// The pipeline updates the counters once per batch, so the reads advance by batches.
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#include "compactds/Utils.hpp"
+
+class ProgressReporter
+{
+private:
+  bool _enabled ;
+  int _interval ; // in seconds
+  size_t _totalBytes ; // the size of the input files, 0 if unknown
+
+  pthread_t _thread ;
+  pthread_mutex_t _lock ;
+  pthread_cond_t _stopCond ;
+  bool _stop ;
+
+  double _startTime ;
+  // All below are protected by _lock
+  size_t _loadedBatchCnt ;
+  size_t _classifyingBatchCnt ; // started, including the finished ones
+  size_t _classifiedBatchCnt ;
+  size_t _outputBatchCnt ;
+  size_t _loadedReadCnt ;
+  size_t _loadedBases ;
+  size_t _outputReadCnt ;
+  size_t _readBytes ;
+  bool _loading ;
+  double _loadStartTime ;
+
+  // The counters at the last report for the current speed
+  double _lastReportTime ;
+  size_t _lastOutputReadCnt ;
+  size_t _lastLoadedBases ;
+  size_t _lastReadBytes ;
+
+  static void FormatDuration(double seconds, char *buffer)
+  {
+    size_t s = (size_t)seconds ;
+    sprintf(buffer, "%luh%02lum%02lus", s / 3600, (s / 60) % 60, s % 60) ;
+  }
+
+  void Report()
+  {
+    char eta[100] ;
+    char input[200] ;
+    pthread_mutex_lock(&_lock) ;
+    double now = Utils::GetWallTime() ;
+    double elapsed = now - _startTime ;
+    double sinceLast = now - _lastReportTime ;
+    if (sinceLast <= 0)
+      sinceLast = 1e-9 ;
+
+    double readSpeed = (_outputReadCnt - _lastOutputReadCnt) / sinceLast ;
+    double baseSpeed = (_loadedBases - _lastLoadedBases) / sinceLast ;
+    eta[0] = '\0' ;
+    input[0] = '\0' ;
+    if (_totalBytes > 0)
+    {
+      sprintf(input, ", %.2lfMB/s", (_readBytes - _lastReadBytes) / sinceLast / 1e6) ;
+      // The input runs ahead of the output by a few batches, so estimate the total
+      //   reads from the input, and the time from the average speed of the output. 
+      if (_readBytes > 0 && _outputReadCnt > 0)
+      {
+        double totalReadCnt = (double)_loadedReadCnt * _totalBytes / _readBytes ;
+        if (totalReadCnt > _outputReadCnt)
+        {
+          strcpy(eta, " ETA: ") ;
+          FormatDuration(elapsed * (totalReadCnt - _outputReadCnt) / _outputReadCnt, eta + strlen(eta)) ;
+          sprintf(eta + strlen(eta), " (%.1lf%% done).", 100.0 * _outputReadCnt / totalReadCnt) ;
+        }
+      }
+    }
+    char loading[100] ;
+    loading[0] = '\0' ;
+    if (_loading && now - _loadStartTime >= _interval)
+      sprintf(loading, " The current batch has been loading for %.0lfs.", now - _loadStartTime) ;
+
+    Utils::PrintLog("Progress: processed %lu reads, %.0lf reads/s. Input: %lu reads, %.2lfM bases/s%s. Batches: %lu waiting for classification, %lu classifying, %lu waiting for output.%s%s",
+        _outputReadCnt, readSpeed, _loadedReadCnt, baseSpeed / 1e6, input,
+        _loadedBatchCnt - _classifyingBatchCnt, _classifyingBatchCnt - _classifiedBatchCnt,
+        _classifiedBatchCnt - _outputBatchCnt, loading, eta) ;
+
+    _lastReportTime = now ;
+    _lastOutputReadCnt = _outputReadCnt ;
+    _lastLoadedBases = _loadedBases ;
+    _lastReadBytes = _readBytes ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+
+  static void *Report_Thread(void *pArg)
+  {
+    ProgressReporter &reporter = *((ProgressReporter *)pArg) ;
+    pthread_mutex_lock(&reporter._lock) ;
+    double nextTime = reporter._startTime ;
+    while (!reporter._stop)
+    {
+      nextTime += reporter._interval ;
+      // The monotonic time of GetWallTime does not work with the condition's clock
+      struct timespec wakeTime ;
+      clock_gettime(CLOCK_REALTIME, &wakeTime) ;
+      double wait = nextTime - Utils::GetWallTime() ;
+      if (wait > 0)
+      {
+        wakeTime.tv_sec += (time_t)wait ;
+        wakeTime.tv_nsec += (long)((wait - (time_t)wait) * 1e9) ;
+        if (wakeTime.tv_nsec >= 1000000000)
+        {
+          ++wakeTime.tv_sec ;
+          wakeTime.tv_nsec -= 1000000000 ;
+        }
+        while (!reporter._stop
+            && pthread_cond_timedwait(&reporter._stopCond, &reporter._lock, &wakeTime) != ETIMEDOUT)
+          ;
+      }
+      if (reporter._stop)
+        break ;
+      pthread_mutex_unlock(&reporter._lock) ;
+      reporter.Report() ;
+      pthread_mutex_lock(&reporter._lock) ;
+    }
+    pthread_mutex_unlock(&reporter._lock) ;
+    pthread_exit(NULL) ;
+  }
+
+public:
+  ProgressReporter()
+  {
+    _enabled = false ;
+    _interval = 0 ;
+    _totalBytes = 0 ;
+    _stop = false ;
+    _startTime = _loadStartTime = _lastReportTime = 0 ;
+    _loadedBatchCnt = _classifyingBatchCnt = _classifiedBatchCnt = _outputBatchCnt = 0 ;
+    _loadedReadCnt = _loadedBases = _outputReadCnt = _readBytes = 0 ;
+    _lastOutputReadCnt = _lastLoadedBases = _lastReadBytes = 0 ;
+    _loading = false ;
+    pthread_mutex_init(&_lock, NULL) ;
+    pthread_cond_init(&_stopCond, NULL) ;
+  }
+
+  ~ProgressReporter()
+  {
+    Stop() ;
+    pthread_mutex_destroy(&_lock) ;
+    pthread_cond_destroy(&_stopCond) ;
+  }
+
+  // interval: seconds between the reports
+  // totalBytes: the size of the input files for the ETA, 0 if unknown
+  void Start(int interval, size_t totalBytes)
+  {
+    _interval = interval ;
+    _totalBytes = totalBytes ;
+    _startTime = _lastReportTime = Utils::GetWallTime() ;
+    _stop = false ;
+    _enabled = true ;
+    pthread_create(&_thread, NULL, Report_Thread, (void *)this) ;
+  }
+
+  void Stop()
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    _stop = true ;
+    pthread_cond_signal(&_stopCond) ;
+    pthread_mutex_unlock(&_lock) ;
+    pthread_join(_thread, NULL) ;
+    _enabled = false ;
+  }
+
+  bool IsEnabled() const
+  {
+    return _enabled ;
+  }
+
+  void StartLoading()
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    _loading = true ;
+    _loadStartTime = Utils::GetWallTime() ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+
+  // readBytes: the bytes read from the input files so far
+  void FinishLoading(int batchSize, size_t batchBases, size_t readBytes)
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    _loading = false ;
+    if (batchSize > 0)
+    {
+      ++_loadedBatchCnt ;
+      _loadedReadCnt += batchSize ;
+      _loadedBases += batchBases ;
+    }
+    _readBytes = readBytes ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+
+  void StartClassifying()
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    ++_classifyingBatchCnt ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+
+  void FinishClassifying()
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    ++_classifiedBatchCnt ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+
+  void FinishOutput(int batchSize)
+  {
+    if (!_enabled)
+      return ;
+    pthread_mutex_lock(&_lock) ;
+    ++_outputBatchCnt ;
+    _outputReadCnt += batchSize ;
+    pthread_mutex_unlock(&_lock) ;
+  }
+} ;
+
+#endif
@@ -434,19 +434,25 @@ public:
     char fileName[1024] ;
 
     // read in the index
+    int i ;
+    int shardCnt = IndexMeta::GetShardCount(indexPrefix) ;
     _taxonomy.Free() ;
-    sprintf(fileName, "%s.2.cfr", indexPrefix) ;
+    IndexMeta::GetTaxonomyFile(indexPrefix, shardCnt, fileName) ;
     FILE *fp = fopen(fileName, "r") ;
     _taxonomy.Load(fp) ;
     fclose(fp) ;
 
     _seqLength.clear() ;
-    sprintf(fileName, "%s.3.cfr", indexPrefix) ;
-    fp = fopen(fileName, "r") ;
-    size_t tmp[2] ;
-    while (fread(tmp, sizeof(tmp[0]), 2, fp))
-      _seqLength[tmp[0]] = tmp[1] ;
-    fclose(fp) ;
+    for (i = 0 ; i < shardCnt ; ++i)
+    {
+      IndexMeta::GetShardPrefix(indexPrefix, i, shardCnt, fileName) ;
+      strcat(fileName, ".3.cfr") ;
+      fp = fopen(fileName, "r") ;
+      size_t tmp[2] ;
+      while (fread(tmp, sizeof(tmp[0]), 2, fp))
+        _seqLength[tmp[0]] += tmp[1] ;
+      fclose(fp) ;
+    }
   
     _abund = (double *)calloc(_taxonomy.GetNodeCount() + 1, sizeof(_abund[0])) ;
     _readCount = (double *)calloc(_taxonomy.GetNodeCount() + 1, sizeof(_readCount)) ;
@@ -0,0 +1,304 @@
+#ifndef _MOURISL_READ_DEDUPLICATOR
+#define _MOURISL_READ_DEDUPLICATOR
+
+// Collapse the identical reads (read pairs) so each distinct sequence is classified once.
+// Within a batch, a duplicate points to its first occurrence and shares its result.
+// Across batches, the results of the latest distinct reads are kept in a bounded
+//   FIFO cache, and a read found there is resolved without classification.
+// In the molecule mode, the reads are grouped by the (corrected) barcode and UMI
+//   instead of the sequence, and the first read of a molecule represents it.
+//   Without barcodes, the reads need the same UMI and sequence.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "defs.h"
+#include "ReadFiles.hpp"
+#include "Classifier.hpp"
+
+#define DEDUP_FROM_CACHE -1
+
+#define DEDUP_KEY_SEQUENCE 0
+#define DEDUP_KEY_MOLECULE 1
+
+class ReadDeduplicator
+{
+private:
+  struct _dedupCacheEntry
+  {
+    uint64_t hash ;
+    std::string key ; // the original read sequence(s), or the UMI and the barcode (or sequences)
+    std::string seq1, seq2 ; // the sequences after classification (dustmasked)
+    struct _classifierResult result ;
+  } ;
+
+  int _keyType ;
+  size_t _cacheSize ;
+  std::vector<struct _dedupCacheEntry> _cache ; // ring buffer
+  size_t _cacheNext ; // the slot to be overwritten next
+  std::unordered_map<uint64_t, size_t> _cacheIndex ; // hash to slot
+
+  // The distinct reads of the latest batch to be added to the cache
+  std::vector<int> _pending ;
+  std::vector<uint64_t> _pendingHash ;
+  std::vector<std::string> _pendingKey ;
+
+  std::unordered_map<uint64_t, int> _batchIndex ; // hash to the first read in the batch
+  std::vector<std::string> _batchKeys ;
+
+  size_t _totalCnt ;
+  size_t _batchDupCnt ;
+  size_t _cacheHitCnt ;
+  size_t _singletonCnt ; // reads without valid barcode or UMI in the molecule mode
+
+  // FNV-1a
+  static uint64_t Hash(const std::string &key)
+  {
+    size_t i ;
+    size_t len = key.length() ;
+    uint64_t h = 14695981039346656037ull ;
+    for (i = 0 ; i < len ; ++i)
+      h = (h ^ (unsigned char)key[i]) * 1099511628211ull ;
+    return h ;
+  }
+
+  // The fields are separated by '\n' so (AB, C) differs from (A, BC).
+  // The molecule key is the UMI and the barcode, or the UMI and the sequence(s) without barcode.
+  // return: false if the read should not be grouped with others
+  bool MakeKey(const char *s1, const char *s2, const char *barcode, const char *umi, std::string &key)
+  {
+    if (_keyType == DEDUP_KEY_MOLECULE)
+    {
+      // "N" marks the barcodes failing the whitelist correction
+      if (umi == NULL || umi[0] == '\0' || (barcode != NULL && !strcmp(barcode, "N")))
+        return false ;
+      key = umi ;
+      key += '\n' ;
+      if (barcode != NULL && barcode[0] != '\0')
+      {
+        key += barcode ;
+        return true ;
+      }
+      // Without a barcode, the UMI alone is shared by many unrelated molecules, 
+      //   so only the reads with the same sequence are grouped. 
+      key += '\n' ;
+      key += s1 ;
+    }
+    else
+      key = s1 ;
+
+    if (s2)
+    {
+      key += '\n' ;
+      key += s2 ;
+    }
+    return true ;
+  }
+
+  // Forget the reads seen so far, e.g. at the start of a new sample
+  void ClearCache()
+  {
+    _cacheIndex.clear() ;
+    _batchIndex.clear() ;
+    _pending.clear() ;
+    _pendingHash.clear() ;
+    _pendingKey.clear() ;
+  }
+
+public:
+  ReadDeduplicator()
+  {
+    _keyType = DEDUP_KEY_SEQUENCE ;
+    _cacheSize = 0 ;
+    _cacheNext = 0 ;
+    _totalCnt = _batchDupCnt = _cacheHitCnt = _singletonCnt = 0 ;
+  }
+
+  ~ReadDeduplicator() {}
+
+  // cacheSize: number of distinct reads remembered across batches, 0 for per-batch only
+  void Init(size_t cacheSize, int keyType)
+  {
+    _keyType = keyType ;
+    _cacheSize = cacheSize ;
+    _cache.clear() ;
+    _cache.resize(cacheSize) ;
+    _cacheNext = 0 ;
+    _cacheIndex.clear() ;
+  }
+
+  // Decide which reads in the batch need classification.
+  // rep[i]==i: classify read i; rep[i]<i: read i is the same as read rep[i];
+  //   rep[i]==DEDUP_FROM_CACHE: results[i] (and the read sequences in the sequence mode)
+  //   are filled from the cache.
+  // barcodeBatch, umiBatch: can be NULL, only used in the molecule mode.
+  // Needs to be called before the reads are dustmasked.
+  void Collapse(struct _Read *readBatch, struct _Read *readBatch2, 
+      const struct _Read *barcodeBatch, const struct _Read *umiBatch, int batchSize,
+      struct _classifierResult *results, int *rep)
+  {
+    int i ;
+    size_t k ;
+    std::vector< std::pair<int, size_t> > cacheHits ;
+    _batchIndex.clear() ;
+    _pending.clear() ;
+    _pendingHash.clear() ;
+    _pendingKey.clear() ;
+    if ((int)_batchKeys.size() < batchSize)
+      _batchKeys.resize(batchSize) ;
+
+    for (i = 0 ; i < batchSize ; ++i)
+    {
+      rep[i] = i ;
+      if (!strcmp(readBatch[i].id, SAMPLE_SHEET_SEPARATOR_READ_ID))
+      {
+        // Molecules do not span samples
+        if (_keyType == DEDUP_KEY_MOLECULE)
+          ClearCache() ;
+        continue ;
+      }
+      
+      ++_totalCnt ;
+      std::string &key = _batchKeys[i] ;
+      if (!MakeKey(readBatch[i].seq, readBatch2 ? readBatch2[i].seq : NULL, 
+            barcodeBatch ? barcodeBatch[i].seq : NULL, umiBatch ? umiBatch[i].seq : NULL, key))
+      {
+        ++_singletonCnt ;
+        continue ;
+      }
+      uint64_t h = Hash(key) ;
+
+      std::unordered_map<uint64_t, int>::iterator bIter = _batchIndex.find(h) ;
+      if (bIter != _batchIndex.end())
+      {
+        int j = bIter->second ; // either classified or from the cache, holding the result
+        if (_batchKeys[j] == key)
+        {
+          rep[i] = j ;
+          ++_batchDupCnt ;
+        }
+        continue ; // a hash collision is classified on its own
+      }
+      _batchIndex[h] = i ;
+
+      if (_cacheSize > 0)
+      {
+        std::unordered_map<uint64_t, size_t>::iterator cIter = _cacheIndex.find(h) ;
+        if (cIter != _cacheIndex.end() && _cache[cIter->second].key == key)
+        {
+          cacheHits.push_back(std::pair<int, size_t>(i, cIter->second)) ;
+          rep[i] = DEDUP_FROM_CACHE ;
+          ++_cacheHitCnt ;
+          continue ;
+        }
+        _pending.push_back(i) ;
+        _pendingHash.push_back(h) ;
+        _pendingKey.push_back(key) ;
+      }
+    }
+
+    // Fill the cache hits after the comparisons, which need the original sequences
+    for (k = 0 ; k < cacheHits.size() ; ++k)
+    {
+      i = cacheHits[k].first ;
+      const struct _dedupCacheEntry &e = _cache[cacheHits[k].second] ;
+      results[i] = e.result ;
+      if (_keyType == DEDUP_KEY_SEQUENCE)
+      {
+        memcpy(readBatch[i].seq, e.seq1.c_str(), e.seq1.length()) ;
+        if (readBatch2)
+          memcpy(readBatch2[i].seq, e.seq2.c_str(), e.seq2.length()) ;
+      }
+    }
+  }
+
+  // Remember the results of the distinct reads classified in the batch from the last Collapse.
+  void Update(const struct _Read *readBatch, const struct _Read *readBatch2,
+      const struct _classifierResult *results)
+  {
+    size_t k ;
+    if (_cacheSize == 0)
+      return ;
+    for (k = 0 ; k < _pending.size() ; ++k)
+    {
+      int i = _pending[k] ;
+      struct _dedupCacheEntry &e = _cache[_cacheNext] ;
+      // Evict the oldest entry
+      std::unordered_map<uint64_t, size_t>::iterator cIter = _cacheIndex.find(e.hash) ;
+      if (cIter != _cacheIndex.end() && cIter->second == _cacheNext)
+        _cacheIndex.erase(cIter) ;
+      e.hash = _pendingHash[k] ;
+      e.key.swap(_pendingKey[k]) ;
+      if (_keyType == DEDUP_KEY_SEQUENCE)
+      {
+        e.seq1 = readBatch[i].seq ;
+        if (readBatch2)
+          e.seq2 = readBatch2[i].seq ;
+      }
+      e.result = results[i] ;
+      _cacheIndex[e.hash] = _cacheNext ;
+
+      ++_cacheNext ;
+      if (_cacheNext >= _cacheSize)
+        _cacheNext = 0 ;
+    }
+    _pending.clear() ;
+    _pendingHash.clear() ;
+    _pendingKey.clear() ;
+  }
+
+  // The index of the result for read i
+  static int GetResultIndex(const int *rep, int i)
+  {
+    if (rep == NULL || rep[i] == DEDUP_FROM_CACHE)
+      return i ;
+    return rep[i] ;
+  }
+
+  // The index of the read whose (masked) sequences are output for read i.
+  // In the molecule mode, the reads of a molecule may have different sequences.
+  int GetSequenceIndex(const int *rep, int i) const
+  {
+    if (_keyType == DEDUP_KEY_MOLECULE)
+      return i ;
+    return GetResultIndex(rep, i) ;
+  }
+
+  // Whether read i represents its group, i.e. is classified
+  static bool IsRepresentative(const int *rep, int i)
+  {
+    return rep == NULL || rep[i] == i ;
+  }
+
+  size_t GetReadCount() const
+  {
+    return _totalCnt ;
+  }
+
+  size_t GetBatchDuplicateCount() const
+  {
+    return _batchDupCnt ;
+  }
+
+  size_t GetCacheHitCount() const
+  {
+    return _cacheHitCnt ;
+  }
+
+  void PrintStats()
+  {
+    size_t collapsed = _batchDupCnt + _cacheHitCnt ;
+    Utils::PrintLog("Collapsed %lu of %lu reads (%.2lf%%): %lu duplicates in the same batch, %lu from the cache. Classified %lu distinct %s.",
+        collapsed, _totalCnt, _totalCnt > 0 ? 100.0 * collapsed / _totalCnt : 0.0,
+        _batchDupCnt, _cacheHitCnt, _totalCnt - collapsed, 
+        _keyType == DEDUP_KEY_MOLECULE ? "molecules" : "reads") ;
+    if (_keyType == DEDUP_KEY_MOLECULE && _singletonCnt > 0)
+      Utils::PrintLog("%lu reads without a valid barcode or UMI are classified individually.", _singletonCnt) ;
+  }
+} ;
+
+#endif
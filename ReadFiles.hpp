@@ -7,6 +7,7 @@
 #include <zlib.h>
 
 #include <glob.h>
+#include <sys/stat.h>
 
 #include <vector>
 #include <string>
@@ -42,6 +43,8 @@ class ReadFiles
     std::string specialReadId ;
     bool addSpecialReadForFileEnd ; 
     int fileEndSpecialReadFlag ; // flag:0 hasn't output the special read yet, 1 already output the speical read, so should move to the next file.
+    size_t lastBatchBases ; // the number of bases from the last GetBatch
+    size_t finishedBytes ; // the bytes of the files already read through
 
     void GetFileBaseName(const char *in, char *out ) 
     {
@@ -67,6 +70,9 @@ class ReadFiles
     {
       if (opened)
       {
+        z_off_t offset = gzoffset(gzFp) ;
+        if (offset > 0)
+          finishedBytes += offset ;
         kseq_destroy(inSeq) ;
         gzclose( gzFp ) ;
       }
@@ -99,6 +105,8 @@ class ReadFiles
       needComment = false ;
       id = comment = seq = qual = NULL ;
       addSpecialReadForFileEnd = false ;
+      lastBatchBases = 0 ;
+      finishedBytes = 0 ;
     }
 
     ~ReadFiles()
@@ -186,10 +194,11 @@ class ReadFiles
         free( seq ) ;
       if ( qual != NULL )
         free( qual ) ;
-      id = seq = qual = NULL ;
+      id = comment = seq = qual = NULL ;
       currentFpInd = 0 ;
 
       OpenFile(0) ;
+      finishedBytes = 0 ;
     }
 
     void SetSpecialReadToMarkFileEnd(const char *readId)
@@ -334,10 +343,13 @@ class ReadFiles
     // Get a batch of reads, it terminates until the buffer is full or 
     // the file ends.
     // readBatch2 can be for interleaved file. 
-    int GetBatch( struct _Read *readBatch, int maxBatchSize, int &fileInd, bool trimReturn, bool stopWhenFileEnds, struct _Read *readBatch2 = NULL)
+    // maxBatchBases: also stop once the reads hold this many bases, 0 for no limit
+    int GetBatch( struct _Read *readBatch, int maxBatchSize, int &fileInd, bool trimReturn, bool stopWhenFileEnds, struct _Read *readBatch2 = NULL,
+        size_t maxBatchBases = 0)
     {
       int batchSize = 0 ;
-      while ( batchSize < maxBatchSize ) 
+      size_t batchBases = 0 ;
+      while ( batchSize < maxBatchSize && (maxBatchBases == 0 || batchBases < maxBatchBases) ) 
       {
         int tmp = NextWithBuffer( &readBatch[ batchSize].id, &readBatch[batchSize].seq,
             &readBatch[batchSize].qual, &readBatch[batchSize].comment,
@@ -346,6 +358,7 @@ class ReadFiles
         if ( tmp == -1 && batchSize > 0 )
         {
           fileInd = currentFpInd - 1 ;
+          lastBatchBases = batchBases ;
           return batchSize ; // Finished read current file. The next file is open
         }
         else if ( tmp == -1 && batchSize == 0 )
@@ -353,6 +366,7 @@ class ReadFiles
         else if ( tmp == 0 && batchSize == 0 )
         {
           fileInd = currentFpInd ;
+          lastBatchBases = 0 ;
           return 0 ; // Finished reading	
         }
         
@@ -361,10 +375,14 @@ class ReadFiles
               &readBatch2[batchSize].qual, &readBatch2[batchSize].comment,
               trimReturn, stopWhenFileEnds ) ;
 
+        batchBases += strlen(readBatch[batchSize].seq) ;
+        if (readBatch2 != NULL)
+          batchBases += strlen(readBatch2[batchSize].seq) ;
         ++batchSize ;
       }
 
       fileInd = currentFpInd ;
+      lastBatchBases = batchBases ;
       return batchSize ;
     }
 
@@ -407,6 +425,40 @@ class ReadFiles
       }
     }
 
+    size_t GetLastBatchBases()
+    {
+      return lastBatchBases ;
+    }
+
+    // The bytes read from the files so far, i.e., the compressed bytes for gzipped files.
+    //   It advances by the buffer of zlib, and misses the reads from the standard input.
+    size_t GetReadBytes()
+    {
+      size_t ret = finishedBytes ;
+      if (opened) // the last file stays open after it is read through
+      {
+        z_off_t offset = gzoffset(gzFp) ;
+        if (offset > 0)
+          ret += offset ;
+      }
+      return ret ;
+    }
+
+    // The total size of the files, 0 if unknown, e.g. for the standard input
+    size_t GetTotalBytes()
+    {
+      int i ;
+      size_t ret = 0 ;
+      for (i = 0 ; i < fileCnt ; ++i)
+      {
+        struct stat st ;
+        if (fileNames[i] == "-" || stat(fileNames[i].c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+          return 0 ;
+        ret += st.st_size ;
+      }
+      return ret ;
+    }
+
     int GetCurrentFileInd()
     {
       return currentFpInd ;
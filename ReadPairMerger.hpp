@@ -2,13 +2,58 @@
 #define _MOURISL_READ_PAIR_MERGER
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 class ReadPairMerger
 {
 private:
   char _compChar[256] ;
   bool _checkReadThrough ;
+  bool _simd ; // use the SIMD mismatch counting
+
+  // The number of mismatches between a and b in the first len characters.
+  // Stop counting once it exceeds maxMismatch, so the return value may be partial then.
+  static int CountMismatchesScalar(const char *a, const char *b, int len, int maxMismatch)
+  {
+    int i ;
+    int mismatch = 0 ;
+    for (i = 0 ; i < len ; ++i)
+    {
+      if (a[i] != b[i])
+      {
+        ++mismatch ;
+        if (mismatch > maxMismatch)
+          break ;
+      }
+    }
+    return mismatch ;
+  }
+
+  // Compare 16 characters at a time
+  static int CountMismatchesSimd(const char *a, const char *b, int len, int maxMismatch)
+  {
+#ifdef __SSE2__
+    int i ;
+    int mismatch = 0 ;
+    for (i = 0 ; i + 16 <= len ; i += 16)
+    {
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i)) ;
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i)) ;
+      int eqMask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ;
+      mismatch += 16 - __builtin_popcount(eqMask) ;
+      if (mismatch > maxMismatch)
+        return mismatch ;
+    }
+    return mismatch + CountMismatchesScalar(a + i, b + i, len - i, maxMismatch - mismatch) ;
+#else
+    return CountMismatchesScalar(a, b, len, maxMismatch) ;
+#endif
+  }
 
 	int IsMateOverlap( char *fr, int flen, char *sr, int slen, int minOverlap, int &offset, int &bestMatchCnt,
 		bool checkTandem = true )
@@ -19,33 +64,27 @@ private:
     int overlapSize = -1 ;
     for ( j = 0 ; j < flen - minOverlap ; ++j ) // The overlap start position in first read
     {
-      // Whether the overlap works.
-      int matchCnt = 0 ;
-      bool flag = true ;
-
       double similarityThreshold = 0.95 ;
       if ( flen - j >= 100 )
         similarityThreshold = 0.85 ;
       else if ( flen - j >= 50 )
         similarityThreshold = 0.85 + ( flen - j - 50 ) / 50.0 * 0.1 ;
 
-      for ( k = 0 ; j + k < flen && k < slen ; ++k )
-      {
-        if ( fr[j + k] == sr[k] )
-          ++matchCnt ;
-        if ( matchCnt + ( flen - ( j + k ) - 1 ) < int( ( flen - j ) * similarityThreshold ) )
-        {
-          flag = false ;
-          break ;
-        }
-      }
+      // The overlap works if the matches plus the unchecked part of fr reach the threshold,
+      //   i.e. the mismatches in the compared part are at most maxMismatch.
+      int maxMismatch = ( flen - j ) - int( ( flen - j ) * similarityThreshold ) ;
+      k = ( flen - j < slen ) ? flen - j : slen ;
+      int mismatch = _simd ? CountMismatchesSimd( fr + j, sr, k, maxMismatch ) 
+        : CountMismatchesScalar( fr + j, sr, k, maxMismatch ) ;
 
-      if ( flag ) 
+      if ( mismatch <= maxMismatch ) 
       {
         offset = j ;
         ++offsetCnt ;
         overlapSize = k ;
-        bestMatchCnt = matchCnt ;
+        bestMatchCnt = k - mismatch ;
+        if ( offsetCnt > 1 ) // ambiguous
+          return -1 ;
       }
     }
 
@@ -81,24 +120,6 @@ private:
     return overlapSize ;
   }
 
-  void ReverseBuffer(char *buffer, int len)
-  {
-    int i, j ;
-    for (i = 0, j = len - 1 ; i < j ; ++i, --j )
-    {
-      char tmp = buffer[i] ;
-      buffer[i] = buffer[j] ;
-      buffer[j] = tmp ;
-    }
-  }
-
-  void ComplementBuffer(char *buffer, int len)
-  {
-    int i ;
-    for (i = 0 ; i < len ; ++i)
-      buffer[i] = _compChar[ (int)buffer[i] ] ;
-  }
-
 public:
   ReadPairMerger()
   {
@@ -111,6 +132,7 @@ public:
     _compChar['T'] = 'A' ;
 
     _checkReadThrough = true ;
+    _simd = true ;
   }
 
   ~ReadPairMerger()
@@ -122,33 +144,50 @@ public:
     _checkReadThrough = check ;
   }
 
+  void SetSimd(bool simd)
+  {
+    _simd = simd ;
+  }
+
   // r1,q1: read and quality for mate 1.
   // r2, q2: for read 2
   // rm, qm: merged read and quality score
   // @ret: 0 no merge. rm and qm will be NULL
   //       1 regular merge
   //       2 read through
-  //       Also overlapSize, offset, bestMatchCnt describes the overlap statistics
+  //       Also overlapSize, offset, bestMatchCnt describes the overlap statistics when merged
   int Merge(char *r1, char *q1, char *r2, char *q2, char **rm, char **qm, int &overlapSize, int &offset, int&bestMatchCnt) 
   {
     int i ;
-    int len1 = strlen(r1) ;
-    int len2 = strlen(r2) ;
     
     *rm = NULL ;
     *qm = NULL ;
     if (r2 == NULL)
       return 0 ;
+    int len1 = strlen(r1) ;
+    int len2 = strlen(r2) ;
     
-    char *rcr2 = strdup(r2) ;
-    ReverseBuffer(rcr2, len2) ;
-    ComplementBuffer(rcr2, len2) ;
+    // The merger is shared by the threads, so the reverse complement of 
+    //   the usual short mates goes to the stack.
+    char stackBuffer[2 * 512] ;
+    char *heapBuffer = NULL ;
+    char *rcr2 = stackBuffer ;
+    if (len2 >= 512)
+    {
+      heapBuffer = (char *)malloc(sizeof(char) * 2 * (len2 + 1)) ;
+      rcr2 = heapBuffer ;
+    }
+    for (i = 0 ; i < len2 ; ++i)
+      rcr2[i] = _compChar[(unsigned char)r2[len2 - 1 - i]] ;
+    rcr2[len2] = '\0' ;
     
     char *rcq2 = NULL ;
     if (q2 != NULL)
     {
-      rcq2 = strdup(q2) ;
-      ReverseBuffer(rcq2, len2) ;
+      rcq2 = rcr2 + len2 + 1 ;
+      for (i = 0 ; i < len2 ; ++i)
+        rcq2[i] = q2[len2 - 1 - i] ;
+      rcq2[len2] = '\0' ;
     }
 
     int minOverlap = ( len1 + len2 ) / 10 ; // overlap required for read trhough
@@ -184,9 +223,8 @@ public:
         }
       }
       
-      free(rcr2) ;
-      if (rcq2)
-        free(rcq2) ;
+      if (heapBuffer)
+        free(heapBuffer) ;
       return 2 ;
     }
     
@@ -219,16 +257,14 @@ public:
       if (rcq2)
         (*qm)[len] = '\0' ;
 
-      free(rcr2) ;
-      if (rcq2)
-        free(rcq2) ;
+      if (heapBuffer)
+        free(heapBuffer) ;
 
       return 1 ;
     }
     
-    free(rcr2) ;
-    if (rcq2)
-      free(rcq2) ;
+    if (heapBuffer)
+      free(heapBuffer) ;
     return 0 ;
   }
 
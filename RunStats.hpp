@@ -0,0 +1,258 @@
+#ifndef _MOURISL_RUN_STATS
+#define _MOURISL_RUN_STATS
+
+// The runtime statistics of the classification: the batch sizes, the time of
+//   the pipeline stages and the work of each classification thread.
+// The per-read counters are kept by each thread in its own _classifierQueryStats,
+//   and only added here after the threads finish.
+// The stages are timed only when enabled, e.g. for the JSON report of --stats.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "compactds/Utils.hpp"
+#include "Classifier.hpp"
+
+#define RUN_STAGE_LOAD_INDEX 0
+#define RUN_STAGE_INPUT 1 // reading and parsing the reads, in the input thread if there is one
+#define RUN_STAGE_DEDUP 2 // collapsing the duplicated reads and caching their results
+#define RUN_STAGE_CLASSIFY 3 // from starting the classification threads to joining them
+#define RUN_STAGE_MERGE_WINDOWS 4 // classifying the long reads from their windows
+#define RUN_STAGE_OUTPUT 5 // writing the results
+#define RUN_STAGE_CNT 6
+
+// The sizes of the batches loaded so far
+struct _batchStats
+{
+  size_t batchCnt ;
+  size_t readCnt ;
+  size_t bases ;
+  size_t maxBases ; // the largest batch
+
+  _batchStats()
+  {
+    batchCnt = readCnt = bases = maxBases = 0 ;
+  }
+
+  void Add(int batchSize, size_t batchBases)
+  {
+    ++batchCnt ;
+    readCnt += batchSize ;
+    bases += batchBases ;
+    if (batchBases > maxBases)
+      maxBases = batchBases ;
+  }
+} ;
+
+// The work of one classification thread
+struct _threadRunStats
+{
+  int numaNode ;
+  size_t readCnt ;
+  double busyTime ; // wall time in the classification
+  double cpuTime ;
+  double dustTime ;
+  double mergeReadPairTime ;
+  struct _classifierQueryStats queryStats ;
+} ;
+
+class RunStats
+{
+private:
+  struct _stage
+  {
+    size_t callCnt ;
+    double wallTime, cpuTime ; // accumulated
+    double startWallTime, startCpuTime ;
+  } ;
+
+  bool _enabled ;
+  double _startWallTime ;
+  struct _stage _stages[RUN_STAGE_CNT] ;
+  struct _batchStats _batchStats ;
+  std::vector<struct _threadRunStats> _threads ;
+  struct _classifierQueryStats _mergeQueryStats ; // from classifying the long reads from the windows
+
+  bool _hasDedup ;
+  size_t _dedupReadCnt, _dedupBatchDupCnt, _dedupCacheHitCnt ;
+
+  static const char *StageName(int stage)
+  {
+    static const char *names[RUN_STAGE_CNT] = {"load_index", "input", "dedup",
+      "classify", "merge_windows", "output"} ;
+    return names[stage] ;
+  }
+
+  static double Ratio(double a, double b)
+  {
+    return b > 0 ? a / b : 0.0 ;
+  }
+
+public:
+  RunStats()
+  {
+    int i ;
+    _enabled = false ;
+    _startWallTime = Utils::GetWallTime() ;
+    for (i = 0 ; i < RUN_STAGE_CNT ; ++i)
+    {
+      _stages[i].callCnt = 0 ;
+      _stages[i].wallTime = _stages[i].cpuTime = 0 ;
+      _stages[i].startWallTime = _stages[i].startCpuTime = 0 ;
+    }
+    _hasDedup = false ;
+    _dedupReadCnt = _dedupBatchDupCnt = _dedupCacheHitCnt = 0 ;
+  }
+
+  ~RunStats() {}
+
+  void SetEnabled(bool enabled)
+  {
+    _enabled = enabled ;
+  }
+
+  bool IsEnabled() const
+  {
+    return _enabled ;
+  }
+
+  // The stages run by different threads can be timed at the same time,
+  //   but each stage is started and stopped by one thread.
+  void StartStage(int stage)
+  {
+    if (!_enabled)
+      return ;
+    _stages[stage].startWallTime = Utils::GetWallTime() ;
+    _stages[stage].startCpuTime = Utils::GetThreadCpuTime() ;
+  }
+
+  void StopStage(int stage)
+  {
+    if (!_enabled)
+      return ;
+    struct _stage &s = _stages[stage] ;
+    ++s.callCnt ;
+    s.wallTime += Utils::GetWallTime() - s.startWallTime ;
+    s.cpuTime += Utils::GetThreadCpuTime() - s.startCpuTime ;
+  }
+
+  void AddBatch(int batchSize, size_t batchBases)
+  {
+    _batchStats.Add(batchSize, batchBases) ;
+  }
+
+  const struct _batchStats &GetBatchStats() const
+  {
+    return _batchStats ;
+  }
+
+  void AddThread(const struct _threadRunStats &t)
+  {
+    _threads.push_back(t) ;
+  }
+
+  void SetMergeQueryStats(const struct _classifierQueryStats &s)
+  {
+    _mergeQueryStats = s ;
+  }
+
+  void SetDedupStats(size_t readCnt, size_t batchDupCnt, size_t cacheHitCnt)
+  {
+    _hasDedup = true ;
+    _dedupReadCnt = readCnt ;
+    _dedupBatchDupCnt = batchDupCnt ;
+    _dedupCacheHitCnt = cacheHitCnt ;
+  }
+
+  // Write the statistics as one JSON object. The time is in seconds.
+  void Output(FILE *fp)
+  {
+    int i ;
+    int threadCnt = _threads.size() ;
+    double wallTime = Utils::GetWallTime() - _startWallTime ;
+    // The throughput excludes loading the index
+    double classifyWallTime = wallTime - _stages[RUN_STAGE_LOAD_INDEX].wallTime ;
+
+    struct _classifierQueryStats queryStats = _mergeQueryStats ;
+    double busyTime = 0, cpuTime = 0, dustTime = 0, mergeReadPairTime = 0 ;
+    size_t readCnt = 0 ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      queryStats.Add(_threads[i].queryStats) ;
+      readCnt += _threads[i].readCnt ;
+      busyTime += _threads[i].busyTime ;
+      cpuTime += _threads[i].cpuTime ;
+      dustTime += _threads[i].dustTime ;
+      mergeReadPairTime += _threads[i].mergeReadPairTime ;
+    }
+
+    fprintf(fp, "{\n") ;
+    fprintf(fp, "  \"wall_time\": %.3lf,\n", wallTime) ;
+    fprintf(fp, "  \"cpu_time\": %.3lf,\n", Utils::GetProcessCpuTime()) ;
+    fprintf(fp, "  \"peak_rss_bytes\": %lu,\n", Utils::GetPeakMemory()) ;
+    fprintf(fp, "  \"reads\": %lu,\n", _batchStats.readCnt) ;
+    fprintf(fp, "  \"bases\": %lu,\n", _batchStats.bases) ;
+    fprintf(fp, "  \"reads_per_second\": %.1lf,\n", Ratio(_batchStats.readCnt, classifyWallTime)) ;
+    fprintf(fp, "  \"bases_per_second\": %.1lf,\n", Ratio(_batchStats.bases, classifyWallTime)) ;
+
+    fprintf(fp, "  \"batches\": {\"count\": %lu, \"average_reads\": %.1lf, \"average_bases\": %.1lf, \"max_bases\": %lu},\n",
+        _batchStats.batchCnt, Ratio(_batchStats.readCnt, _batchStats.batchCnt),
+        Ratio(_batchStats.bases, _batchStats.batchCnt), _batchStats.maxBases) ;
+
+    // The classification threads are not timed as a stage, but by their own clocks
+    fprintf(fp, "  \"stages\": {\n") ;
+    for (i = 0 ; i < RUN_STAGE_CNT ; ++i)
+    {
+      fprintf(fp, "    \"%s\": {\"calls\": %lu, \"wall_time\": %.3lf, \"cpu_time\": %.3lf}%s\n",
+          StageName(i), _stages[i].callCnt, _stages[i].wallTime,
+          i == RUN_STAGE_CLASSIFY ? cpuTime : _stages[i].cpuTime, i < RUN_STAGE_CNT - 1 ? "," : "") ;
+    }
+    fprintf(fp, "  },\n") ;
+
+    fprintf(fp, "  \"classification\": {\n") ;
+    fprintf(fp, "    \"threads\": %d,\n", threadCnt) ;
+    fprintf(fp, "    \"busy_time\": %.3lf,\n", busyTime) ;
+    fprintf(fp, "    \"cpu_time\": %.3lf,\n", cpuTime) ;
+    fprintf(fp, "    \"merge_read_pair_time\": %.3lf,\n", mergeReadPairTime) ;
+    fprintf(fp, "    \"dust_time\": %.3lf,\n", dustTime) ;
+    fprintf(fp, "    \"search_time\": %.3lf,\n", queryStats.searchTime) ;
+    fprintf(fp, "    \"locate_time\": %.3lf,\n", queryStats.locateTime) ;
+    fprintf(fp, "    \"reduce_time\": %.3lf,\n", queryStats.reduceTime) ;
+    fprintf(fp, "    \"reads\": %lu,\n", readCnt) ;
+    fprintf(fp, "    \"queries\": %lu,\n", queryStats.queryCnt) ;
+    fprintf(fp, "    \"classified\": %lu,\n", queryStats.classifiedCnt) ;
+    fprintf(fp, "    \"hits\": %lu,\n", queryStats.hitCnt) ;
+    fprintf(fp, "    \"hits_per_query\": %.3lf,\n", Ratio(queryStats.hitCnt, queryStats.queryCnt)) ;
+    fprintf(fp, "    \"backward_searches\": %lu,\n", queryStats.searchCnt) ;
+    fprintf(fp, "    \"backward_search_lf_steps\": %lu,\n", queryStats.searchStepCnt) ;
+    fprintf(fp, "    \"located_positions\": %lu,\n", queryStats.locateCnt) ;
+    fprintf(fp, "    \"locate_lf_steps\": %lu,\n", queryStats.locateStepCnt) ;
+    fprintf(fp, "    \"listed_hits\": %lu,\n", queryStats.listedHitCnt) ;
+    fprintf(fp, "    \"early_exits\": %lu,\n", queryStats.earlyExitCnt) ;
+    fprintf(fp, "    \"filtered\": %lu,\n", queryStats.filteredCnt) ;
+    fprintf(fp, "    \"filtered_before_locate\": %lu\n", queryStats.filteredBeforeLocateCnt) ;
+    fprintf(fp, "  },\n") ;
+
+    if (_hasDedup)
+    {
+      fprintf(fp, "  \"dedup\": {\"reads\": %lu, \"batch_duplicates\": %lu, \"cache_hits\": %lu, \"cache_hit_rate\": %.4lf},\n",
+          _dedupReadCnt, _dedupBatchDupCnt, _dedupCacheHitCnt, Ratio(_dedupCacheHitCnt, _dedupReadCnt)) ;
+    }
+
+    fprintf(fp, "  \"per_thread\": [\n") ;
+    for (i = 0 ; i < threadCnt ; ++i)
+    {
+      const struct _threadRunStats &t = _threads[i] ;
+      fprintf(fp, "    {\"tid\": %d, \"numa_node\": %d, \"reads\": %lu, \"busy_time\": %.3lf, \"cpu_time\": %.3lf, "
+          "\"reads_per_second\": %.1lf, \"dust_time\": %.3lf, \"search_time\": %.3lf, \"locate_time\": %.3lf, \"reduce_time\": %.3lf}%s\n",
+          i, t.numaNode, t.readCnt, t.busyTime, t.cpuTime, Ratio(t.readCnt, t.busyTime),
+          t.dustTime, t.queryStats.searchTime, t.queryStats.locateTime, t.queryStats.reduceTime,
+          i < threadCnt - 1 ? "," : "") ;
+    }
+    fprintf(fp, "  ]\n") ;
+    fprintf(fp, "}\n") ;
+  }
+} ;
+
+#endif
@@ -300,10 +300,12 @@ private:
   }
 
   // Assume we already have the taxonomy tree loaded
+  // The sequences added before (from an existing index) keep their IDs and tax IDs.
   void ReadSeqNameFile(std::string fname, bool conversionTableAtFileLevel)
   {
     std::ifstream seqmap_file(fname.c_str(), std::ios::in);
     std::map<std::string, uint64_t> rawSeqNameMap ;
+    size_t baseSeqCnt = _seqStrNameMap.GetSize() ;
     SimpleVector<size_t> pathA ;
     SimpleVector<size_t> pathB ;
     if(seqmap_file.is_open()) {
@@ -327,7 +329,7 @@ private:
           _seqStrNameMap.Add(seqIdStr) ;
           rawSeqNameMap[seqIdStr] = tid ;
         }
-        else // a sequence ID maps is found in multiple taxonomy IDs.
+        else if (rawSeqNameMap.find(seqIdStr) != rawSeqNameMap.end()) // a sequence ID maps is found in multiple taxonomy IDs.
         {
           size_t a = rawSeqNameMap[seqIdStr] ;
           size_t b = tid ;
@@ -358,7 +360,13 @@ private:
     }
     
     // Map sequence string identifier to compact taxonomy id
+    uint64_t *baseSeqIdToTaxId = _seqIdToTaxId ;
     _seqIdToTaxId = new uint64_t[ _seqStrNameMap.GetSize() ] ;
+    if (baseSeqIdToTaxId != NULL)
+    {
+      memcpy(_seqIdToTaxId, baseSeqIdToTaxId, sizeof(_seqIdToTaxId[0]) * baseSeqCnt) ;
+      delete[] baseSeqIdToTaxId ;
+    }
     for (std::map<std::string, uint64_t>::iterator iter = rawSeqNameMap.begin() ;
         iter != rawSeqNameMap.end() ; ++iter)
     {
@@ -484,6 +492,41 @@ public:
     _rootCTaxId = FindRoot() ;
   }
   
+  // Extend the sequences of an existing index (base) with the sequences in seqIdFile.
+  //   The sequences in base keep their seqIds, and the taxonomy tree is rebuilt from nodesFile
+  //   to cover the taxonomy IDs from both. The uncategorized sequences in base 
+  //   are mapped to _nodeCnt explicitly. 
+  void InitWithBase(Taxonomy &base, const char *nodesFile, const char *namesFile, const char *seqIdFile, bool conversionTableAtFileLevel)
+  {
+    size_t i ;
+    size_t baseSeqCnt = base.GetAllSeqCount() ;
+    std::map<uint64_t, int> presentTax;
+    ReadPresentTaxonomyLeafs(std::string(seqIdFile), 0, presentTax) ;
+    for (i = 0 ; i < base.GetSeqCount() ; ++i)
+      if (base.SeqIdToTaxId(i) < base.GetNodeCount())
+        presentTax[ base.GetOrigTaxId( base.SeqIdToTaxId(i) ) ] = 0 ;
+    ReadTaxonomyTree(std::string(nodesFile), presentTax) ;
+    ReadTaxonomyName(std::string(namesFile), presentTax) ;
+
+    _seqIdToTaxId = new uint64_t[baseSeqCnt] ;
+    for (i = 0 ; i < baseSeqCnt ; ++i)
+    {
+      _seqStrNameMap.Add(base.SeqIdToName(i)) ;
+      _seqIdToTaxId[i] = _nodeCnt ;
+      if (base.SeqIdToTaxId(i) < base.GetNodeCount())
+      {
+        uint64_t taxid = base.GetOrigTaxId( base.SeqIdToTaxId(i) ) ;
+        if (_taxIdMap.IsIn(taxid))
+          _seqIdToTaxId[i] = _taxIdMap.Map(taxid) ;
+        else
+          fprintf(stderr, "WARNING: taxonomy id %lu of %s is not in the taxonomy tree.\n", taxid, base.SeqIdToName(i).c_str()) ;
+      }
+    }
+    ReadSeqNameFile(std::string(seqIdFile), conversionTableAtFileLevel) ;
+    
+    _rootCTaxId = FindRoot() ;
+  }
+  
   void Init(const char *nodesFile, const char *namesFile)
   {
     std::map<uint64_t, int> presentTax;
@@ -22,6 +22,9 @@ enum
   ARGV_BARCODE,
   ARGV_UMI,
   ARGV_NO_DUST,
+  ARGV_NO_EARLY_EXIT,
+  ARGV_MIN_SCORE,
+  ARGV_MIN_HITLEN_TOTAL,
   ARGV_CONSIDER_SECONDARY_HITS,
   ARGV_OUTPUT_UNCLASSIFIED,
   ARGV_OUTPUT_CLASSIFIED,
@@ -32,9 +35,27 @@ enum
   ARGV_BUILD_CONCAT_SAME_TAXID_SEQS,
   ARGV_BUILD_IGNORE_UNCATEGORIZED,
   ARGV_BUILD_USE_CHECKPOINT,
+  ARGV_BUILD_SHARD_COUNT,
+  ARGV_BUILD_SHARD_ID,
+  ARGV_BUILD_SPILL_BWT,
+  ARGV_BUILD_ADD_TO,
+  ARGV_BUILD_BWT_LAYOUT,
+  ARGV_BUILD_DOC_LISTING,
+  ARGV_BUILD_SA_SAMPLE,
+  ARGV_HUGEPAGE,
+  ARGV_NUMA,
+  ARGV_DEDUP,
+  ARGV_DEDUP_UMI,
+  ARGV_LONG_READ,
+  ARGV_WINDOW_OUTPUT,
+  ARGV_BATCH_BASES,
+  ARGV_BATCH_MEMORY,
+  ARGV_STATS,
+  ARGV_PROGRESS,
   ARGV_INSPECT_SUMMARY,
   ARGV_INSPECT_SEQNAME,
   ARGV_INSPECT_INDEXSIZE,
+  ARGV_INSPECT_LOCATESTEPS,
   ARGV_QUANT_MINSCORE,
   ARGV_QUANT_MINLENGTH,
   ARGV_QUANT_OUTPUT_FORMAT
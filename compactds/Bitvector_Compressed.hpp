@@ -246,7 +246,7 @@ public:
       free(_choose) ;
       free(_L) ;
       
-      free(_O) ;
+      Utils::FreeLarge(_O) ;
       free(_P) ;
         
       free(_R) ;
@@ -71,7 +71,7 @@ public:
   {
     if (_B != NULL)
     {
-      free(_B) ;
+      Utils::FreeLarge(_B) ;
       _B = NULL ;
     }
     _rank.Free() ;
@@ -95,8 +95,8 @@ public:
     Utils::BitSet(oneB, oneLen) ;
     _R.InitFromBitvector(B, n + 1) ;
     _O.InitFromBitvector(oneB, oneLen + 1) ;
-    free(B) ;
-    free(oneB) ;
+    Utils::FreeLarge(B) ;
+    Utils::FreeLarge(oneB) ;
     
     /*size_t len = 1 ;
     SimpleVector<int> rlens ;
@@ -49,7 +49,7 @@ public:
       int alphabetSize = _alphabets.GetSize() ;
       int i ;
       for (i = 0 ; i < alphabetSize ; ++i)
-        free(_psiB[i]) ;   
+        Utils::FreeLarge(_psiB[i]) ;   
       free(_psiB) ;
     }
   }
@@ -106,7 +106,7 @@ public:
       _Psi[i].Init(_psiB[i], _n) ;
 
     for (i = 0 ; i < alphabetSize ; ++i)
-      free(_psiB[i]) ;   
+      Utils::FreeLarge(_psiB[i]) ;   
     free(_psiB) ;
     _psiB = NULL ;
   }
@@ -0,0 +1,175 @@
+#ifndef _MOURISL_COMPACTDS_DS_DOCUMENTLISTING
+#define _MOURISL_COMPACTDS_DS_DOCUMENTLISTING
+
+#include "Utils.hpp"
+#include "FixedSizeElemArray.hpp"
+#include "Bitvector_Sparse.hpp"
+
+#include <math.h>
+#include <vector>
+
+// The run-length compressed document array: the document (e.g. sequence id) of each
+//   suffix in the BWT order, stored once for each run of the same document.
+// Listing the documents of a BWT range [sp, ep] visits the runs overlapping
+//   the range, without locating any suffix.
+// If the runs are too short to save space, the plain document array is stored instead,
+//   where each position is treated as a run.
+namespace compactds {
+class DS_DocumentListing
+{
+private:
+  size_t _n ;
+  size_t _runCnt ;
+  bool _plain ; // no run compression
+  Bitvector_Sparse _runHeads ; // the start position of each run
+  FixedSizeElemArray _runDocs ; // the document of each run
+
+public:
+  DS_DocumentListing()
+  {
+    _n = _runCnt = 0 ;
+    _plain = false ;
+  }
+
+  ~DS_DocumentListing()
+  {
+    Free() ;
+  }
+
+  void Free()
+  {
+    if (_runCnt > 0)
+    {
+      if (!_plain)
+        _runHeads.Free() ;
+      _runDocs.Free() ;
+      _n = _runCnt = 0 ;
+      _plain = false ;
+    }
+  }
+
+  bool IsInit() const
+  {
+    return _runCnt > 0 ;
+  }
+
+  size_t GetRunCount() const
+  {
+    return _runCnt ;
+  }
+
+  bool IsPlain() const
+  {
+    return _plain ;
+  }
+
+  size_t GetSpace()
+  {
+    size_t ret = _runDocs.GetSpace() - sizeof(_runDocs) + sizeof(*this) ;
+    if (!_plain && _runCnt > 0)
+      ret += _runHeads.GetSpace() - sizeof(_runHeads) ;
+    return ret ;
+  }
+
+  // docs: the document of each position
+  void Init(const FixedSizeElemArray &docs, size_t n)
+  {
+    size_t i ;
+    Free() ;
+    if (n == 0)
+      return ;
+
+    _n = n ;
+    _runCnt = 1 ;
+    for (i = 1 ; i < n ; ++i)
+      if (docs.Read(i) != docs.Read(i - 1))
+        ++_runCnt ;
+
+    // The run heads take about log(n/runs)+2 bits each in the sparse bitvector
+    int docBits = docs.GetElemLength() ;
+    _plain = (double)_runCnt * (docBits + log((double)n / _runCnt) / log(2.0) + 2) 
+      >= (double)n * docBits ;
+    if (_plain)
+    {
+      _runCnt = n ;
+      _runDocs.Malloc(docBits, n) ;
+      for (i = 0 ; i < n ; ++i)
+        _runDocs.Write64(i, docs.Read(i)) ;
+      return ;
+    }
+
+    uint64_t *heads = (uint64_t *)malloc(sizeof(*heads) * _runCnt) ;
+    _runDocs.Malloc(docBits, _runCnt) ;
+    size_t k = 0 ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      if (i == 0 || docs.Read(i) != docs.Read(i - 1))
+      {
+        heads[k] = i ;
+        _runDocs.Write64(k, docs.Read(i)) ;
+        ++k ;
+      }
+    }
+    _runHeads.InitFromOnes(heads, _runCnt, n) ;
+    free(heads) ;
+  }
+
+  // The index of the run containing position i
+  size_t GetRunIndex(size_t i) const
+  {
+    if (_plain)
+      return i ;
+    return _runHeads.Rank1(i) - 1 ;
+  }
+
+  size_t Access(size_t i) const
+  {
+    return _runDocs.Read(GetRunIndex(i)) ;
+  }
+
+  // The number of runs overlapping [sp, ep]
+  size_t GetRangeRunCount(size_t sp, size_t ep) const
+  {
+    return GetRunIndex(ep) - GetRunIndex(sp) + 1 ;
+  }
+
+  // Append the document of each run overlapping [sp, ep] to docs.
+  //   A document may show up more than once.
+  void ListRange(size_t sp, size_t ep, std::vector<size_t> &docs) const
+  {
+    size_t i ;
+    size_t last = GetRunIndex(ep) ;
+    for (i = GetRunIndex(sp) ; i <= last ; ++i)
+      docs.push_back(_runDocs.Read(i)) ;
+  }
+
+  void Save(FILE *fp)
+  {
+    SAVE_VAR(fp, _n) ;
+    SAVE_VAR(fp, _runCnt) ;
+    SAVE_VAR(fp, _plain) ;
+    if (_runCnt > 0)
+    {
+      if (!_plain)
+        _runHeads.Save(fp) ;
+      _runDocs.Save(fp) ;
+    }
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+    LOAD_VAR(fp, _n) ;
+    LOAD_VAR(fp, _runCnt) ;
+    LOAD_VAR(fp, _plain) ;
+    if (_runCnt > 0)
+    {
+      if (!_plain)
+        _runHeads.Load(fp) ;
+      _runDocs.Load(fp) ;
+    }
+  }
+} ;
+}
+
+#endif
@@ -110,8 +110,8 @@ public:
       i = j ;
     }
 
-    free(B) ;
-    free(V) ;
+    Utils::FreeLarge(B) ;
+    Utils::FreeLarge(V) ;
   }
 
   //@return: Pi^{-1}[i]
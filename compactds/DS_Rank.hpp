@@ -35,7 +35,7 @@ public:
   {
     if (_R != NULL)
     {
-      free(_R) ;
+      Utils::FreeLarge(_R) ;
       _R = NULL ;
     }
     _b = 0 ;
@@ -134,7 +134,7 @@ public:
     fread(this, sizeof(*this), 1, fp) ;
     size_t blockCnt = DIV_CEIL(_wordCnt, _b) ;
     if (_R != NULL)
-      free(_R) ;
+      Utils::FreeLarge(_R) ;
     _R = (uint64_t *)malloc(sizeof(uint64_t) * blockCnt * 2) ;
     fread(_R, sizeof(_R[0]), blockCnt, fp) ;
     _subR.Load(fp) ;
@@ -167,7 +167,7 @@ public:
   {
     if (_R != NULL)
     {
-      free(_R) ;
+      Utils::FreeLarge(_R) ;
       _R = NULL ;
     }
   }
@@ -290,8 +290,8 @@ public:
     const int b = 8 ;
     size_t blockCnt = DIV_CEIL(_wordCnt, b) ;
     if (_R != NULL)
-      free(_R) ;
-    _R = (uint64_t *)malloc(sizeof(uint64_t) * blockCnt * 2) ;
+      Utils::FreeLarge(_R) ;
+    _R = (uint64_t *)Utils::MallocLarge(sizeof(uint64_t) * blockCnt * 2) ;
     fread(_R, sizeof(_R[0]), blockCnt * 2, fp) ; 
   }
 } ;
@@ -381,7 +381,7 @@ public:
       
       if (_V[i] != NULL)
       {
-        free(_V[i]) ;
+        Utils::FreeLarge(_V[i]) ;
         _V[i] = NULL ; 
       }
       _rankV[i].Free() ;
@@ -389,7 +389,7 @@ public:
     
       if (_Vmini[i] != NULL)
       {
-        free(_Vmini[i]) ;
+        Utils::FreeLarge(_Vmini[i]) ;
         _Vmini[i] = NULL ;
       }
       _rankVmini[i].Free() ;
@@ -618,8 +618,8 @@ public:
 
         if (_speed >= 4)
         {
-          _Vmini[k] = (WORD *)realloc(_Vmini[k], 
-              Utils::BitsToWordBytes(new_IminiSize)) ;
+          _Vmini[k] = (WORD *)Utils::ReallocLarge(_Vmini[k], 
+              Utils::BitsToWordBytes(blockCnt[k] * (_b / _minib)), Utils::BitsToWordBytes(new_IminiSize)) ;
           _VminiSize[k] = new_IminiSize ;
           _space += Utils::BitsToWordBytes(new_IminiSize) ;
           _rankVmini[k].Init(_Vmini[k], new_IminiSize) ;
@@ -5,11 +5,17 @@
 
 #include <utility>
 #include <map>
+#include <string>
 
 #include <pthread.h> 
 
 #include "Utils.hpp"
 #include "SuffixArrayGenerator.hpp"
+#include "Bitvector_Plain.hpp"
+
+// sampleStrategy
+#define FMBUILDER_SAMPLE_ON_SA 0 // every sampleRate BWT positions
+#define FMBUILDER_SAMPLE_ON_T 1 // every sampleRate text positions, bounds the LF steps of locate
 
 namespace compactds {
 struct _FMBuilderParam
@@ -24,6 +30,7 @@ struct _FMBuilderParam
   int sampleStrategy ; // on SA, on T or on the ends of BWT runs.
   size_t sampleSize ;
   size_t *sampledSA ;
+  WORD *sampledSAMarks ; // for sampling on T: the BWT positions that are sampled
 
   int precomputeWidth ;
   size_t precomputeSize ;
@@ -57,6 +64,12 @@ struct _FMBuilderParam
   //        followed by firstISA, sampledSA, precomputedRange, selectedISA, endMarkerSA, lastSA, accuChunkSizeForSort
   std::string checkpointFilePrefix ; 
 
+  bool spillBWT ; // Spill the filled BWT to the file [spillFilePrefix].bwt instead of holding it in memory during the suffix sorting.
+                  // The caller needs to call LoadSpilledBWT after Build, preferably after releasing T. 
+                  // T and the full BWT are not in memory at the same time, but each of them still is, 
+                  // so this saves about one text size of the peak memory, not an external-memory construction.
+  std::string spillFilePrefix ;
+
   _FMBuilderParam()
   {
     sampleStrategy = 0 ;
@@ -77,9 +90,11 @@ struct _FMBuilderParam
     endMarkerSA = NULL ;
 
     hasCheckpointFile = false ;
+    spillBWT = false ;
 
     // The memory for these arrays shall handled explicitly outside.
     sampledSA = NULL ;
+    sampledSAMarks = NULL ;
     precomputedRange = NULL ;
     semiLcpGreater = NULL ;
     semiLcpEqual = NULL ;
@@ -93,12 +108,14 @@ struct _FMBuilderParam
   {
     if (sampledSA != NULL)
       free(sampledSA) ;
+    if (sampledSAMarks != NULL)
+      Utils::FreeLarge(sampledSAMarks) ;
     if (precomputedRange != NULL)
       free(precomputedRange) ;
     if (semiLcpGreater != NULL)
-      free(semiLcpGreater) ;
+      Utils::FreeLarge(semiLcpGreater) ;
     if (semiLcpEqual != NULL)
-      free(semiLcpEqual) ;
+      Utils::FreeLarge(semiLcpEqual) ;
     if (endMarkerSA != NULL)
       free(endMarkerSA) ;
   }
@@ -139,6 +156,7 @@ struct _FMBuilderPostprocessThreadArg
 
   FixedSizeElemArray *T ;
   FixedSizeElemArray *BWT ;
+  size_t bwtBase ; // BWT holds the portion starting from bwtBase
   size_t n ;
 
   size_t *saChunk ;
@@ -221,15 +239,16 @@ private:
     const FixedSizeElemArray &T = *(pArg->T) ;
     FixedSizeElemArray &BWT = *(pArg->BWT) ;
     size_t n = pArg->n ;
+    size_t bwtBase = pArg->bwtBase ;
 
     // Fill FM string
     //printf("%d %d %d %d\n", size, j, saSortThreadArgs[prevPosTag][j].pos->at(1),
     //    saChunk[0]) ;
     size_t bwtFilled = pArg->accuChunkSize ;
     int skipLength = 0 ; // skip this amount of BWT as they may write to a word 
-    if (tid > 0 && BWT.GetElemOffsetInWord(bwtFilled) > 0)
+    if (tid > 0 && BWT.GetElemOffsetInWord(bwtFilled - bwtBase) > 0)
     {
-      while (BWT.GetElemWordIndex(bwtFilled) == BWT.GetElemWordIndex(bwtFilled + skipLength))
+      while (BWT.GetElemWordIndex(bwtFilled - bwtBase) == BWT.GetElemWordIndex(bwtFilled - bwtBase + skipLength))
       {
         ++skipLength ;
       }
@@ -244,13 +263,18 @@ private:
         if (saChunk[i] == 0)
         {
           *(pArg->pFirstISA) = bwtFilled ;
-          BWT.Write(bwtFilled, T.Read(n - 1)) ;
+          BWT.Write(bwtFilled - bwtBase, T.Read(n - 1)) ;
         }
         else
-          BWT.Write(bwtFilled, T.Read( saChunk[i] - 1 ) ) ;
+          BWT.Write(bwtFilled - bwtBase, T.Read( saChunk[i] - 1 ) ) ;
 
-        if (param.sampledSA != NULL && bwtFilled % param.sampleRate == 0)
-          param.sampledSA[bwtFilled / param.sampleRate] = saChunk[i] ;
+        if (param.sampledSA != NULL)
+        {
+          if (param.sampleStrategy == FMBUILDER_SAMPLE_ON_SA && bwtFilled % param.sampleRate == 0)
+            param.sampledSA[bwtFilled / param.sampleRate] = saChunk[i] ;
+          else if (param.sampleStrategy == FMBUILDER_SAMPLE_ON_T && saChunk[i] % param.sampleRate == 0)
+            param.sampledSA[saChunk[i] / param.sampleRate] = bwtFilled ; // ISA for now, see ReorderTextSampledSA
+        }
       }
 
       if (param.precomputedRange != NULL)
@@ -318,6 +342,29 @@ private:
   }
 
 public:
+  // For sampling on T, sampledSA[k] holds the BWT position of text position k*sampleRate after sorting.
+  // Mark these BWT positions, and store the text positions in BWT order,
+  //   so the sample of a marked BWT position i is sampledSA[rank1(i)-1].
+  static void ReorderTextSampledSA(size_t n, struct _FMBuilderParam &param)
+  {
+    size_t k ;
+    Bitvector_Plain marks ;
+    marks.SetSelectSpeed(DS_SELECT_SPEED_NO) ;
+    marks.Malloc(n) ;
+    for (k = 0 ; k < param.sampleSize ; ++k)
+      marks.BitSet(param.sampledSA[k]) ;
+    marks.Init() ;
+
+    size_t *reordered = (size_t *)malloc(sizeof(size_t) * param.sampleSize) ;
+    for (k = 0 ; k < param.sampleSize ; ++k)
+      reordered[ marks.Rank1(param.sampledSA[k]) - 1 ] = k * param.sampleRate ;
+    free(param.sampledSA) ;
+    param.sampledSA = reordered ;
+
+    param.sampledSAMarks = Utils::MallocByBits(n) ;
+    memcpy(param.sampledSAMarks, marks.GetData(), Utils::BitsToWordBytes(n)) ;
+  }
+
   // Allocate and init the memorys for auxiliary data arrays in FM index
   // chrbit: number of bits for each character
   static void MallocAuxiliaryData(const FixedSizeElemArray &T, size_t chrbit, size_t n, struct _FMBuilderParam &param)
@@ -379,14 +426,25 @@ public:
     size_t bestBlockSize = 0 ;
     size_t bestDcv = 0 ;
 		
-    if (2 * n * alphabetBits / 8 > memory) // The input text and the output BWT
+    size_t textBytes = n * alphabetBits / 8 ;
+    if (2 * textBytes > memory && textBytes < memory 
+        && !param.spillBWT && param.spillFilePrefix.size() > 0)
+    {
+      // Only the input text stays in memory during the suffix sorting, the BWT goes to the disk.
+      param.spillBWT = true ;
+      if (param.printLog)
+        Utils::PrintLog("The text and BWT exceed the memory, will spill the BWT to the disk.") ;
+    }
+
+    size_t inMemoryBytes = (param.spillBWT ? 1 : 2) * textBytes ; // The input text and the output BWT
+    if (inMemoryBytes > memory) 
     {
       if (param.printLog)
         Utils::PrintLog("WARNING: memory is not enough for other block size and dcv values, will use the default.") ;
       return ;
     }
     
-    memory -= 2 * n * alphabetBits / 8 ;
+    memory -= inMemoryBytes ;
     for (dcv = 512 ; dcv <= 8196 ; dcv *= 2)
     {
       size_t dcSize = DIV_CEIL(n, dcv) * DifferenceCover::EstimateCoverSize(dcv) ;
@@ -437,10 +495,71 @@ public:
         Utils::PrintLog("WARNING: memory is not enough for other block size and dcv values, will use the default.") ;
   }
 
+  // Write the finished words of the BWT portion [bwtBase, filled) to the spill file,
+  //   and move the remaining elements to the beginning of BWT.
+  // bwtBase is kept as a multiple of WORDBITS, so the portion shares the word boundaries with the whole BWT.
+  static void SpillBWT(FixedSizeElemArray &BWT, size_t &bwtBase, size_t filled, bool isLast, FILE *fp)
+  {
+    size_t i ;
+    int l = BWT.GetElemLength() ;
+    size_t spillEnd = isLast ? filled : filled / WORDBITS * WORDBITS ;
+    if (spillEnd <= bwtBase)
+      return ;
+
+    const WORD *W = BWT.GetData() ;
+    size_t wordCnt = (spillEnd - bwtBase) / WORDBITS * l ;
+    fwrite(W, sizeof(W[0]), wordCnt, fp) ;
+    if (isLast && (spillEnd - bwtBase) % WORDBITS != 0)
+    {
+      // Clear the unused bits in the last word, as in the calloc-ed BWT.
+      size_t bits = (spillEnd - bwtBase) % WORDBITS * l ;
+      for (i = 0 ; i < DIV_CEIL(bits, WORDBITS) ; ++i)
+      {
+        WORD w = W[wordCnt + i] ;
+        if (i == bits / WORDBITS)
+          w &= MASK(bits % WORDBITS) ;
+        fwrite(&w, sizeof(w), 1, fp) ;
+      }
+    }
+
+    for (i = spillEnd ; i < filled ; ++i)
+      BWT.Write(i - spillEnd, BWT.Read(i - bwtBase)) ;
+    bwtBase = spillEnd ;
+  }
+
+  // Load the full BWT spilled by Build when param.spillBWT is set, and remove the spill file. 
+  static void LoadSpilledBWT(FixedSizeElemArray &BWT, size_t n, int alphabetSize, struct _FMBuilderParam &param)
+  {
+    if (!param.spillBWT)
+      return ;
+    std::string fileName = param.spillFilePrefix + ".bwt" ;
+    FILE *fp = fopen(fileName.c_str(), "r") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to open the spilled BWT file %s.\n", fileName.c_str()) ;
+      exit(1) ;
+    }
+    
+    size_t alphabetBits = Utils::Log2Ceil(alphabetSize) ;
+    BWT.Malloc(alphabetBits, n) ;
+    size_t wordCnt = Utils::BitsToWords(alphabetBits * n) ;
+    if (fread((void *)BWT.GetData(), sizeof(WORD), wordCnt, fp) != wordCnt)
+    {
+      fprintf(stderr, "ERROR: the spilled BWT file %s is truncated.\n", fileName.c_str()) ;
+      exit(1) ;
+    }
+    fclose(fp) ;
+    remove(fileName.c_str()) ;
+    if (param.printLog)
+      Utils::PrintLog("Loaded the BWT from the spill file.") ;
+  }
+
   // T: text
   // n: len(text)
   // firstISA: ISA[0]
   // Returned information is in BWT, firstISA, which are important in the F column. param holds all the other allocated array.
+  // With param.spillBWT, BWT only holds a window of the current batch of chunks and is freed at the end, 
+  //   the full BWT is written to the spill file sequentially and obtained by LoadSpilledBWT.
   static void Build(FixedSizeElemArray &T, size_t n, int alphabetSize, 
       FixedSizeElemArray &BWT, size_t &firstISA,
       struct _FMBuilderParam &param)
@@ -464,7 +583,7 @@ public:
     {
       if (param.printLog)
         Utils::PrintLog("Generate difference cover and chunks.") ;
-      cutCnt = saGenerator.Init(T, n, param.saBlockSize, param.saDcv, alphabetSize) ;
+      cutCnt = saGenerator.Init(T, n, param.saBlockSize, param.saDcv, alphabetSize, param.threadCnt) ;
       if (param.printLog)
         Utils::PrintLog("Found %lu chunks.", cutCnt) ;
       
@@ -492,7 +611,22 @@ public:
 
     size_t alphabetBits = Utils::Log2Ceil(alphabetSize) ;
     MallocAuxiliaryData(T, alphabetBits, n, param) ; 
-    BWT.Malloc(alphabetBits, n) ;
+    size_t bwtBase = 0 ; // the BWT index of BWT[0]
+    FILE *spillFp = NULL ;
+    if (!param.spillBWT)
+      BWT.Malloc(alphabetBits, n) ;
+    else
+    {
+      BWT.Malloc(alphabetBits, WORDBITS) ;
+      spillFp = fopen((param.spillFilePrefix + ".bwt").c_str(), checkpointStep > 1 ? "r+" : "w") ;
+      if (spillFp == NULL)
+      {
+        fprintf(stderr, "ERROR: failed to create the BWT spill file %s.bwt.\n", param.spillFilePrefix.c_str()) ;
+        exit(1) ;
+      }
+      if (param.printLog)
+        Utils::PrintLog("Spill the BWT to %s.bwt.", param.spillFilePrefix.c_str()) ;
+    }
        
     pthread_t *threads = (pthread_t *)malloc(sizeof(*threads) * param.threadCnt) ;
     struct _FMBuilderChunkThreadArg *chunkThreadArgs ;
@@ -594,6 +728,11 @@ public:
         LOAD_ARR(fp, param.endMarkerSA, param.endMarkerCnt) ;
       LOAD_VAR(fp, lastSA) ;
       LOAD_VAR(fp, accuChunkSizeForSort) ;  
+      if (param.spillBWT)
+      {
+        LOAD_VAR(fp, bwtBase) ;
+        fseek(spillFp, bwtBase / WORDBITS * alphabetBits * sizeof(WORD), SEEK_SET) ;
+      }
 
       fclose(fp) ;
       if (param.printLog)
@@ -678,8 +817,11 @@ public:
       if (param.printLog)
         Utils::PrintLog("Postprocess %d chunks.", chunkCnt) ;
       
+      if (param.spillBWT && accuChunkSizeForSort - bwtBase > BWT.GetSize())
+        BWT.Resize(accuChunkSizeForSort - bwtBase) ;
       for (j = 0 ; j < chunkCnt ; ++j)
       {
+        postprocessThreadArgs[j].bwtBase = bwtBase ;
         postprocessThreadArgs[j].saChunk = sa[j] ;
         postprocessThreadArgs[j].saSize = saChunkSize[j] ;
         postprocessThreadArgs[j].accuChunkSize = saSortThreadArgs[j].accuChunkSize ;
@@ -715,13 +857,18 @@ public:
           if (saChunk[l] == 0)
           {
             firstISA = bwtFilled ;
-            BWT.Write(bwtFilled, T.Read(n - 1)) ;
+            BWT.Write(bwtFilled - bwtBase, T.Read(n - 1)) ;
           }
           else
-            BWT.Write(bwtFilled, T.Read( saChunk[l] - 1 ) ) ;
+            BWT.Write(bwtFilled - bwtBase, T.Read( saChunk[l] - 1 ) ) ;
 
-          if (param.sampledSA != NULL && bwtFilled % param.sampleRate == 0)
-            param.sampledSA[bwtFilled / param.sampleRate] = saChunk[l] ;
+          if (param.sampledSA != NULL)
+          {
+            if (param.sampleStrategy == FMBUILDER_SAMPLE_ON_SA && bwtFilled % param.sampleRate == 0)
+              param.sampledSA[bwtFilled / param.sampleRate] = saChunk[l] ;
+            else if (param.sampleStrategy == FMBUILDER_SAMPLE_ON_T && saChunk[l] % param.sampleRate == 0)
+              param.sampledSA[saChunk[l] / param.sampleRate] = bwtFilled ;
+          }
         }
 
         // Fill the precomputew
@@ -744,11 +891,16 @@ public:
         // TODO: Fill the lcp structure
       }
 
+      if (param.spillBWT)
+        SpillBWT(BWT, bwtBase, accuChunkSizeForSort, i + param.threadCnt >= cutCnt, spillFp) ;
+
       // i+param.threadCnt is the number of finished blocks at this point
       if (param.hasCheckpointFile
           && i > 0 && 
           (i + param.threadCnt)/ (cutCnt / 10 + 1) > i / (cutCnt / 10 + 1))
       {
+        if (spillFp != NULL)
+          fflush(spillFp) ;
         // Reset the main checkpoint tracker to 1 just in case program crashes during the output
         FILE *fp = fopen((param.checkpointFilePrefix + ".1").c_str(), "w") ;
         fprintf(fp, "1") ;
@@ -777,6 +929,8 @@ public:
           SAVE_ARR(fp, param.endMarkerSA, param.endMarkerCnt) ;
         SAVE_VAR(fp, lastSA) ;
         SAVE_VAR(fp, accuChunkSizeForSort) ;  
+        if (param.spillBWT)
+          SAVE_VAR(fp, bwtBase) ;
         fclose(fp) ;
         
         fp = fopen((param.checkpointFilePrefix + ".1").c_str(), "w") ;
@@ -793,6 +947,12 @@ public:
     }
     std::map<size_t, size_t>().swap(param.selectedISA) ; // ISA will not be useful
 
+    if (spillFp != NULL)
+    {
+      fclose(spillFp) ;
+      BWT.Free() ;
+    }
+
     free(threads) ;
     pthread_attr_destroy(&attr) ;
     delete[] chunkThreadArgs ;
@@ -808,6 +968,9 @@ public:
     free(saChunkCapacity) ;
     free(saSortThreadArgs) ;
     free(postprocessThreadArgs) ;
+
+    if (param.sampleStrategy == FMBUILDER_SAMPLE_ON_T)
+      ReorderTextSampledSA(n, param) ;
   }
 } ;
 }
@@ -3,9 +3,16 @@
 
 #include <stdio.h>
 
+#include <vector>
+#include <algorithm>
+
 #include "Alphabet.hpp"
 #include "FixedSizeElemArray.hpp"
 #include "FMBuilder.hpp"
+#include "PrecomputedRange.hpp"
+
+// Marks the saved precomputeSize whose ranges are in the compact table
+#define PRECOMPUTE_COMPACT_FLAG (1ull<<63)
 
 // Auxiliary data, other than the BWT and F (alphabet partial sum), for FM index
 // Should be directly initalized through FMBuilderParam, simplifies the parameter passing
@@ -18,13 +25,17 @@ struct _FMIndexAuxData
   int sampleRate ;
   size_t sampleSize ;
   FixedSizeElemArray sampledSA ;
+  Bitvector_Plain sampledSAMarks ; // the sampled BWT positions when sampling on T
 
   // precomputedRange: the BWT range for a prefix of size param.precomputeWidth
   //                  The pair format is (the start position, and the length of the range).
   //                  The advantage is that we can easily tell whether a range is empty.
+  //                  Only for the index built before the compact table.
+  // compactRange: the compact table of the same ranges
   size_t precomputeWidth ;
   size_t precomputeSize ;
   std::pair<size_t, size_t> *precomputedRange ;
+  PrecomputedRange compactRange ;
 
   size_t maxLcp ; // only consider LCP up to this point
   WORD *semiLcpGreater ; // The LCP is between current suffix and its previous one
@@ -70,17 +81,19 @@ struct _FMIndexAuxData
   void Free()
   {
     sampledSA.Free() ;
+    sampledSAMarks.Free() ;
     
     if (precomputedRange)
     {
-      free(precomputedRange) ;
+      Utils::FreeLarge(precomputedRange) ;
       precomputedRange = NULL ;
     }
+    compactRange.Free() ;
 
     if (semiLcpGreater)
     {
-      free(semiLcpGreater) ;
-      free(semiLcpEqual) ;
+      Utils::FreeLarge(semiLcpGreater) ;
+      Utils::FreeLarge(semiLcpEqual) ;
       semiLcpGreater = NULL ;
       semiLcpEqual = NULL ;
     }
@@ -88,7 +101,7 @@ struct _FMIndexAuxData
     if (selectedSA.size() > 0)
     {
       selectedSA.clear() ;
-      free(selectedSAFilter) ;
+      Utils::FreeLarge(selectedSAFilter) ;
     }
 
     if (hasEndMarker)
@@ -104,11 +117,19 @@ struct _FMIndexAuxData
     SAVE_VAR(fp, sampleRate) ;
     SAVE_VAR(fp, sampleSize) ;
     SAVE_VAR(fp, precomputeWidth) ;
-    SAVE_VAR(fp, precomputeSize) ;
+    size_t tmpSize = precomputeSize ;
+    if (compactRange.IsInit())
+      tmpSize |= PRECOMPUTE_COMPACT_FLAG ;
+    SAVE_VAR(fp, tmpSize) ;
     SAVE_VAR(fp, adjustedSA0) ;
 
     sampledSA.Save(fp) ;
-    SAVE_ARR(fp, precomputedRange, precomputeSize) ;
+    if (sampleStrategy == FMBUILDER_SAMPLE_ON_T)
+      sampledSAMarks.Save(fp) ;
+    if (compactRange.IsInit())
+      compactRange.Save(fp) ;
+    else
+      SAVE_ARR(fp, precomputedRange, precomputeSize) ;
 
     SAVE_VAR(fp, maxLcp) ;
     if (maxLcp > 0)
@@ -118,7 +139,7 @@ struct _FMIndexAuxData
     }
 
     // For speical SAs
-    size_t tmpSize = selectedSA.size() ;
+    tmpSize = selectedSA.size() ;
     SAVE_VAR(fp, tmpSize) ;
     SAVE_VAR(fp, selectedSAFilterSampleRate) ;
     for (std::map<size_t, size_t>::iterator iter = selectedSA.begin() ;
@@ -147,9 +168,19 @@ struct _FMIndexAuxData
     LOAD_VAR(fp, adjustedSA0) ;
 
     sampledSA.Load(fp) ; 
-    precomputedRange = (std::pair<size_t, size_t> *)malloc(
-        sizeof(std::pair<size_t, size_t>) * precomputeSize) ;
-    LOAD_ARR(fp, precomputedRange, precomputeSize) ;
+    if (sampleStrategy == FMBUILDER_SAMPLE_ON_T)
+      sampledSAMarks.Load(fp) ;
+    if (precomputeSize & PRECOMPUTE_COMPACT_FLAG)
+    {
+      precomputeSize &= ~PRECOMPUTE_COMPACT_FLAG ;
+      compactRange.Load(fp) ;
+    }
+    else
+    {
+      precomputedRange = (std::pair<size_t, size_t> *)Utils::MallocLarge(
+          sizeof(std::pair<size_t, size_t>) * precomputeSize) ;
+      LOAD_ARR(fp, precomputedRange, precomputeSize) ;
+    }
 
     LOAD_VAR(fp, maxLcp) ;
     if (maxLcp > 0)
@@ -185,6 +216,15 @@ struct _FMIndexAuxData
   }
 } ;
 
+// The bidirectional interval of a pattern P in the FMD-index (Li 2012), where the text
+//   is its own reverse complement: [sp, sp+size) is the BWT range of P and
+//   [rcSp, rcSp+size) is the BWT range of the reverse complement of P.
+struct _FMDInterval
+{
+  size_t sp, rcSp, size ;
+  size_t start, end ; // P is s[start, end) of the query
+} ;
+
 template <class SeqClass>
 class FMIndex
 {
@@ -207,11 +247,20 @@ private:
       sa = _auxData.adjustedSA0 ;
       return true ;
     }
-    else if (i % _auxData.sampleRate == 0)
+    else if (_auxData.sampleStrategy == FMBUILDER_SAMPLE_ON_SA && i % _auxData.sampleRate == 0)
     {
       sa = _auxData.sampledSA[i / _auxData.sampleRate] ;
       return true ;
     }
+    else if (_auxData.sampleStrategy == FMBUILDER_SAMPLE_ON_T && _auxData.sampledSAMarks.Access(i))
+    {
+      // The end markers are sampled on T as well, keep their special values
+      if (_auxData.hasEndMarker && i < _auxData.endMarkerSA.GetSize())
+        sa = _auxData.endMarkerSA[i] ;
+      else
+        sa = _auxData.sampledSA[ _auxData.sampledSAMarks.Rank1(i) - 1 ] ;
+      return true ;
+    }
     else if (_auxData.selectedSAFilter)
     {
       if (Utils::BitRead(_auxData.selectedSAFilter,  i / _auxData.selectedSAFilterSampleRate)
@@ -278,6 +327,13 @@ public:
     //_auxData.sampledSA = builderParam.sampledSA ;
     _auxData.sampledSA.InitFromArray(0, builderParam.sampledSA, _auxData.sampleSize) ;
     free(builderParam.sampledSA) ;
+    if (_auxData.sampleStrategy == FMBUILDER_SAMPLE_ON_T)
+    {
+      _auxData.sampledSAMarks.SetSelectSpeed(DS_SELECT_SPEED_NO) ;
+      _auxData.sampledSAMarks.Init(builderParam.sampledSAMarks, _n) ;
+      Utils::FreeLarge(builderParam.sampledSAMarks) ;
+      builderParam.sampledSAMarks = NULL ;
+    }
     
     if (builderParam.hasEndMarker)
     {
@@ -288,7 +344,15 @@ public:
 
     _auxData.precomputeWidth = builderParam.precomputeWidth ;
     _auxData.precomputeSize = builderParam.precomputeSize ;
-    _auxData.precomputedRange = builderParam.precomputedRange ;
+    if (builderParam.precomputedRange != NULL
+        && _auxData.compactRange.Init(builderParam.precomputedRange,
+          builderParam.precomputeWidth, _plainAlphabetBits))
+    {
+      free(builderParam.precomputedRange) ;
+      builderParam.precomputedRange = NULL ;
+    }
+    else
+      _auxData.precomputedRange = builderParam.precomputedRange ;
 
     _auxData.maxLcp = builderParam.maxLcp ;
     _auxData.semiLcpGreater = builderParam.semiLcpGreater ; 
@@ -391,6 +455,7 @@ public:
     if (_auxData.precomputeWidth > 0)
     {
       WORD initW = 0 ;
+      WORD key = 0 ; // the lexicographic order for the compact table
       for (i = 0 ; i < _auxData.precomputeWidth ; ++i)
       {
         if (!_alphabets.IsIn(s[m - 1 - i]))
@@ -399,18 +464,28 @@ public:
           ep = 0 ;
           return i ;
         }
-        initW = (initW << _plainAlphabetBits) | (_plainAlphabetCoder.Encode(s[m - 1 - i])) ;
+        WORD c = _plainAlphabetCoder.Encode(s[m - 1 - i]) ;
+        initW = (initW << _plainAlphabetBits) | c ;
+        key |= (c << (_plainAlphabetBits * i)) ;
       }
       
-      if (_auxData.precomputedRange[initW].second == 0)
+      size_t len ;
+      if (_auxData.precomputedRange == NULL)
+        len = _auxData.compactRange.Query(key, sp) ;
+      else
+      {
+        sp = _auxData.precomputedRange[initW].first ;
+        len = _auxData.precomputedRange[initW].second ;
+      }
+
+      if (len == 0)
       {
         sp = 1 ;
         ep = 0 ;
         return _auxData.precomputeWidth - 1 ;
       }
 
-      sp = _auxData.precomputedRange[initW].first ;
-      ep = sp + _auxData.precomputedRange[initW].second - 1 ;
+      ep = sp + len - 1 ;
       return _auxData.precomputeWidth ;
     }
     else
@@ -482,6 +557,237 @@ public:
     return readRange.size() ;
   }
 
+  // The FMD-index functions below require the text to be its own reverse complement,
+  //   and the alphabet ordered so the complement of code c is alphabetSize-1-c, e.g. ACGT.
+  void FMDInitInterval(ALPHABET c, struct _FMDInterval &ik)
+  {
+    WORD code = _plainAlphabetCoder.Encode(c) ;
+    ik.sp = _plainAlphabetPartialSum[code] ;
+    ik.size = _plainAlphabetPartialSum[code + 1] - ik.sp ;
+    ik.rcSp = _plainAlphabetPartialSum[_plainAlphabetCoder.GetSize() - 1 - code] ;
+  }
+
+  // Extend the pattern P of ik to cP (backward) or Pc (forward) for every character code c.
+  // ok: the extended intervals indexed by the code, should hold the alphabet size
+  void FMDExtendAll(const struct _FMDInterval &ik, bool backward, struct _FMDInterval *ok)
+  {
+    int c ;
+    const int alphabetSize = _plainAlphabetCoder.GetSize() ;
+    // Forward extension of P is the backward extension of its reverse complement
+    size_t sp = backward ? ik.sp : ik.rcSp ;
+    size_t rcSp = backward ? ik.rcSp : ik.sp ;
+    // The suffix at the beginning of the text has no preceding character, and
+    //   its reverse complement is the last suffix with the pattern.
+    size_t textStartCnt = (sp <= _firstISA && _firstISA < sp + ik.size) ? 1 : 0 ;
+
+    if (ik.size == 1) // only need one rank
+    {
+      for (c = 0 ; c < alphabetSize ; ++c)
+      {
+        ok[c].sp = _plainAlphabetPartialSum[c] ;
+        ok[c].size = 0 ;
+      }
+      if (!textStartCnt)
+      {
+        ALPHABET a = _BWT.Access(sp) ;
+        c = _plainAlphabetCoder.Encode(a) ;
+        ok[c].sp += Rank(a, sp, /*inclusive=*/0) ;
+        ok[c].size = 1 ;
+      }
+    }
+    else
+    {
+      size_t beforeSum = 0 ;
+      size_t inSum = 0 ;
+      for (c = 0 ; c < alphabetSize - 1 ; ++c)
+      {
+        ALPHABET a = _plainAlphabetCoder.Decode(c, _plainAlphabetBits) ;
+        size_t before = Rank(a, sp, /*inclusive=*/0) ;
+        size_t in = Rank(a, sp + ik.size - 1) - before ;
+        ok[c].sp = _plainAlphabetPartialSum[c] + before ;
+        ok[c].size = in ;
+        beforeSum += before ;
+        inSum += in ;
+      }
+      // The last character's counts come from the others. Rank counts the character 
+      //   at _firstISA before position 0.
+      ok[c].sp = _plainAlphabetPartialSum[c] + sp + (sp <= _firstISA ? 1 : 0) - beforeSum ;
+      ok[c].size = ik.size - textStartCnt - inSum ;
+    }
+
+    // The reverse complement of cP is rc(P)comp(c), which are ordered by comp(c) in rc(P)'s range
+    ok[alphabetSize - 1].rcSp = rcSp + textStartCnt ;
+    for (c = alphabetSize - 2 ; c >= 0 ; --c)
+      ok[c].rcSp = ok[c + 1].rcSp + ok[c + 1].size ;
+
+    if (!backward)
+    {
+      for (c = 0 ; c < alphabetSize / 2 ; ++c)
+        std::swap(ok[c], ok[alphabetSize - 1 - c]) ;
+      for (c = 0 ; c < alphabetSize ; ++c)
+        std::swap(ok[c].sp, ok[c].rcSp) ;
+    }
+  }
+
+  // Extend the pattern P of ik to cP (backward) or Pc (forward) for one character.
+  //   Only needs the counts of the characters on one side of c in the range, 
+  //   so it takes fewer ranks than FMDExtendAll.
+  // withRc: whether to compute the range of the reverse complement, can skip it for
+  //   the backward extension if the pattern will not be extended forward anymore.
+  void FMDExtend(const struct _FMDInterval &ik, ALPHABET c, bool backward, struct _FMDInterval &ok, 
+      bool withRc = true)
+  {
+    int b ;
+    const int alphabetSize = _plainAlphabetCoder.GetSize() ;
+    int code = _plainAlphabetCoder.Encode(c) ;
+    size_t sp = backward ? ik.sp : ik.rcSp ;
+    size_t rcSp = backward ? ik.rcSp : ik.sp ;
+    if (!backward)
+    {
+      code = alphabetSize - 1 - code ;
+      c = _plainAlphabetCoder.Decode(code, _plainAlphabetBits) ;
+    }
+    size_t textStartCnt = (sp <= _firstISA && _firstISA < sp + ik.size) ? 1 : 0 ;
+    size_t nextSp = _plainAlphabetPartialSum[code] ;
+    size_t nextRcSp = rcSp ;
+    size_t size = 0 ;
+
+    if (ik.size == 1)
+    {
+      if (!textStartCnt && _BWT.Access(sp) == c)
+      {
+        nextSp += Rank(c, sp, /*inclusive=*/0) ;
+        size = 1 ;
+      }
+    }
+    else
+    {
+      size_t before = Rank(c, sp, /*inclusive=*/0) ;
+      nextSp += before ;
+      size = Rank(c, sp + ik.size - 1) - before ;
+      
+      // The range of rc(P)comp(c) follows the characters greater than c
+      size_t greaterCnt = 0 ;
+      if (!withRc && backward)
+        ;
+      else if (code >= alphabetSize / 2)
+      {
+        for (b = code + 1 ; b < alphabetSize ; ++b)
+        {
+          ALPHABET a = _plainAlphabetCoder.Decode(b, _plainAlphabetBits) ;
+          greaterCnt += Rank(a, sp + ik.size - 1) - Rank(a, sp, /*inclusive=*/0) ;
+        }
+      }
+      else
+      {
+        greaterCnt = ik.size - textStartCnt - size ;
+        for (b = 0 ; b < code ; ++b)
+        {
+          ALPHABET a = _plainAlphabetCoder.Decode(b, _plainAlphabetBits) ;
+          greaterCnt -= Rank(a, sp + ik.size - 1) - Rank(a, sp, /*inclusive=*/0) ;
+        }
+      }
+      nextRcSp += textStartCnt + greaterCnt ;
+    }
+
+    ok.size = size ;
+    ok.sp = backward ? nextSp : nextRcSp ;
+    ok.rcSp = backward ? nextRcSp : nextSp ;
+  }
+
+  // Find the super-maximal exact matches (SMEMs) overlapping s[x] (bwt_smem1 in bwa).
+  // prev, curr: buffers
+  // @return: the position to search the next SMEMs 
+  size_t FMDSearchSuperMEMAt(char *s, size_t m, size_t x, size_t minL, std::vector<struct _FMDInterval> &mems,
+      std::vector<struct _FMDInterval> &prev, std::vector<struct _FMDInterval> &curr)
+  {
+    size_t i, j ;
+    struct _FMDInterval next ;
+    if (!_alphabets.IsIn(s[x]))
+      return x + 1 ;
+
+    struct _FMDInterval ik ;
+    FMDInitInterval(s[x], ik) ;
+    ik.start = x ;
+    ik.end = x + 1 ;
+
+    // Forward extension, keep the intervals whose size shrink
+    prev.clear() ;
+    for (i = x + 1 ; i < m ; ++i)
+    {
+      if (!_alphabets.IsIn(s[i]))
+      {
+        prev.push_back(ik) ;
+        break ;
+      }
+      FMDExtend(ik, s[i], false, next) ;
+      if (next.size != ik.size)
+      {
+        prev.push_back(ik) ;
+        if (next.size == 0)
+          break ;
+      }
+      ik.sp = next.sp ;
+      ik.rcSp = next.rcSp ;
+      ik.size = next.size ;
+      ik.end = i + 1 ;
+    }
+    if (i == m)
+      prev.push_back(ik) ;
+    std::reverse(prev.begin(), prev.end()) ; // the longest first
+    size_t ret = prev[0].end ;
+
+    // Backward extension. A match is an SMEM if it can not be extended
+    //   and no longer match in prev survives. The matches are not extended 
+    //   forward anymore, so only the range of P is needed.
+    size_t memStart = mems.size() ;
+    for (i = x ; ; --i) // extend with s[i - 1]
+    {
+      bool valid = (i > 0 && _alphabets.IsIn(s[i - 1])) ;
+      curr.clear() ;
+      for (j = 0 ; j < prev.size() ; ++j)
+      {
+        if (valid)
+          FMDExtend(prev[j], s[i - 1], true, next, /*withRc=*/false) ;
+        if (!valid || next.size == 0)
+        {
+          if (curr.size() == 0 && prev[j].end - i >= minL
+              && (mems.size() == memStart || i < mems.back().start))
+          {
+            prev[j].start = i ;
+            mems.push_back(prev[j]) ;
+          }
+        }
+        else if (curr.size() == 0 || next.size != curr.back().size)
+        {
+          next.start = i - 1 ;
+          next.end = prev[j].end ;
+          curr.push_back(next) ;
+        }
+      }
+      if (curr.size() == 0)
+        break ;
+      prev.swap(curr) ;
+    }
+    std::reverse(mems.begin() + memStart, mems.end()) ;
+    return ret ;
+  }
+
+  // Find all the SMEMs of length at least minL on both strands with the FMD-index.
+  //   Only sp and size are set for the SMEMs, not rcSp.
+  // @return: number of SMEMs in mems, sorted by the start on s
+  size_t FMDSearchSuperMEM(char *s, size_t m, size_t minL, std::vector<struct _FMDInterval> &mems)
+  {
+    std::vector<struct _FMDInterval> prev ;
+    std::vector<struct _FMDInterval> curr ;
+    size_t x = 0 ;
+
+    mems.clear() ;
+    while (x < m)
+      x = FMDSearchSuperMEMAt(s, m, x, minL, mems, prev, curr) ;
+    return mems.size() ;
+  }
+
   // m: length of s
   // Return the [sp, ep] through the option, and the length of matched suffix in size_t
   size_t BackwardSearch(char *s, size_t m, size_t &sp, size_t &ep)
@@ -523,6 +829,29 @@ public:
     return ret ;
   }
 
+  // Fill values[i] with the sampled SA value BackwardToSampledSA(i) would return, for all i.
+  // One LF pass from the end of the text, so each position is visited once.
+  // values: should be allocated with the length of n.
+  void ResolveAllSampledSA(FixedSizeElemArray &values)
+  {
+    size_t k ;
+    std::vector<size_t> pending ; // positions waiting for the sampled value in front of them
+    size_t i = GetLastISA() ;
+    for (k = 0 ; k < _n ; ++k)
+    {
+      size_t sa ;
+      pending.push_back(i) ;
+      if (GetSampledSA(i, sa))
+      {
+        for (size_t j = 0 ; j < pending.size() ; ++j)
+          values.Write64(pending[j], sa) ;
+        pending.clear() ;
+      }
+      if (k + 1 < _n)
+        i = BackwardExtend(_BWT.Access(i), i) ;
+    }
+  }
+
   // return ISA[n - 1]
   size_t GetLastISA()
   {
@@ -565,7 +894,12 @@ public:
     Utils::PrintLog("FM-index space usage (bytes):") ;
     Utils::PrintLog("BWT: %llu", _BWT.GetSpace()) ;
     Utils::PrintLog("sampledSA: %llu", _auxData.sampledSA.GetSpace()) ;
-    Utils::PrintLog("precomputedRange: %llu", _auxData.precomputeSize * sizeof(*_auxData.precomputedRange)) ;
+    if (_auxData.sampleStrategy == FMBUILDER_SAMPLE_ON_T)
+      Utils::PrintLog("sampledSA marks: %llu", _auxData.sampledSAMarks.GetSpace()) ;
+    if (_auxData.compactRange.IsInit())
+      Utils::PrintLog("precomputedRange: %llu", _auxData.compactRange.GetSpace()) ;
+    else
+      Utils::PrintLog("precomputedRange: %llu", _auxData.precomputeSize * sizeof(*_auxData.precomputedRange)) ;
   }
 
   void Save(FILE *fp)
@@ -92,7 +92,7 @@ public:
   void Free()
   {
     if (_W != NULL)
-      free(_W) ;
+      Utils::FreeLarge(_W) ;
     _W = NULL ;
     _n = _size = 0 ;
     _l = 0 ;
@@ -324,9 +324,10 @@ public:
 
   void Resize(size_t newn)
   {
+    size_t oldSize = _size ;
     _n = newn ;
     _size = Utils::BitsToWords(_l * newn) ;
-    _W = (WORD *)realloc(_W, _size * sizeof(WORD)) ;
+    _W = (WORD *)Utils::ReallocLarge(_W, oldSize * sizeof(WORD), _size * sizeof(WORD)) ;
   }
   
   // Reserve the space for m elements without changing current element
@@ -335,9 +336,10 @@ public:
     if (m <= _n || Utils::BitsToWords(_l * m) <= _size)
       return;
 
+    size_t oldSize = _size ;
     _size = Utils::BitsToWords(_l * m) ;
     if (_W != NULL)
-      _W = (WORD *)realloc(_W, _size * sizeof(WORD)) ;
+      _W = (WORD *)Utils::ReallocLarge(_W, oldSize * sizeof(WORD), _size * sizeof(WORD)) ;
     else
       _W = Utils::MallocByBits(_l * m) ;
   }
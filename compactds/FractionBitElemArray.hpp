@@ -69,7 +69,7 @@ public:
   void Free()
   {
     if (_W != NULL)
-      free(_W) ;
+      Utils::FreeLarge(_W) ;
     _W = NULL ;
   }
   
@@ -108,9 +108,10 @@ public:
 
   void Resize(size_t newn)
   {
+    size_t oldSize = _size ;
     _n = newn ;
     _size = Utils::BitsToWords(DIV_CEIL(_n, _k)) ;
-    _W = (WORD *)realloc(_W, _size * sizeof(WORD)) ;
+    _W = (WORD *)Utils::ReallocLarge(_W, oldSize * sizeof(WORD), _size * sizeof(WORD)) ;
   }
 } ;
 }
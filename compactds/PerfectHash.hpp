@@ -140,7 +140,7 @@ private:
       for (j = 0 ; j < PERFECT_MAP_KEY_TRIES ; ++j)
         Utils::BitSet(V, targets[j]) ;
     }
-    free(V) ;
+    Utils::FreeLarge(V) ;
     return 1 ;
   }
 public:
@@ -178,7 +178,7 @@ public:
     free(nL) ;
     free(uniqueSlotQueue) ;
     free(S) ;
-    free(keyIdxProcessed) ;
+    Utils::FreeLarge(keyIdxProcessed) ;
   }
 
   uint64_t Map(uint64_t x)
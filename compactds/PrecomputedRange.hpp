@@ -0,0 +1,220 @@
+#ifndef _MOURISL_COMPACTDS_PRECOMPUTEDRANGE
+#define _MOURISL_COMPACTDS_PRECOMPUTEDRANGE
+
+#include "Utils.hpp"
+
+#include <map>
+#include <algorithm>
+
+// The compact table of the BWT ranges for all the k-mers (ftab).
+// The k-mers are ordered lexicographically, so the ranges are consecutive in the BWT
+//   and we only need the number of k-mer suffixes before each k-mer (C),
+//   the length of the range is C[key+1]-C[key].
+// C is stored as a 64-bit base every 2^BLOCK_SHIFT k-mers plus a 32-bit offset,
+//   the rare offsets that do not fit go to a sparse map.
+// The suffixes shorter than the k-mer (near the end of the text) are not in any range,
+//   they are the gaps that shift the start of the ranges after them.
+namespace compactds {
+class PrecomputedRange
+{
+private:
+  static const int BLOCK_SHIFT = 8 ;
+  static const uint32_t OVERFLOW_MARK = 0xffffffffu ;
+
+  size_t _width ;
+  int _alphabetBits ;
+  size_t _size ; // number of k-mers
+  uint32_t *_offsets ; // size+1
+  size_t *_bases ;
+  size_t _blockCnt ;
+  std::map<size_t, size_t> _overflow ;
+
+  // For the ith gap, the number of k-mer suffixes before it, non-decreasing.
+  size_t *_gaps ;
+  size_t _gapCnt ;
+
+  void MallocArrays()
+  {
+    _blockCnt = ((_size + 1) >> BLOCK_SHIFT) + 1 ;
+    _offsets = (uint32_t *)Utils::MallocLarge(sizeof(*_offsets) * (_size + 1)) ;
+    _bases = (size_t *)malloc(sizeof(*_bases) * _blockCnt) ;
+    _gaps = (size_t *)malloc(sizeof(*_gaps) * (_gapCnt + 1)) ;
+  }
+
+  void SetC(size_t key, size_t c)
+  {
+    if ((key & ((1ull << BLOCK_SHIFT) - 1)) == 0)
+      _bases[key >> BLOCK_SHIFT] = c ;
+    size_t o = c - _bases[key >> BLOCK_SHIFT] ;
+    if (o >= OVERFLOW_MARK)
+    {
+      _offsets[key] = OVERFLOW_MARK ;
+      _overflow[key] = c ;
+    }
+    else
+      _offsets[key] = o ;
+  }
+
+  size_t GetC(size_t key) const
+  {
+    uint32_t o = _offsets[key] ;
+    if (o == OVERFLOW_MARK)
+      return _overflow.find(key)->second ;
+    return _bases[key >> BLOCK_SHIFT] + o ;
+  }
+
+  // The key with the first character as the lowest bits, which is how the builder packs the text
+  WORD ReverseKey(WORD key) const
+  {
+    size_t i ;
+    WORD ret = 0 ;
+    for (i = 0 ; i < _width ; ++i)
+    {
+      ret = (ret << _alphabetBits) | (key & MASK(_alphabetBits)) ;
+      key >>= _alphabetBits ;
+    }
+    return ret ;
+  }
+
+public:
+  PrecomputedRange()
+  {
+    _width = _size = 0 ;
+    _alphabetBits = 0 ;
+    _offsets = NULL ;
+    _bases = NULL ;
+    _gaps = NULL ;
+    _blockCnt = _gapCnt = 0 ;
+  }
+
+  ~PrecomputedRange()
+  {
+    Free() ;
+  }
+
+  void Free()
+  {
+    if (_offsets != NULL)
+    {
+      Utils::FreeLarge(_offsets) ;
+      free(_bases) ;
+      free(_gaps) ;
+      _offsets = NULL ;
+      _bases = NULL ;
+      _gaps = NULL ;
+      _overflow.clear() ;
+      _size = _blockCnt = _gapCnt = 0 ;
+    }
+  }
+
+  bool IsInit() const
+  {
+    return _offsets != NULL ;
+  }
+
+  size_t GetSpace() const
+  {
+    return sizeof(*_offsets) * (_size + 1) + sizeof(*_bases) * _blockCnt
+      + sizeof(*_gaps) * (_gapCnt + 1) + _overflow.size() * 2 * sizeof(size_t) + sizeof(*this) ;
+  }
+
+  // ranges: the (start, length) pairs from the builder, indexed by the k-mer packed with
+  //   the first character in the lowest bits.
+  // @return: false if the ranges are not consecutive in lexicographic order
+  bool Init(const std::pair<size_t, size_t> *ranges, size_t width, int alphabetBits)
+  {
+    size_t key ;
+    Free() ;
+
+    _width = width ;
+    _alphabetBits = alphabetBits ;
+    _size = 1ull << (alphabetBits * width) ;
+
+    // First pass: count the gaps and check the order
+    size_t c = 0 ; // number of k-mer suffixes so far
+    for (key = 0 ; key < _size ; ++key)
+    {
+      const std::pair<size_t, size_t> &r = ranges[ReverseKey(key)] ;
+      if (r.second == 0)
+        continue ;
+      if (r.first < c + _gapCnt)
+        return false ;
+      _gapCnt += r.first - (c + _gapCnt) ;
+      c += r.second ;
+    }
+
+    MallocArrays() ;
+    size_t gapi = 0 ;
+    c = 0 ;
+    for (key = 0 ; key < _size ; ++key)
+    {
+      const std::pair<size_t, size_t> &r = ranges[ReverseKey(key)] ;
+      SetC(key, c) ;
+      if (r.second == 0)
+        continue ;
+      for ( ; c + gapi < r.first ; ++gapi)
+        _gaps[gapi] = c ;
+      c += r.second ;
+    }
+    SetC(_size, c) ;
+    return true ;
+  }
+
+  // key: the k-mer with the first character in the highest bits
+  // @return: the length of the range, and sp is the start of the range if it is non-empty
+  size_t Query(WORD key, size_t &sp) const
+  {
+    size_t c = GetC(key) ;
+    size_t len = GetC(key + 1) - c ;
+    if (len == 0)
+      return 0 ;
+    sp = c + (std::upper_bound(_gaps, _gaps + _gapCnt, c) - _gaps) ;
+    return len ;
+  }
+
+  void Save(FILE *fp)
+  {
+    SAVE_VAR(fp, _width) ;
+    SAVE_VAR(fp, _alphabetBits) ;
+    SAVE_VAR(fp, _size) ;
+    SAVE_VAR(fp, _gapCnt) ;
+    SAVE_ARR(fp, _offsets, _size + 1) ;
+    SAVE_ARR(fp, _bases, _blockCnt) ;
+    SAVE_ARR(fp, _gaps, _gapCnt) ;
+
+    size_t tmpSize = _overflow.size() ;
+    SAVE_VAR(fp, tmpSize) ;
+    for (std::map<size_t, size_t>::iterator iter = _overflow.begin() ;
+        iter != _overflow.end() ; ++iter)
+    {
+      size_t pair[2] = {iter->first, iter->second} ;
+      fwrite(pair, sizeof(size_t), 2, fp) ;
+    }
+  }
+
+  void Load(FILE *fp)
+  {
+    size_t i ;
+    Free() ;
+    LOAD_VAR(fp, _width) ;
+    LOAD_VAR(fp, _alphabetBits) ;
+    LOAD_VAR(fp, _size) ;
+    LOAD_VAR(fp, _gapCnt) ;
+    MallocArrays() ;
+    LOAD_ARR(fp, _offsets, _size + 1) ;
+    LOAD_ARR(fp, _bases, _blockCnt) ;
+    LOAD_ARR(fp, _gaps, _gapCnt) ;
+
+    size_t tmpSize = 0 ;
+    LOAD_VAR(fp, tmpSize) ;
+    for (i = 0 ; i < tmpSize ; ++i)
+    {
+      size_t pair[2] ;
+      fread(pair, sizeof(size_t), 2, fp) ;
+      _overflow[pair[0]] = pair[1] ;
+    }
+  }
+} ;
+}
+
+#endif
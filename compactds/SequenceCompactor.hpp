@@ -16,6 +16,29 @@ private:
   ALPHABET _endingAlphabet ; // the alphabet represent the end of a text, this alphaet needs to be in the alphabetList!
   Alphabet _alphabets ;
   bool _setEndingAlphabet ;
+  int _code[256] ; // the code for each raw character after capitalization and replacement, -1 if the character is skipped
+
+  void InitCodeTable()
+  {
+    int i ;
+    for (i = 0 ; i < 256 ; ++i)
+    {
+      char c = (char)i ;
+      if (_capitalize && c >= 'a' && c <= 'z')
+        c = c - 'a' + 'A' ;
+      if (!_alphabets.IsIn(c))
+      {
+        if (_missingReplace == '\0')
+        {
+          _code[i] = -1 ;
+          continue ;
+        }
+        else
+          c = _missingReplace ;
+      }
+      _code[i] = _alphabets.Encode(c) ;
+    }
+  }
 public: 
   SequenceCompactor() 
   {
@@ -23,6 +46,7 @@ public:
     _missingReplace = '\0' ;  
     _endingAlphabet = '\0' ;
     _setEndingAlphabet = false ;
+    InitCodeTable() ;
   };
 
   ~SequenceCompactor() {} ;
@@ -36,11 +60,13 @@ public:
   void Init(const char *alphabetList)
   {
     _alphabets.InitFromList(alphabetList, strlen(alphabetList)) ;
+    InitCodeTable() ;
   }
 
   void Init(const char *alphabetList, FixedSizeElemArray &compactSeq, size_t reserveLength)
   {
     int alphabetCodeLen = _alphabets.InitFromList(alphabetList, strlen(alphabetList)) ;
+    InitCodeTable() ;
     compactSeq.Malloc(alphabetCodeLen, reserveLength) ; 
     compactSeq.SetSize(0) ;
   }
@@ -48,11 +74,13 @@ public:
   void SetCapitalize(bool c)
   {
     _capitalize = c ;
+    InitCodeTable() ;
   }
 
   void SetMissingReplace(ALPHABET c)
   {
     _missingReplace = c ;
+    InitCodeTable() ;
   }
 
   // @return: number of chars added to seq
@@ -62,26 +90,59 @@ public:
     size_t origLen = seq.GetSize() ;
     for (i = 0 ; rawseq[i] ; ++i)
     {
-      char c = rawseq[i] ;
-      if (_capitalize)
-      {
-        if (c >= 'a' && c <= 'z')
-          c = c - 'a' + 'A' ;
-      }
-
-      if (!_alphabets.IsIn(c))
-      {
-        if (_missingReplace == '\0')
-          continue ;
-        else
-          c = _missingReplace ;
-      }
-      seq.PushBack( _alphabets.Encode(c) ) ;
+      int code = _code[(unsigned char)rawseq[i]] ;
+      if (code >= 0)
+        seq.PushBack(code) ;
     }
     if (_setEndingAlphabet)
       seq.PushBack( _alphabets.Encode(_endingAlphabet) ) ;
     return seq.GetSize() - origLen ;
   }
+
+  // @return: the number of chars Compact() would add, without compacting the sequence
+  size_t GetCompactLength(const char *rawseq) const
+  {
+    size_t i ;
+    size_t ret = 0 ;
+    for (i = 0 ; rawseq[i] ; ++i)
+      if (_code[(unsigned char)rawseq[i]] >= 0)
+        ++ret ;
+    if (_setEndingAlphabet)
+      ++ret ;
+    return ret ;
+  }
+
+  // Compact rawseq into the already reserved seq[offset...], without changing the size of seq.
+  // The first skip chars are not written, but stored in skipped, so the caller 
+  //   can write them later. This allows threads to fill adjacent ranges of seq without 
+  //   touching the same word at the same time.
+  // @return: number of chars compacted 
+  size_t CompactAt(const char *rawseq, FixedSizeElemArray &seq, size_t offset, size_t skip, int *skipped) const
+  {
+    size_t i ;
+    size_t k = 0 ;
+    for (i = 0 ; rawseq[i] ; ++i)
+    {
+      int code = _code[(unsigned char)rawseq[i]] ;
+      if (code < 0)
+        continue ;
+      if (k < skip)
+        skipped[k] = code ;
+      else
+        seq.Write(offset + k, code) ;
+      ++k ;
+    }
+    if (_setEndingAlphabet)
+    {
+      int code = _alphabets.Encode(_endingAlphabet) ;
+      if (k < skip)
+        skipped[k] = code ;
+      else
+        seq.Write(offset + k, code) ;
+      ++k ;
+    }
+    return k ;
+  }
 } ;
 } 
 #endif
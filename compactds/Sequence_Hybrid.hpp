@@ -236,7 +236,7 @@ public:
     //printf("%d %d %d\n", sizeof(*this), sizeof(_waveletSeq), sizeof(_runlengthSeq)) ;
 
     //free(psums) ;
-    free(B) ;
+    Utils::FreeLarge(B) ;
   }
 
   ALPHABET Access(size_t i) const 
@@ -0,0 +1,179 @@
+#ifndef _MOURISL_COMPACTDS_SEQUENCE_INTERLEAVED
+#define _MOURISL_COMPACTDS_SEQUENCE_INTERLEAVED
+
+#include "Utils.hpp"
+#include "Alphabet.hpp"
+#include "Sequence.hpp"
+
+// The sequence over an alphabet with at most 4 characters (e.g. DNA),
+//   where each 64-byte block holds the occurrence counts of the 4 characters
+//   before the block and the next 192 2-bit characters, so a rank
+//   only touches one cache line (plus the small super block count array).
+namespace compactds {
+class Sequence_Interleaved: public Sequence
+{
+private:
+  // Each block has 8 words: 4 32-bit counts relative to the super block in the first two words,
+  //   followed by 6 words of 2-bit characters.
+  static const int BLOCK_WORDS = 8 ;
+  static const int BLOCK_HEADER_WORDS = 2 ;
+  static const int BLOCK_CHARS = (BLOCK_WORDS - BLOCK_HEADER_WORDS) * (WORDBITS / 2) ;
+  static const int SUPERBLOCK_SHIFT = 20 ; // 2^20 blocks in a super block, so the relative counts fit in 32 bits
+
+  WORD *_B ; // the blocks
+  size_t _blockCnt ;
+  size_t *_superCounts ; // the occurrence counts before each super block, 4 per super block
+  size_t _superBlockCnt ;
+
+  // The 2-bit lanes in x that equal c become 01 in the returned word
+  static WORD MatchLanes(WORD x, WORD c)
+  {
+    const WORD lowBits = 0x5555555555555555ull ;
+    WORD y = x ^ (c * lowBits) ;
+    return ~(y | (y >> 1)) & lowBits ;
+  }
+
+  void MallocBlocks()
+  {
+    // Align the blocks with the cache lines
+    _B = (WORD *)Utils::MallocLarge(sizeof(WORD) * BLOCK_WORDS * _blockCnt, BLOCK_WORDS * sizeof(WORD)) ;
+    if (_B == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to allocate the memory for Sequence_Interleaved.\n") ;
+      exit(1) ;
+    }
+    memset(_B, 0, sizeof(WORD) * BLOCK_WORDS * _blockCnt) ;
+    _superCounts = (size_t *)malloc(sizeof(size_t) * 4 * _superBlockCnt) ;
+    _space = sizeof(WORD) * BLOCK_WORDS * _blockCnt + sizeof(size_t) * 4 * _superBlockCnt ;
+  }
+
+public:
+  Sequence_Interleaved()
+  {
+    _B = NULL ;
+    _superCounts = NULL ;
+    _blockCnt = _superBlockCnt = 0 ;
+  }
+
+  ~Sequence_Interleaved()
+  {
+    Free() ;
+  }
+
+  void Free()
+  {
+    if (_B != NULL)
+    {
+      Utils::FreeLarge(_B) ;
+      free(_superCounts) ;
+      _B = NULL ;
+      _superCounts = NULL ;
+      _blockCnt = _superBlockCnt = 0 ;
+    }
+    Sequence::Free() ;
+  }
+
+  size_t GetSpace()
+  {
+    return _space + _alphabets.GetSpace() - sizeof(_alphabets) + sizeof(*this) ;
+  }
+
+  void Init(const FixedSizeElemArray &S, size_t sequenceLength, const ALPHABET *alphabetMap)
+  {
+    size_t i, j ;
+    int c ;
+
+    if (_alphabets.GetSize() == 0)
+      _alphabets.InitFromList(alphabetMap, strlen(alphabetMap)) ;
+    if (_alphabets.GetSize() > 4)
+    {
+      fprintf(stderr, "ERROR: Sequence_Interleaved only supports the alphabet with at most 4 characters.\n") ;
+      exit(1) ;
+    }
+
+    _n = sequenceLength ;
+    _blockCnt = _n / BLOCK_CHARS + 1 ; // the extra block makes rank at _n easy
+    _superBlockCnt = ((_blockCnt - 1) >> SUPERBLOCK_SHIFT) + 1 ;
+    MallocBlocks() ;
+
+    size_t counts[4] = {0, 0, 0, 0} ; // counts before current block
+    for (i = 0 ; i < _blockCnt ; ++i)
+    {
+      WORD *block = _B + i * BLOCK_WORDS ;
+      if ((i & ((1ull << SUPERBLOCK_SHIFT) - 1)) == 0)
+      {
+        for (c = 0 ; c < 4 ; ++c)
+          _superCounts[ (i >> SUPERBLOCK_SHIFT) * 4 + c] = counts[c] ;
+      }
+
+      uint32_t *blockCounts = (uint32_t *)block ;
+      for (c = 0 ; c < 4 ; ++c)
+        blockCounts[c] = counts[c] - _superCounts[(i >> SUPERBLOCK_SHIFT) * 4 + c] ;
+
+      for (j = 0 ; j < (size_t)BLOCK_CHARS && i * BLOCK_CHARS + j < _n ; ++j)
+      {
+        WORD x = S.Read(i * BLOCK_CHARS + j) ;
+        block[BLOCK_HEADER_WORDS + j / (WORDBITS / 2)] |= (x << (2 * (j % (WORDBITS / 2)))) ;
+        ++counts[x] ;
+      }
+    }
+  }
+
+  ALPHABET Access(size_t i) const
+  {
+    const WORD *block = _B + (i / BLOCK_CHARS) * BLOCK_WORDS ;
+    size_t j = i % BLOCK_CHARS ;
+    return _alphabets.Decode((block[BLOCK_HEADER_WORDS + j / (WORDBITS / 2)] >> (2 * (j % (WORDBITS / 2)))) & 3, 2) ;
+  }
+
+  size_t Rank(ALPHABET ch, size_t i, int inclusive = 1) const
+  {
+    size_t p = inclusive ? i + 1 : i ; // count in [0, p)
+    size_t bi = p / BLOCK_CHARS ;
+    size_t r = p % BLOCK_CHARS ;
+    WORD c = _alphabets.Encode(ch) ;
+    const WORD *block = _B + bi * BLOCK_WORDS ;
+
+    size_t ret = _superCounts[ (bi >> SUPERBLOCK_SHIFT) * 4 + c ] + ((const uint32_t *)block)[c] ;
+    const WORD *w = block + BLOCK_HEADER_WORDS ;
+    for ( ; r >= (size_t)(WORDBITS / 2) ; r -= WORDBITS / 2, ++w)
+      ret += Utils::Popcount(MatchLanes(*w, c)) ;
+    if (r > 0)
+      ret += Utils::Popcount(MatchLanes(*w, c) & MASK(2 * r)) ;
+    return ret ;
+  }
+
+  size_t Select(ALPHABET c, size_t i) const
+  {
+    return 0 ;
+  }
+
+  void Save(FILE *fp)
+  {
+    Sequence::Save(fp) ;
+    SAVE_VAR(fp, _blockCnt) ;
+    SAVE_VAR(fp, _superBlockCnt) ;
+    SAVE_ARR(fp, _B, BLOCK_WORDS * _blockCnt) ;
+    SAVE_ARR(fp, _superCounts, 4 * _superBlockCnt) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+
+    Sequence::Load(fp) ;
+    LOAD_VAR(fp, _blockCnt) ;
+    LOAD_VAR(fp, _superBlockCnt) ;
+    MallocBlocks() ;
+    LOAD_ARR(fp, _B, BLOCK_WORDS * _blockCnt) ;
+    LOAD_ARR(fp, _superCounts, 4 * _superBlockCnt) ;
+  }
+
+  void PrintStats()
+  {
+    Utils::PrintLog("Sequence_Interleaved: total_length: %lu block_count: %lu", _n, _blockCnt) ;
+  }
+} ;
+}
+
+#endif
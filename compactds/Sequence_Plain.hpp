@@ -68,7 +68,7 @@ public:
       _Bvs[i].Init(B, _n) ;
       _space += _Bvs[i].GetSpace() ;
     }
-    free(B) ;
+    Utils::FreeLarge(B) ;
   }
 
   ALPHABET Access(size_t i) const 
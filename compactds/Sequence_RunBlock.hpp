@@ -354,7 +354,7 @@ public:
     _space += _runBlockSeq.GetSpace() - sizeof(_runBlockSeq) ;
     //printf("%d %d %d\n", sizeof(*this), sizeof(_waveletSeq), sizeof(_runBlockSeq)) ;
 
-    free(B) ;
+    Utils::FreeLarge(B) ;
   }
 
   ALPHABET Access(size_t i) const 
@@ -5,11 +5,14 @@
 
 #include "Sequence.hpp"
 #include "Sequence_WaveletTree.hpp"
+#include "Sequence_WaveletMatrix.hpp"
 
 // Split the original sequence into fixed-length blocks,
 //   compress the single-run block by reducing it to one character
 // This is implemented using a single-wavelet tree. It uses O(m) more bits than a two-wavelet tree implementation.
+// CompressedSeqClass: the wavelet tree or the wavelet matrix holding the compressed sequence
 namespace compactds {
+template <class CompressedSeqClass = Sequence_WaveletTree<Bitvector_Plain> >
 class Sequence_RunBlockOneTree: public Sequence
 {
 private:
@@ -18,7 +21,7 @@ private:
   Bitvector_Plain _useRunBlock ; // 0-plain sequence, 1-runblock
   Bitvector_Plain *_alphabetRB ; // 0-plain sequence, 1-runblock. for each alphabet
   //size_t **_alphabetBlockPartialSum ;
-  Sequence_WaveletTree<Bitvector_Plain> _compressedSeq ;
+  CompressedSeqClass _compressedSeq ;
 
   // Variables and functions related to automatic block size estimation
   size_t _blockSizeInferLength ; // use this amount of numbers to infer block size
@@ -376,7 +379,7 @@ public:
     //printf("%d %d %d\n", sizeof(*this), sizeof(_waveletSeq), sizeof(_runBlockSeq)) ;
     
     free(alphabetCnt) ;
-    free(B) ;
+    Utils::FreeLarge(B) ;
   }
 
   ALPHABET Access(size_t i) const 
@@ -115,7 +115,7 @@ public:
       _alphabetPartialSum[c].InitFromBitvector(W, psum + 1) ;
       _space += _alphabetPartialSum[c].GetSpace() - sizeof(_alphabetPartialSum[c]) ;
     }
-    free(W) ;
+    Utils::FreeLarge(W) ;
   }
 
   ALPHABET Access(size_t i) const 
@@ -0,0 +1,281 @@
+#ifndef _MOURISL_COMPACTDS_SEQUENCE_WAVELETMATRIX
+#define _MOURISL_COMPACTDS_SEQUENCE_WAVELETMATRIX
+
+#include "Utils.hpp"
+#include "Sequence.hpp"
+#include "FixedSizeElemArray.hpp"
+
+#include <string.h>
+
+// The wavelet matrix (Claude, Navarro, Ordonez 2015) for the alphabet with plain codes.
+// Each level is one bitvector in the order of the stable partition by the
+//   bits of the previous levels, so the rank of a character goes down
+//   one position per level instead of following the tree pointers.
+// The rank directory is interleaved with the bits as in rank9: each 64-byte block has
+//   the number of 1s before the block in the first word, the 9-bit counts
+//   before each of the 6 data words in the second word, followed by 384 bits,
+//   so a rank on a level touches one cache line and needs one popcount.
+namespace compactds {
+
+class Sequence_WaveletMatrix: public Sequence
+{
+private:
+  static const int BLOCK_WORDS = 8 ;
+  static const int BLOCK_HEADER_WORDS = 2 ;
+  static const int BLOCK_BITS = (BLOCK_WORDS - BLOCK_HEADER_WORDS) * WORDBITS ;
+
+  WORD *_B ; // the blocks of all the levels
+  size_t _blockCnt ; // number of blocks in each level
+  int _levelCnt ; // the code length
+  size_t *_zeros ; // the number of 0s in each level
+  size_t *_start ; // the position of the first character with code c on the last level
+
+  // Number of 1s in [0, i) on level l
+  size_t Rank1(int l, size_t i) const
+  {
+    const WORD *block = _B + (l * _blockCnt + i / BLOCK_BITS) * BLOCK_WORDS ;
+    size_t r = i % BLOCK_BITS ;
+    size_t k = r / WORDBITS ;
+    return block[0] + ((block[1] >> (9 * k)) & 0x1ff)
+      + Utils::Popcount(block[BLOCK_HEADER_WORDS + k] & MASK(r % WORDBITS)) ;
+  }
+
+  int AccessBit(int l, size_t i) const
+  {
+    const WORD *block = _B + (l * _blockCnt + i / BLOCK_BITS) * BLOCK_WORDS ;
+    size_t r = i % BLOCK_BITS ;
+    return (block[BLOCK_HEADER_WORDS + r / WORDBITS] >> (r % WORDBITS)) & 1 ;
+  }
+
+  void SetBit(int l, size_t i)
+  {
+    WORD *block = _B + (l * _blockCnt + i / BLOCK_BITS) * BLOCK_WORDS ;
+    size_t r = i % BLOCK_BITS ;
+    block[BLOCK_HEADER_WORDS + r / WORDBITS] |= (1ull << (r % WORDBITS)) ;
+  }
+
+  // Map the prefix [0, i) of the sequence through the levels with code c.
+  // return: the position on the last level
+  size_t MapDown(WORD c, size_t i) const
+  {
+    int l ;
+    for (l = 0 ; l < _levelCnt ; ++l)
+    {
+      size_t r1 = Rank1(l, i) ;
+      if ((c >> (_levelCnt - l - 1)) & 1)
+        i = _zeros[l] + r1 ;
+      else
+        i -= r1 ;
+    }
+    return i ;
+  }
+
+  void MallocBlocks()
+  {
+    size_t size = sizeof(WORD) * BLOCK_WORDS * _blockCnt * _levelCnt ;
+    if (size == 0)
+      size = sizeof(WORD) * BLOCK_WORDS ;
+    _B = (WORD *)Utils::MallocLarge(size, BLOCK_WORDS * sizeof(WORD)) ;
+    if (_B == NULL)
+    {
+      fprintf(stderr, "ERROR: failed to allocate the memory for Sequence_WaveletMatrix.\n") ;
+      exit(1) ;
+    }
+    memset(_B, 0, size) ;
+    _zeros = (size_t *)malloc(sizeof(size_t) * (_levelCnt + 1)) ;
+    _start = (size_t *)malloc(sizeof(size_t) * (1ull << _levelCnt)) ;
+    _space = size + sizeof(size_t) * (_levelCnt + 1 + (1ull << _levelCnt)) ;
+  }
+
+  void InitStart()
+  {
+    WORD c ;
+    for (c = 0 ; c < (1ull << _levelCnt) ; ++c)
+      _start[c] = MapDown(c, 0) ;
+  }
+
+public:
+  Sequence_WaveletMatrix()
+  {
+    _B = NULL ;
+    _zeros = _start = NULL ;
+    _blockCnt = 0 ;
+    _levelCnt = 0 ;
+  }
+
+  ~Sequence_WaveletMatrix() {Free() ;}
+
+  void Free()
+  {
+    if (_B != NULL)
+    {
+      Utils::FreeLarge(_B) ;
+      free(_zeros) ;
+      free(_start) ;
+      _B = NULL ;
+      _zeros = _start = NULL ;
+      _blockCnt = 0 ;
+      _levelCnt = 0 ;
+    }
+    Sequence::Free() ;
+  }
+
+  // The matrix does not use select structures, keep this to be compatible with the wavelet tree.
+  void SetSelectSpeed(int speed)
+  {
+  }
+
+  size_t GetSpace() {return _space + _alphabets.GetSpace() - sizeof(_alphabets) + sizeof(*this) ;}
+
+  void Init(const FixedSizeElemArray &S, size_t sequenceLength, const ALPHABET *alphabetMap)
+  {
+    size_t i ;
+    int l ;
+
+    _n = sequenceLength ;
+    if (_alphabets.GetSize() == 0)
+      _alphabets.InitFromList(alphabetMap, strlen(alphabetMap)) ;
+    _levelCnt = _alphabets.GetLongestCodeLength() ;
+    _blockCnt = _n / BLOCK_BITS + 1 ;
+    MallocBlocks() ;
+
+    // Codes in the order of current level
+    FixedSizeElemArray codeBuffers[2] ;
+    for (l = 0 ; l < 2 ; ++l)
+      codeBuffers[l].Malloc(_levelCnt > 0 ? _levelCnt : 1, _n) ;
+    for (i = 0 ; i < _n ; ++i)
+      codeBuffers[0].Write(i, _alphabets.Encode(alphabetMap[S.Read(i)])) ;
+
+    for (l = 0 ; l < _levelCnt ; ++l)
+    {
+      int shift = _levelCnt - l - 1 ;
+      FixedSizeElemArray &codes = codeBuffers[l & 1] ;
+      FixedSizeElemArray &nextCodes = codeBuffers[(l & 1) ^ 1] ;
+      size_t zeroCnt = 0 ;
+      for (i = 0 ; i < _n ; ++i)
+      {
+        if ((codes.Read(i) >> shift) & 1)
+          SetBit(l, i) ;
+        else
+          ++zeroCnt ;
+      }
+      _zeros[l] = zeroCnt ;
+
+      // Fill the counts and stably partition the codes for next level
+      size_t j ;
+      size_t onecnt = 0 ;
+      for (i = 0 ; i < _blockCnt ; ++i)
+      {
+        WORD *block = _B + (l * _blockCnt + i) * BLOCK_WORDS ;
+        block[0] = onecnt ;
+        for (j = BLOCK_HEADER_WORDS ; j < (size_t)BLOCK_WORDS ; ++j)
+        {
+          block[1] |= ((WORD)(onecnt - block[0]) << (9 * (j - BLOCK_HEADER_WORDS))) ;
+          onecnt += Utils::Popcount(block[j]) ;
+        }
+      }
+
+      if (l < _levelCnt - 1)
+      {
+        size_t zi = 0 ;
+        size_t oi = zeroCnt ;
+        for (i = 0 ; i < _n ; ++i)
+        {
+          WORD c = codes.Read(i) ;
+          if ((c >> shift) & 1)
+            nextCodes.Write(oi++, c) ;
+          else
+            nextCodes.Write(zi++, c) ;
+        }
+      }
+    }
+
+    InitStart() ;
+  }
+
+  ALPHABET Access(size_t i) const
+  {
+    int l ;
+    WORD code = 0 ;
+    for (l = 0 ; l < _levelCnt ; ++l)
+    {
+      int b = AccessBit(l, i) ;
+      code = (code << 1) | b ;
+      size_t r1 = Rank1(l, i) ;
+      i = b ? _zeros[l] + r1 : i - r1 ;
+    }
+    return _alphabets.Decode(code, _levelCnt) ;
+  }
+
+  // Return: the number of alphabet c's in [0..i]
+  size_t Rank(ALPHABET c, size_t i, int inclusive = 1) const
+  {
+    WORD code = _alphabets.Encode(c) ;
+    if (inclusive)
+      ++i ;
+    return MapDown(code, i) - _start[code] ;
+  }
+
+  // Return: rank of c in [0..i] (inclusive),
+  //  also test whether T[i]==c, return through isC
+  size_t RankAndTest(ALPHABET c, size_t i, bool &isC) const
+  {
+    WORD code = _alphabets.Encode(c) ;
+    int l ;
+    size_t p = i ; // S[i] is at position p on the level as long as its prefix matches c
+    isC = true ;
+    for (l = 0 ; l < _levelCnt ; ++l)
+    {
+      int b = (code >> (_levelCnt - l - 1)) & 1 ;
+      if (isC && AccessBit(l, p) != b)
+        isC = false ;
+      size_t r1 = Rank1(l, p) ;
+      p = b ? _zeros[l] + r1 : p - r1 ;
+    }
+    return p - _start[code] + (isC ? 1 : 0) ;
+  }
+
+  // return: the index of the ith (1-based) c. Binary search on rank.
+  size_t Select(ALPHABET c, size_t i) const
+  {
+    size_t l = 0, r = _n ;
+    while (l < r)
+    {
+      size_t m = (l + r) / 2 ;
+      if (Rank(c, m) >= i)
+        r = m ;
+      else
+        l = m + 1 ;
+    }
+    return l ;
+  }
+
+  void Save(FILE *fp)
+  {
+    Sequence::Save(fp) ;
+    SAVE_VAR(fp, _levelCnt) ;
+    SAVE_VAR(fp, _blockCnt) ;
+    SAVE_ARR(fp, _B, BLOCK_WORDS * _blockCnt * _levelCnt) ;
+    SAVE_ARR(fp, _zeros, _levelCnt) ;
+  }
+
+  void Load(FILE *fp)
+  {
+    Free() ;
+    Sequence::Load(fp) ;
+    LOAD_VAR(fp, _levelCnt) ;
+    LOAD_VAR(fp, _blockCnt) ;
+    MallocBlocks() ;
+    LOAD_ARR(fp, _B, BLOCK_WORDS * _blockCnt * _levelCnt) ;
+    LOAD_ARR(fp, _zeros, _levelCnt) ;
+    InitStart() ;
+  }
+
+  void PrintStats()
+  {
+    Utils::PrintLog("Sequence_WaveletMatrix: total_length: %lu levels: %d", _n, _levelCnt) ;
+  }
+} ;
+}
+
+#endif
@@ -208,7 +208,7 @@ public:
     
     WORD *bufferv = Utils::MallocByBits(sequenceLength) ; 
     BuildTree(S, alphabetMap, 0, 0, bufferv) ;
-    free(bufferv) ;
+    Utils::FreeLarge(bufferv) ;
   }
 
   // Return: the alphabet at position i.
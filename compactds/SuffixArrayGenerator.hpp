@@ -2,6 +2,7 @@
 #define _MOURISL_COMPACTDS_SUFFIXARRAY_GENERATOR
 
 #include <vector>
+#include <pthread.h>
 
 #include "FixedSizeElemArray.hpp"
 #include "DifferenceCover.hpp"
@@ -11,12 +12,38 @@
 // The class handle the generation of suffix array by chunks
 // The chunk creation is based the sampled difference cover (Algorithm 11.9 from the textbook is commented out)
 namespace compactds {
+class SuffixArrayGenerator ;
+
+// Each thread handles the buckets/groups/cuts with index in [from, to) 
+struct _SAGeneratorThreadArg
+{
+  int tid ;
+  int threadCnt ;
+
+  SuffixArrayGenerator *saGenerator ;
+  const FixedSizeElemArray *T ;
+  size_t n ;
+
+  size_t *sa ;
+  size_t from, to ;
+  size_t offset ; // the position on sa for the first bucket/group
+
+  size_t *bucketSize ; // for the difference cover prefix sorting
+  size_t d ; // the prefix length shared by the elements in a bucket, or the maximum LCP length for the cuts
+
+  size_t *L ; // for the Larsson-Sadakane doubling 
+  size_t *rank ;
+  size_t *nextBuffer ;
+  size_t h ;
+} ;
+
 class SuffixArrayGenerator
 {
 private:
   size_t _n ;
   size_t _space ;
   size_t _alphabetSize ;
+  int _threadCnt ;
   
   // The variables relate to generate the boundaries/_cuts 
   size_t _b ;
@@ -29,6 +56,77 @@ private:
   size_t *_dcISA ; // The difference cover's index should be compacted when query this ISA 
   size_t _dcSize ; 
   
+  // Relate to threads ============================================  
+  struct _SAGeneratorThreadArg *InitThreadArgs(const FixedSizeElemArray &T, size_t n, size_t *sa)
+  {
+    int i ;
+    struct _SAGeneratorThreadArg *args = (struct _SAGeneratorThreadArg *)calloc(_threadCnt, sizeof(*args)) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+    {
+      args[i].tid = i ;
+      args[i].threadCnt = _threadCnt ;
+      args[i].saGenerator = this ;
+      args[i].T = &T ;
+      args[i].n = n ;
+      args[i].sa = sa ;
+    }
+    return args ;
+  }
+
+  void RunThreads(void *(*threadFunc)(void *), struct _SAGeneratorThreadArg *args)
+  {
+    int i ;
+    pthread_t *threads = (pthread_t *)malloc(sizeof(*threads) * _threadCnt) ;
+    pthread_attr_t attr ;
+    pthread_attr_init( &attr ) ;
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE ) ;
+    
+    // The multikey quick sort is recursive, use the same estimation as in FMBuilder
+    size_t pthreadStackSize, estimatedStackSize ;
+    pthread_attr_getstacksize(&attr, &pthreadStackSize) ;
+    estimatedStackSize = (size_t)_dc.GetV() * 500 ;
+    if (estimatedStackSize > pthreadStackSize) 
+      pthread_attr_setstacksize(&attr, estimatedStackSize) ;
+
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_create(&threads[i], &attr, threadFunc, (void *)(args + i)) ;
+    for (i = 0 ; i < _threadCnt ; ++i)
+      pthread_join(threads[i], NULL) ;
+
+    pthread_attr_destroy(&attr) ;
+    free(threads) ;
+  }
+
+  // Split the runs of sizes (sizes[0..m-1]) into consecutive parts with similar total size, one for each thread. 
+  // The sizes are the absolute value of the entries, so it also works for the L array in LS algorithm.
+  void PartitionRunsForThreads(const size_t *sizes, size_t m, size_t total, struct _SAGeneratorThreadArg *args)
+  {
+    size_t i ;
+    int t = 0 ;
+    size_t offset = 0 ;
+    args[0].from = 0 ;
+    args[0].offset = 0 ;
+    for (i = 0 ; i < m ; ++i)
+    {
+      // Thread t+1 starts from the run whose start is beyond its share
+      while (t + 1 < _threadCnt && offset >= total / _threadCnt * (t + 1))
+      {
+        args[t].to = i ;
+        ++t ;
+        args[t].from = i ;
+        args[t].offset = offset ;
+      }
+      int64_t v = (int64_t)sizes[i] ;
+      offset += (v < 0 ? -v : v) ;
+    }
+    args[t].to = m ;
+    for (++t ; t < _threadCnt ; ++t)
+    {
+      args[t].from = args[t].to = m ;
+      args[t].offset = offset ;
+    }
+  }
+
   // Relate to cut ============================================  
 #if 0 // The commented out codes is for Algorithm 11.9, which might be too slow for very repetitive sequence (i.e: ACGTACGTACGT....), so we have another implementation now
 
@@ -119,12 +217,11 @@ private:
     return _cutCnt ;
   }
 
-  // For each cut s, compute LCP(s, s[i:]) for i <= maxSize
-  void ComputeCutLCP(const FixedSizeElemArray &T, size_t n, size_t maxSize) 
+  // For each cut s in [from, to) with stride step, compute LCP(s, s[i:]) for i <= maxSize
+  void ComputeCutLCPInRange(const FixedSizeElemArray &T, size_t n, size_t maxSize, size_t from, size_t to, size_t step)
   {
     size_t i, j, l ;
-    _cutLCP = (size_t **)malloc(sizeof(*_cutLCP) * _cutCnt) ;
-    for (i = 0 ; i < _cutCnt ; ++i)
+    for (i = from ; i < to ; i += step)
     {
       size_t jopenend = n - _cuts[i] ;
       if (jopenend > maxSize )
@@ -144,6 +241,32 @@ private:
       }
     }
   }
+
+  static void *ComputeCutLCP_Thread(void *arg)
+  {
+    struct _SAGeneratorThreadArg *pArg = (struct _SAGeneratorThreadArg *)arg ;
+    SuffixArrayGenerator &g = *(pArg->saGenerator) ;
+    g.ComputeCutLCPInRange(*(pArg->T), pArg->n, pArg->d, pArg->tid, g._cutCnt, pArg->threadCnt) ;
+    pthread_exit(NULL) ;
+  }
+
+  // For each cut s, compute LCP(s, s[i:]) for i <= maxSize
+  void ComputeCutLCP(const FixedSizeElemArray &T, size_t n, size_t maxSize) 
+  {
+    _cutLCP = (size_t **)malloc(sizeof(*_cutLCP) * _cutCnt) ;
+    if (_threadCnt <= 1 || _cutCnt < (size_t)_threadCnt)
+    {
+      ComputeCutLCPInRange(T, n, maxSize, 0, _cutCnt, 1) ;
+      return ;
+    }
+    
+    // The cuts have similar cost, so the threads take them in an interleaved fashion.
+    struct _SAGeneratorThreadArg *args = InitThreadArgs(T, n, NULL) ;
+    for (int i = 0 ; i < _threadCnt ; ++i)
+      args[i].d = maxSize ;
+    RunThreads(ComputeCutLCP_Thread, args) ;
+    free(args) ;
+  }
   
   // Compare the T[i,...] with a cut ci, and adjust other auxiliary data relating
   // rightmosti: the start position corresponding to the rightmost j 
@@ -588,6 +711,152 @@ private:
     MultikeyQSort(T, n, sa, m, pj, e, d, dcStrategy, alphabetCounts) ;
   }
 
+  // The bucket of T[p..p+w-1], where the end of T is the smallest character
+  size_t GetPrefixBucket(const FixedSizeElemArray &T, size_t n, size_t p, size_t w)
+  {
+    size_t i ;
+    size_t ret = 0 ;
+    for (i = 0 ; i < w ; ++i)
+    {
+      ret *= (_alphabetSize + 1) ;
+      if (p + i < n)
+        ret += T.Read(p + i) + 1 ;
+    }
+    return ret ;
+  }
+
+  static void *SortDCPrefix_Thread(void *arg)
+  {
+    struct _SAGeneratorThreadArg *pArg = (struct _SAGeneratorThreadArg *)arg ;
+    SuffixArrayGenerator &g = *(pArg->saGenerator) ;
+    size_t i ;
+    size_t offset = pArg->offset ;
+    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (g._alphabetSize + 1)) ;
+    for (i = pArg->from ; i < pArg->to ; ++i)
+    {
+      size_t size = pArg->bucketSize[i] ;
+      if (size > 1)
+        g.MultikeyQSort(*(pArg->T), pArg->n, pArg->sa, g._dcSize, offset, offset + size - 1, 
+            pArg->d, /*dcStrategy=*/2, alphabetCounts) ;
+      offset += size ;
+    }
+    free(alphabetCounts) ;
+    pthread_exit(NULL) ;
+  }
+
+  // Get the difference cover positions and sort them by their first v characters
+  // buffer: temporary array with size _dcSize
+  void SortDCPrefix(const FixedSizeElemArray &T, size_t n, size_t *sa, size_t *buffer)
+  {
+    size_t i ;
+    _dc.GetDiffCoverList(n, sa) ;
+    if (_threadCnt <= 1 || _dcSize < (size_t)_threadCnt * 1024)
+    {
+      size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
+      MultikeyQSort(T, n, sa, _dcSize, 0, _dcSize - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
+      free(alphabetCounts) ; 
+      return ;
+    }
+
+    // Bucket the positions by their first w characters,
+    //   so each thread can sort a subset of the buckets independently.
+    size_t w = 0 ;
+    size_t bucketCnt = 1 ;
+    while (w < (size_t)_dc.GetV() && bucketCnt * (_alphabetSize + 1) <= (1<<16))
+    {
+      bucketCnt *= (_alphabetSize + 1) ;
+      ++w ;
+    }
+    size_t *bucketSize = (size_t *)calloc(bucketCnt, sizeof(size_t)) ;
+    size_t *bucketStart = (size_t *)malloc(sizeof(size_t) * bucketCnt) ;
+    for (i = 0 ; i < _dcSize ; ++i)
+      ++bucketSize[ GetPrefixBucket(T, n, sa[i], w) ] ;
+    bucketStart[0] = 0 ;
+    for (i = 1 ; i < bucketCnt ; ++i)
+      bucketStart[i] = bucketStart[i - 1] + bucketSize[i - 1] ;
+    for (i = 0 ; i < _dcSize ; ++i)
+    {
+      size_t b = GetPrefixBucket(T, n, sa[i], w) ;
+      buffer[ bucketStart[b] ] = sa[i] ;
+      ++bucketStart[b] ;
+    }
+    memcpy(sa, buffer, sizeof(sa[0]) * _dcSize) ;
+    free(bucketStart) ;
+
+    struct _SAGeneratorThreadArg *args = InitThreadArgs(T, n, sa) ;
+    PartitionRunsForThreads(bucketSize, bucketCnt, _dcSize, args) ;
+    for (i = 0 ; i < (size_t)_threadCnt ; ++i)
+    {
+      args[i].bucketSize = bucketSize ;
+      args[i].d = w ;
+    }
+    RunThreads(SortDCPrefix_Thread, args) ;
+    
+    free(args) ;
+    free(bucketSize) ;
+  }
+
+  // Sort each h-group (positive entries in L[from..to-1]) in the LS algorithm. 
+  //   The new ranks are stored in newRank. 
+  void SortLSGroups(size_t *sa, size_t *rank, size_t n, const size_t *L, size_t from, size_t to, size_t offset, size_t h, size_t *newRank)
+  {
+    size_t i ;
+    for (i = from ; i < to ; ++i)
+    {
+      int64_t liValue = (int64_t)L[i] ;
+      if (liValue < 0)
+      {
+        offset += (size_t)(-liValue) ;
+      }
+      else
+      {
+        MultikeyQSortForLSandDC(sa, rank, n, offset, offset + L[i] - 1,
+            h, newRank) ;
+
+        offset += L[i] ;
+      }
+    }
+  }
+
+  // Copy the updated rank back from newRank for the h-groups in L[from..to-1]
+  void UpdateLSRanks(size_t *sa, size_t *rank, const size_t *L, size_t from, size_t to, size_t offset, const size_t *newRank)
+  {
+    size_t i, j ;
+    for (i = from ; i < to ; ++i)
+    {
+      int64_t liValue = (int64_t)L[i] ;
+      if (liValue < 0)
+      {
+        offset += (size_t)(-liValue) ;
+      }
+      else
+      {
+        for (j = offset ; j < offset + L[i] ; ++j)
+        {
+          size_t dcj = _dc.CompactIndex(sa[j]) ;
+          rank[dcj] = newRank[dcj] ;
+        }
+        offset += L[i] ;
+      }
+    }
+  }
+
+  static void *SortLSGroups_Thread(void *arg)
+  {
+    struct _SAGeneratorThreadArg *pArg = (struct _SAGeneratorThreadArg *)arg ;
+    pArg->saGenerator->SortLSGroups(pArg->sa, pArg->rank, pArg->n, pArg->L, 
+        pArg->from, pArg->to, pArg->offset, pArg->h, pArg->nextBuffer) ;
+    pthread_exit(NULL) ;
+  }
+  
+  static void *UpdateLSRanks_Thread(void *arg)
+  {
+    struct _SAGeneratorThreadArg *pArg = (struct _SAGeneratorThreadArg *)arg ;
+    pArg->saGenerator->UpdateLSRanks(pArg->sa, pArg->rank, pArg->L, 
+        pArg->from, pArg->to, pArg->offset, pArg->nextBuffer) ;
+    pthread_exit(NULL) ;
+  }
+
   // Sort the suffixes in the difference cover using Manber-Myers algorithm
   // @return: the suffix array of the difference cover
   size_t *SortSuffixInDCWithMM(const FixedSizeElemArray &T, size_t n)
@@ -611,10 +880,7 @@ private:
     // This is because the following Manber-Myers algorithm (or Larsson-Sadakane) 
     //  needs to start at k=v, so the +k is also in the difference cover.
     //Utils::PrintLog("SA sort start") ;
-    _dc.GetDiffCoverList(n, sa) ;
-    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
-    MultikeyQSort(T, n, sa, _dcSize, 0, _dcSize - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
-    free(alphabetCounts) ; 
+    SortDCPrefix(T, n, sa, nextBuffer) ;
     //Utils::PrintLog("SA sort MultikeyQSort finishes") ;
     
     maxRank = 0 ;
@@ -716,10 +982,7 @@ private:
 
     // Sort by their first v characters
     Utils::PrintLog("Start to sort |dc|-prefix") ;
-    _dc.GetDiffCoverList(n, sa) ;
-    size_t *alphabetCounts = (size_t *)malloc(sizeof(size_t) * (_alphabetSize + 1)) ;
-    MultikeyQSort(T, n, sa, _dcSize, 0, _dcSize - 1, 0, /*dcStrategy=*/2, alphabetCounts) ;
-    free(alphabetCounts) ; 
+    SortDCPrefix(T, n, sa, nextBuffer) ;
     Utils::PrintLog("Finish sorting |dc|-prefix") ;
 
     // Initialization
@@ -789,43 +1052,31 @@ private:
 
     // Sorting difference cover using Larsson-Sadakane algorithm 
     size_t *tmpSwap ;
+    struct _SAGeneratorThreadArg *args = NULL ;
+    if (_threadCnt > 1)
+      args = InitThreadArgs(T, n, sa) ;
     for (k = v ; k < n /*&& maxRank < _dcSize - 1*/ ; k <<= 1)
     {
-      offset = 0 ;
-      for (i = 0 ; i < sizeL ; ++i)
+      // The k-groups are independent, and the new rank is written to nextBuffer first, 
+      //   so we can sort the groups in parallel.
+      if (args == NULL || sizeL < (size_t)_threadCnt)
       {
-        int64_t liValue = (int64_t)L[i] ;
-        if (liValue < 0)
-        {
-          offset += (size_t)(-liValue) ;
-        }
-        else
-        {
-          MultikeyQSortForLSandDC(sa, rank, n, offset, offset + L[i] - 1,
-              k, nextBuffer) ;
-
-          offset += L[i] ;
-        }
+        SortLSGroups(sa, rank, n, L, 0, sizeL, 0, k, nextBuffer) ;
+        // Copy the updated rank back from the buffer
+        UpdateLSRanks(sa, rank, L, 0, sizeL, 0, nextBuffer) ;
       }
-
-      // Copy the updated rank back from the buffer
-      offset = 0 ;
-      for (i = 0 ; i < sizeL ; ++i)
+      else
       {
-        int64_t liValue = (int64_t)L[i] ;
-        if (liValue < 0)
-        {
-          offset += (size_t)(-liValue) ;
-        }
-        else
+        PartitionRunsForThreads(L, sizeL, _dcSize, args) ;
+        for (i = 0 ; i < (size_t)_threadCnt ; ++i)
         {
-          for (j = offset ; j < offset + L[i] ; ++j)
-          {
-            size_t dcj = _dc.CompactIndex(sa[j]) ;
-            rank[dcj] = nextBuffer[dcj] ;
-          }
-          offset += L[i] ;
+          args[i].L = L ;
+          args[i].rank = rank ;
+          args[i].nextBuffer = nextBuffer ;
+          args[i].h = k ;
         }
+        RunThreads(SortLSGroups_Thread, args) ;
+        RunThreads(UpdateLSRanks_Thread, args) ;
       }
 
       // Update L to nextbuffer, and then swap the points
@@ -894,6 +1145,8 @@ private:
       sizeL = newSizeL ;
     } // for-loop of k
 
+    if (args != NULL)
+      free(args) ;
     free(nextBuffer) ;
     free(L) ;
 
@@ -907,6 +1160,7 @@ public:
     _n = _space = 0 ;
     _cuts = NULL ;
     _dcISA = NULL ;
+    _threadCnt = 1 ;
   }
 
   ~SuffixArrayGenerator() 
@@ -945,10 +1199,12 @@ public:
 
   // Initialize the generator to obtain the _cuts
   // _dcv: difference cover period
+  // threadCnt: the number of threads for sorting the difference cover and computing cut LCPs
   // @return: the number of _cuts
-  size_t Init(const FixedSizeElemArray &T, size_t n, size_t b, int dcv, int alphabetSize)
+  size_t Init(const FixedSizeElemArray &T, size_t n, size_t b, int dcv, int alphabetSize, int threadCnt = 1)
   {
     this->_n = n ;
+    this->_threadCnt = threadCnt > 0 ? threadCnt : 1 ;
     if (b > 0)
       this->_b = b ;
     this->_alphabetSize = alphabetSize ;
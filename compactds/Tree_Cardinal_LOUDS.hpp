@@ -62,7 +62,7 @@ public:
 
     _B.Init(W, c * n) ;
     _space = _B.GetSpace() - sizeof(_B);
-    free(W) ;
+    Utils::FreeLarge(W) ;
   }
 
   // The index in B
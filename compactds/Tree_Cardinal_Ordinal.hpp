@@ -46,7 +46,7 @@ public:
       }
     }
     _B.Init(W, c * n) ;
-    free(W) ;
+    Utils::FreeLarge(W) ;
 
     _space = _t.GetSpace(false) + _B.GetSpace() - sizeof(_B) ;
   }
@@ -97,7 +97,7 @@ public:
     _l.Init(childrenLabels, 2 * n - 1, alphabetList.data()) ;
     _lmarker.Init(W, 2 * n - 1) ;
 
-    free(W) ;
+    Utils::FreeLarge(W) ;
     
     _space = _t.GetSpace(false) + _l.GetSpace() - sizeof(_l) + _lmarker.GetSpace() - sizeof(_lmarker) ;
   }
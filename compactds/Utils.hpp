@@ -10,6 +10,15 @@
 #include <math.h>
 #include <string.h>
 
+#include <vector>
+#include <utility>
+
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace compactds {
 #define WORD_64 // comment this out if word size is 32
 
@@ -70,6 +79,9 @@ const uint64_t MASK_ARRAY[65] =
 #define SAVE_ARR(fp, x, n) (fwrite((x), sizeof(*(x)), (n), (fp)))
 #define LOAD_ARR(fp, x, n) (fread((x), sizeof(*(x)), (n), (fp)))
 
+// The size of the transparent huge page on x86-64
+#define HUGE_PAGE_SIZE (1ull<<21)
+
 #ifdef __GNUC__
   #define CACHE_PREFETCH(x) __builtin_prefetch(x)
 #else
@@ -274,8 +286,200 @@ public:
 
   static WORD *MallocByBits(size_t l)
   {
+    size_t size = BitsToWords(l) * sizeof(WORD) ;
+    if (GetHugePageState().enabled && size >= HUGE_PAGE_SIZE)
+    {
+      WORD *ret = (WORD *)MallocLarge(size) ;
+      if (ret != NULL)
+        memset(ret, 0, size) ;
+      return ret ;
+    }
     return (WORD *)calloc(BitsToWords(l), sizeof(WORD)) ;
   }
+
+  // Whether the large allocations should be backed by transparent huge pages,
+  //   and the memory advised so far.
+  struct _hugePageState
+  {
+    bool enabled ;
+    size_t advisedBytes ;
+    std::vector< std::pair<size_t, size_t> > advisedRanges ; // [start, end) of each advised allocation
+  } ;
+
+  static struct _hugePageState &GetHugePageState()
+  {
+    static struct _hugePageState state = {false, 0, std::vector< std::pair<size_t, size_t> >()} ;
+    return state ;
+  }
+
+  // Mainly for the data structures loaded for query, so the random access has fewer TLB misses
+  static void SetHugePage(bool enabled)
+  {
+    GetHugePageState().enabled = enabled ;
+  }
+
+  // Allocate the memory that can be released by free().
+  // If huge page is enabled, the memory of at least HUGE_PAGE_SIZE is aligned to the huge page
+  //   and advised with MADV_HUGEPAGE before it is touched.
+  // alignment: 0 for the plain malloc, otherwise it should be a power of 2.
+  static void *MallocLarge(size_t size, size_t alignment = 0)
+  {
+    void *ret = NULL ;
+#ifdef MADV_HUGEPAGE
+    if (GetHugePageState().enabled && size >= HUGE_PAGE_SIZE)
+    {
+      size_t alignedSize = DIV_CEIL(size, HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE ;
+      if (posix_memalign(&ret, HUGE_PAGE_SIZE, alignedSize))
+        return NULL ;
+      if (madvise(ret, alignedSize, MADV_HUGEPAGE) == 0)
+      {
+        GetHugePageState().advisedBytes += alignedSize ;
+        GetHugePageState().advisedRanges.push_back( 
+            std::pair<size_t, size_t>((size_t)ret, (size_t)ret + alignedSize) ) ;
+      }
+      return ret ;
+    }
+#endif
+    if (alignment == 0)
+      return malloc(size) ;
+    if (posix_memalign(&ret, alignment, size))
+      return NULL ;
+    return ret ;
+  }
+
+  // Free the memory from MallocLarge (or malloc), and forget its advised range.
+  static void FreeLarge(void *p)
+  {
+    size_t i ;
+    if (p == NULL)
+      return ;
+    std::vector< std::pair<size_t, size_t> > &ranges = GetHugePageState().advisedRanges ;
+    for (i = 0 ; i < ranges.size() ; ++i)
+      if (ranges[i].first == (size_t)p)
+      {
+        GetHugePageState().advisedBytes -= ranges[i].second - ranges[i].first ;
+        ranges[i] = ranges.back() ;
+        ranges.pop_back() ;
+        break ;
+      }
+    free(p) ;
+  }
+
+  // Resize the memory from MallocLarge (or malloc) of oldSize bytes to newSize bytes.
+  //   realloc would lose the huge page alignment and advice, so the large memory
+  //   is allocated again and copied when huge page is enabled.
+  // @return: NULL if failed, and p is kept
+  static void *ReallocLarge(void *p, size_t oldSize, size_t newSize)
+  {
+    if (p == NULL)
+      return MallocLarge(newSize) ;
+    if (!IsAdvised(p) && (!GetHugePageState().enabled || newSize < HUGE_PAGE_SIZE))
+      return realloc(p, newSize) ;
+    void *ret = MallocLarge(newSize) ;
+    if (ret == NULL)
+      return NULL ;
+    memcpy(ret, p, MIN(oldSize, newSize)) ;
+    FreeLarge(p) ;
+    return ret ;
+  }
+
+  static bool IsAdvised(void *p)
+  {
+    size_t i ;
+    const std::vector< std::pair<size_t, size_t> > &ranges = GetHugePageState().advisedRanges ;
+    for (i = 0 ; i < ranges.size() ; ++i)
+      if (ranges[i].first == (size_t)p)
+        return true ;
+    return false ;
+  }
+
+  // Report how much of the advised memory is backed by huge pages.
+  // madvise splits the mappings at the advised ranges, so only the huge pages
+  //   of the mappings in /proc/self/smaps inside these ranges are counted, 
+  //   not those of the other heap memory like the read buffers.
+  static void PrintHugePageCoverage()
+  {
+    size_t i ;
+    size_t hugeBytes = 0 ;
+    char line[256] ;
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r") ;
+    if (fp == NULL)
+    {
+      fprintf(stderr, "WARNING: transparent huge page is not supported in the system.\n") ;
+      return ;
+    }
+    if (fgets(line, sizeof(line), fp) && strstr(line, "[never]"))
+      fprintf(stderr, "WARNING: transparent huge page is disabled in the system.\n") ;
+    fclose(fp) ;
+
+    fp = fopen("/proc/self/smaps", "r") ;
+    if (fp != NULL)
+    {
+      const std::vector< std::pair<size_t, size_t> > &ranges = GetHugePageState().advisedRanges ;
+      size_t advisedOverlap = 0 ; // the advised bytes in the current mapping
+      while (fgets(line, sizeof(line), fp))
+      {
+        size_t start, end, kb ;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) // the header line of a mapping
+        {
+          advisedOverlap = 0 ;
+          for (i = 0 ; i < ranges.size() ; ++i)
+          {
+            size_t l = MAX(start, ranges[i].first) ;
+            size_t r = MIN(end, ranges[i].second) ;
+            if (l < r)
+              advisedOverlap += r - l ;
+          }
+        }
+        else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+          hugeBytes += MIN(kb * 1024, advisedOverlap) ;
+      }
+      fclose(fp) ;
+    }
+    size_t advisedBytes = GetHugePageState().advisedBytes ;
+    PrintLog("Huge page coverage: %.1lfMB of %.1lfMB advised memory (%.1lf%%).",
+        hugeBytes / 1048576.0, advisedBytes / 1048576.0,
+        advisedBytes > 0 ? 100.0 * hugeBytes / advisedBytes : 0.0) ;
+  }
+  
+  // The peak resident memory of the process in bytes, 0 if unknown
+  static size_t GetPeakMemory()
+  {
+    struct rusage usage ;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0 ;
+#ifdef __APPLE__
+    return usage.ru_maxrss ; // already in bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024 ;
+#endif
+  }
+
+  // The monotonic wall time in seconds
+  static double GetWallTime()
+  {
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + t.tv_nsec / 1e9 ;
+  }
+
+  // The CPU time of the calling thread in seconds
+  static double GetThreadCpuTime()
+  {
+    struct timespec t ;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) ;
+    return t.tv_sec + t.tv_nsec / 1e9 ;
+  }
+
+  // The user and system CPU time of the process in seconds
+  static double GetProcessCpuTime()
+  {
+    struct rusage usage ;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0 ;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+      + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6 ;
+  }
   
   // Translate the space usage description (TB, GB, MB, KB) to bytes
   static size_t SpaceStringToBytes(const char *s) 
@@ -39,7 +39,7 @@ public:
   void Free()
   {
     if (M != NULL)
-      free(M) ;
+      Utils::FreeLarge(M) ;
     if (P != NULL)
       free(P) ;
     offsets.Free() ;
@@ -38,7 +38,7 @@ public:
   void Free()
   {
     if (M != NULL)
-      free(M) ;
+      Utils::FreeLarge(M) ;
     if (P != NULL)
       free(P) ;
     M = NULL ;
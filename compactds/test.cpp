@@ -1382,6 +1382,167 @@ int main(int argc, char *argv[])
     printf("Inverted index based on permutation space usage %lu\n", idx.GetSpace()) ;
   }
 #endif
+  else if (!strcmp(argv[1], "fmd"))
+  {
+    // The text followed by its reverse complement, compared with the brute-force
+    //   suffix array and matches.
+    const size_t half = 3000 ;
+    const size_t n = 2 * half ;
+    const size_t minL = 12 ;
+    FixedSizeElemArray s ;
+    s.Malloc(2, n) ;
+    char *strs = (char *)malloc(n + 1) ;
+    char abList[] = "ACGT" ;
+    srand(1) ;
+    for (i = 0 ; i < half ; ++i)
+    {
+      int r = rand() % 4 ;
+      if (i >= 100 && rand() % 4 == 0) // repeats to have intervals of size > 1
+        r = s.Read(i - 100) ;
+      s.Write(i, r) ;
+      s.Write(n - 1 - i, 3 - r) ;
+    }
+    for (i = 0 ; i < n ; ++i)
+      strs[i] = abList[s.Read(i)] ;
+    strs[n] = '\0' ;
+
+    struct _FMBuilderParam param ;
+    param.threadCnt = 4 ;
+    param.saBlockSize = n / 4 ;
+    param.precomputeWidth = 6 ;
+    param.maxLcp = 17 ;
+    FixedSizeElemArray BWT ;
+    size_t firstISA = 0 ;
+    param.selectedISA[0] = 0 ;
+    param.selectedISA[1] = 0 ;
+    FMBuilder::Build(s, n, 4, BWT, firstISA, param) ;
+    FMIndex< Sequence_WaveletTree<Bitvector_Plain> > fmIndex ;
+    fmIndex.Init(BWT, n, firstISA, param, abList, strlen(abList)) ;
+
+    // Brute-force suffix array, the range of a pattern is found by binary search
+    std::vector<size_t> sa(n) ;
+    for (i = 0 ; i < n ; ++i)
+      sa[i] = i ;
+    std::sort(sa.begin(), sa.end(), [&](size_t a, size_t b) {return strcmp(strs + a, strs + b) < 0 ;}) ;
+    auto patternRange = [&](const char *p, size_t m, size_t &sp) -> size_t {
+      size_t lo = 0, hi = n ;
+      while (lo < hi)
+      {
+        size_t mid = (lo + hi) / 2 ;
+        if (strncmp(strs + sa[mid], p, m) < 0)
+          lo = mid + 1 ;
+        else
+          hi = mid ;
+      }
+      sp = lo ;
+      for (hi = lo ; hi < n && !strncmp(strs + sa[hi], p, m) ; ++hi)
+        ;
+      return hi - lo ;
+    } ;
+    auto reverseComplement = [&](const char *p, size_t m, char *rc) {
+      size_t j ;
+      for (j = 0 ; j < m ; ++j)
+        rc[j] = abList[3 - (strchr(abList, p[m - 1 - j]) - abList)] ;
+      rc[m] = '\0' ;
+    } ;
+
+    // Bidirectional intervals from random extensions
+    size_t k, j ;
+    size_t mismatchCnt = 0 ;
+    size_t compareCnt = 0 ;
+    char p[64], rc[64] ;
+    for (k = 0 ; k < 20000 ; ++k)
+    {
+      size_t m = rand() % 30 + 1 ;
+      size_t start = rand() % (n - m + 1) ;
+      memcpy(p, strs + start, m) ;
+      if (rand() % 4 == 0) // may not occur in the text
+        p[rand() % m] = abList[rand() % 4] ;
+      p[m] = '\0' ;
+
+      size_t b = rand() % m ; // the pattern grows from p[b]
+      size_t e = b + 1 ;
+      struct _FMDInterval ik, ok, all[4] ;
+      fmIndex.FMDInitInterval(p[b], ik) ;
+      while (ik.size > 0 && e - b < m)
+      {
+        bool backward = (e == m || (b > 0 && rand() % 2)) ;
+        char c = backward ? p[b - 1] : p[e] ;
+        fmIndex.FMDExtend(ik, c, backward, ok) ;
+        fmIndex.FMDExtendAll(ik, backward, all) ;
+        const struct _FMDInterval &ak = all[strchr(abList, c) - abList] ;
+        if (ak.size != ok.size || (ok.size > 0 && (ak.sp != ok.sp || ak.rcSp != ok.rcSp)))
+          ++mismatchCnt ;
+        ik = ok ;
+        if (backward)
+          --b ;
+        else
+          ++e ;
+      }
+
+      size_t sp, rcSp ;
+      size_t size = patternRange(p + b, e - b, sp) ;
+      reverseComplement(p + b, e - b, rc) ;
+      patternRange(rc, e - b, rcSp) ;
+      ++compareCnt ;
+      if (size != ik.size || (size > 0 && (sp != ik.sp || rcSp != ik.rcSp)))
+      {
+        ++mismatchCnt ;
+        printf("%s: %lu %lu %lu. %lu %lu %lu\n", p, sp, rcSp, size, ik.sp, ik.rcSp, ik.size) ;
+      }
+    }
+    printf("Interval mismatch count: %lu out of %lu\n", mismatchCnt, compareCnt) ;
+
+    // SMEMs of mutated substrings. An SMEM starts at i if it is longer than
+    //   the longest match at i-1 without the base i-1.
+    mismatchCnt = 0 ;
+    compareCnt = 0 ;
+    const size_t m = 100 ;
+    char q[m + 1] ;
+    std::vector<size_t> longest(m) ;
+    std::vector<struct _FMDInterval> mems ;
+    for (k = 0 ; k < 200 ; ++k)
+    {
+      memcpy(q, strs + rand() % (n - m + 1), m) ;
+      for (j = 0 ; j < 3 ; ++j)
+        q[rand() % m] = abList[rand() % 4] ;
+      if (k % 10 == 0)
+        q[rand() % m] = 'N' ;
+      q[m] = '\0' ;
+
+      for (i = 0 ; i < m ; ++i)
+      {
+        longest[i] = 0 ;
+        for (j = 0 ; j < n ; ++j)
+        {
+          size_t l ;
+          for (l = 0 ; i + l < m && j + l < n && q[i + l] == strs[j + l] ; ++l)
+            ;
+          if (l > longest[i])
+            longest[i] = l ;
+        }
+      }
+
+      fmIndex.FMDSearchSuperMEM(q, m, minL, mems) ;
+      size_t memi = 0 ;
+      for (i = 0 ; i < m ; ++i)
+      {
+        if (longest[i] < minL || (i > 0 && longest[i - 1] > longest[i]))
+          continue ;
+        size_t sp ;
+        size_t size = patternRange(q + i, longest[i], sp) ;
+        ++compareCnt ;
+        if (memi >= mems.size() || mems[memi].start != i || mems[memi].end != i + longest[i]
+            || mems[memi].sp != sp || mems[memi].size != size)
+          ++mismatchCnt ;
+        else
+          ++memi ;
+      }
+      mismatchCnt += mems.size() - memi ;
+    }
+    printf("SMEM mismatch count: %lu out of %lu\n", mismatchCnt, compareCnt) ;
+    free(strs) ;
+  }
   else if (!strcmp(argv[1], "rmmtree"))
   {
     int n = 1000000 ; 
@@ -0,0 +1,64 @@
+// Time the DUST masking on simulated short reads:
+//   ./dustmasker-benchmark [read_count [read_length [low_complexity_fraction]]]
+// A fraction of the reads carry a short tandem repeat to be masked.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Dustmasker.hpp"
+
+static double GetTime()
+{
+  struct timespec t ;
+  clock_gettime(CLOCK_MONOTONIC, &t) ;
+  return t.tv_sec + t.tv_nsec / 1e9 ;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, j ;
+  int readCnt = argc > 1 ? atoi(argv[1]) : 1000000 ;
+  int readLen = argc > 2 ? atoi(argv[2]) : 150 ;
+  double lowComplexityFraction = argc > 3 ? atof(argv[3]) : 0.05 ;
+  const char nucs[] = "ACGT" ;
+
+  srand(17) ;
+  char *reads = (char *)malloc(sizeof(char) * (size_t)readCnt * (readLen + 1)) ;
+  char *buffer = (char *)malloc(sizeof(char) * (readLen + 1)) ;
+  for (i = 0 ; i < readCnt ; ++i)
+  {
+    char *r = reads + (size_t)i * (readLen + 1) ;
+    for (j = 0 ; j < readLen ; ++j)
+      r[j] = nucs[rand() & 3] ;
+    r[readLen] = '\0' ;
+    if (rand() < lowComplexityFraction * RAND_MAX)
+    {
+      int period = rand() % 4 + 1 ;
+      int start = rand() % (readLen / 2 + 1) ;
+      for (j = start + period ; j < readLen && j < start + readLen / 2 ; ++j)
+        r[j] = r[j - period] ;
+    }
+    if (rand() % 100 == 0)
+      r[rand() % readLen] = 'N' ;
+  }
+
+  Dustmasker dustmasker ;
+  dustmasker.Init("ACGT") ;
+
+  size_t maskedCnt = 0 ;
+  double start = GetTime() ;
+  for (i = 0 ; i < readCnt ; ++i)
+  {
+    memcpy(buffer, reads + (size_t)i * (readLen + 1), readLen + 1) ;
+    maskedCnt += dustmasker.MaskInPlace(buffer, readLen) ;
+  }
+  double elapsed = GetTime() - start ;
+
+  printf("reads: %d\tlength: %d\tmasked_bases: %lu\ttime: %.3lfs\treads_per_second: %.0lf\n",
+      readCnt, readLen, maskedCnt, elapsed, elapsed > 0 ? readCnt / elapsed : 0.0) ;
+
+  free(reads) ;
+  free(buffer) ;
+  return 0 ;
+}
@@ -0,0 +1,97 @@
+// Time the read pair merging with the scalar and the SIMD mismatch counting on simulated pairs:
+//   ./readpairmerger-benchmark [pair_count [read_length]]
+// The fragment sizes range from half to 3.5 times of the read length, so the pairs include
+//   read-through with adapters, regular overlaps and no overlap.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ReadPairMerger.hpp"
+
+static double GetTime()
+{
+  struct timespec t ;
+  clock_gettime(CLOCK_MONOTONIC, &t) ;
+  return t.tv_sec + t.tv_nsec / 1e9 ;
+}
+
+static char RandomQual()
+{
+  return 33 + rand() % 40 ;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, j ;
+  int pairCnt = argc > 1 ? atoi(argv[1]) : 200000 ;
+  int readLen = argc > 2 ? atoi(argv[2]) : 150 ;
+  const char nucs[] = "ACGT" ;
+  const char adapter1[] = "AGATCGGAAGAGCACACGTCTGAACTCCAGTCAC" ;
+  const char adapter2[] = "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGT" ;
+  char comp[256] ;
+  memset(comp, 'N', sizeof(comp)) ;
+  comp['A'] = 'T' ; comp['C'] = 'G' ; comp['G'] = 'C' ; comp['T'] = 'A' ;
+
+  srand(17) ;
+  size_t stride = readLen + 1 ;
+  char *r1 = (char *)malloc(sizeof(char) * pairCnt * stride) ;
+  char *r2 = (char *)malloc(sizeof(char) * pairCnt * stride) ;
+  char *q1 = (char *)malloc(sizeof(char) * pairCnt * stride) ;
+  char *q2 = (char *)malloc(sizeof(char) * pairCnt * stride) ;
+  char *fragment = (char *)malloc(sizeof(char) * 4 * readLen) ;
+  for (i = 0 ; i < pairCnt ; ++i)
+  {
+    int fragLen = readLen / 2 + rand() % (3 * readLen) ;
+    for (j = 0 ; j < fragLen ; ++j)
+      fragment[j] = nucs[rand() & 3] ;
+
+    char *a = r1 + i * stride ;
+    char *b = r2 + i * stride ;
+    for (j = 0 ; j < readLen ; ++j)
+    {
+      a[j] = j < fragLen ? fragment[j] : adapter1[(j - fragLen) % (sizeof(adapter1) - 1)] ;
+      b[j] = j < fragLen ? comp[(int)fragment[fragLen - 1 - j]] : adapter2[(j - fragLen) % (sizeof(adapter2) - 1)] ;
+      if (rand() % 50 == 0) // sequencing errors
+        a[j] = nucs[rand() & 3] ;
+      if (rand() % 50 == 0)
+        b[j] = nucs[rand() & 3] ;
+      q1[i * stride + j] = RandomQual() ;
+      q2[i * stride + j] = RandomQual() ;
+    }
+    a[readLen] = b[readLen] = q1[i * stride + readLen] = q2[i * stride + readLen] = '\0' ;
+  }
+
+  ReadPairMerger merger ;
+  double elapsed[2] ;
+  int mergeCnt[2] ;
+  size_t mergedLen[2] ;
+  for (int simd = 0 ; simd <= 1 ; ++simd)
+  {
+    merger.SetSimd(simd) ;
+    mergeCnt[simd] = 0 ;
+    mergedLen[simd] = 0 ;
+    double start = GetTime() ;
+    for (i = 0 ; i < pairCnt ; ++i)
+    {
+      char *rm, *qm ;
+      if (merger.Merge(r1 + i * stride, q1 + i * stride, r2 + i * stride, q2 + i * stride, &rm, &qm))
+      {
+        ++mergeCnt[simd] ;
+        mergedLen[simd] += strlen(rm) ;
+        free(rm) ;
+        free(qm) ;
+      }
+    }
+    elapsed[simd] = GetTime() - start ;
+    printf("%s\tpairs: %d\tlength: %d\tmerged: %d\ttime: %.3lfs\tpairs_per_second: %.0lf\n",
+        simd ? "simd" : "scalar", pairCnt, readLen, mergeCnt[simd], elapsed[simd],
+        elapsed[simd] > 0 ? pairCnt / elapsed[simd] : 0.0) ;
+  }
+  if (mergeCnt[0] != mergeCnt[1] || mergedLen[0] != mergedLen[1])
+    printf("WARNING: the scalar and SIMD paths merge differently.\n") ;
+
+  free(r1) ; free(r2) ; free(q1) ; free(q2) ;
+  free(fragment) ;
+  return 0 ;
+}
@@ -0,0 +1,107 @@
+#!/bin/sh
+# Regression checks on the small synthetic genomes in this folder.
+# Run "make test" in the top folder, or "sh run_tests.sh" here after "make".
+# SEQ_D is a mutated reverse complement of SEQ_C with a different tax ID.
+
+cd "$(dirname "$0")"
+bin=..
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failCnt=0
+
+check()
+{
+  if [ "$2" = "$3" ]
+  then
+    echo "PASS: $1"
+  else
+    echo "FAIL: $1 (expected $3, got $2)"
+    failCnt=$((failCnt + 1))
+  fi
+}
+
+build()
+{
+  $bin/centrifuger-build --taxonomy-tree ../example/nodes.dmp --name-table ../example/names.dmp \
+    --conversion-table ref_seqid.map "$@" > /dev/null 2>> "$tmp/build.log"
+}
+
+# --add-to: the conversion table of the existing index lists more sequences than it holds
+awk '/^>/{keep = ($1 != ">SEQ_D" && $1 != ">SEQ_E")} keep' ref.fa > "$tmp/base.fa"
+build -r "$tmp/base.fa" -o "$tmp/add"
+build -r ref.fa --add-to "$tmp/add"
+check "--add-to with a superset conversion table indexes the new genomes" \
+  "$($bin/centrifuger-inspect -x "$tmp/add" --summary 2> /dev/null | wc -l)" 5
+
+# The assignments from the index with --add-to should be the same as without sharding
+build -r ref.fa -o "$tmp/full"
+$bin/centrifuger -x "$tmp/full" -1 reads_1.fq -2 reads_2.fq 2> /dev/null | cut -f1,3 > "$tmp/full.tsv"
+$bin/centrifuger -x "$tmp/add" -1 reads_1.fq -2 reads_2.fq 2> /dev/null | cut -f1,3 > "$tmp/add.tsv"
+check "--add-to index gives the same taxIDs as the index without sharding" \
+  "$(diff "$tmp/full.tsv" "$tmp/add.tsv" | grep -c '^[<>]')" 0
+
+# --shard-id out of [-1, --shard-count) is rejected
+build -r ref.fa -o "$tmp/badshard" --shard-count 2 --shard-id -2
+status=$?
+build -r ref.fa -o "$tmp/badshard" --shard-count 2 --shard-id 2
+check "--shard-id out of range is rejected" \
+  "$status $? $(ls "$tmp"/badshard* 2> /dev/null | wc -l)" "1 1 0"
+
+# The minus-strand early exit only skips the strands that would be dropped
+$bin/centrifuger -x "$tmp/full" -1 reads_1.fq -2 reads_2.fq 2> /dev/null > "$tmp/ee.tsv"
+$bin/centrifuger -x "$tmp/full" -1 reads_1.fq -2 reads_2.fq --no-early-exit 2> /dev/null > "$tmp/no_ee.tsv"
+check "the early exit gives the same output as --no-early-exit" \
+  "$(diff "$tmp/ee.tsv" "$tmp/no_ee.tsv" | grep -c '^[<>]')" 0
+
+# --dedup-umi without barcodes: the distinct reads sharing a UMI are not merged
+awk 'NR % 4 == 2 {print "ACGTACGTAC" ; next} NR % 4 == 0 {print "IIIIIIIIII" ; next} {print}' reads_1.fq > "$tmp/umi.fq"
+$bin/centrifuger -x "$tmp/full" -1 reads_1.fq -2 reads_2.fq --UMI "$tmp/umi.fq" --dedup-umi fanout 2> /dev/null | cut -f1,3 > "$tmp/umi.tsv"
+check "--dedup-umi without barcodes groups the reads by UMI and sequence" \
+  "$(diff "$tmp/full.tsv" "$tmp/umi.tsv" | grep -c '^[<>]')" 0
+
+# --doc-listing: the sequences not in the conversion table get extra seqIds after the listed ones
+cat ref.fa extra.fa > "$tmp/extra_ref.fa"
+awk '/^>/ {name = substr($1, 2) ; next} {seq[name] = seq[name] $0} 
+  END {for (n in seq) if (n ~ /^EXTRA/) for (i = 1 ; i + 100 <= length(seq[n]) ; i += 500) print ">" n "_" i "\n" substr(seq[n], i, 100)}' \
+  extra.fa > "$tmp/extra_reads.fa"
+build -r "$tmp/extra_ref.fa" -o "$tmp/doclist" --doc-listing
+check "--doc-listing keeps the seqIds of the uncategorized sequences" \
+  "$($bin/centrifuger -x "$tmp/doclist" -u "$tmp/extra_reads.fa" 2> /dev/null | awk '$1 ~ ("^" $2 "_")' | wc -l)" \
+  "$(grep -c '^>' "$tmp/extra_reads.fa")"
+
+# --add-to on a --doc-listing index: the document listing moves to shard0, and the new shard has one too
+build -r "$tmp/base.fa" -o "$tmp/add_doclist" --doc-listing
+build -r ref.fa --add-to "$tmp/add_doclist"
+check "--add-to keeps the document listing of the existing index" \
+  "$(ls "$tmp"/add_doclist.shard*.5.cfr 2> /dev/null | wc -l)" 2
+check "--add-to index with --doc-listing classifies the reads" \
+  "$($bin/centrifuger -x "$tmp/add_doclist" -1 reads_1.fq -2 reads_2.fq 2> /dev/null | cut -f1 | sort -u | wc -l)" \
+  "$(($(wc -l < reads_1.fq) / 4 + 1))"
+
+# --add-to rejects the index built with --concat-tax-genome, whose seqIds are tax IDs
+build -r "$tmp/base.fa" -o "$tmp/concat" --concat-tax-genome
+build -r ref.fa --add-to "$tmp/concat"
+check "--add-to rejects an index built with --concat-tax-genome" \
+  "$? $(ls "$tmp"/concat.shard* 2> /dev/null | wc -l)" "1 0"
+
+# --add-to stops at 4 shards, after which the index should be rebuilt
+for name in NC_002942.5 NC_006368.1 SEQ_C SEQ_D SEQ_E
+do
+  awk -v name=">$name" '/^>/{keep = ($1 == name)} keep' ref.fa > "$tmp/one.fa"
+  if [ "$name" = NC_002942.5 ]
+  then
+    build -r "$tmp/one.fa" -o "$tmp/cap"
+  else
+    build -r "$tmp/one.fa" --add-to "$tmp/cap"
+  fi
+done
+check "--add-to refuses an index with 4 shards" \
+  "$? $(ls "$tmp"/cap.shard*.1.cfr 2> /dev/null | wc -l)" "1 4"
+
+if [ $failCnt -gt 0 ]
+then
+  echo "$failCnt check(s) failed, see $tmp/build.log"
+  trap - EXIT
+  exit 1
+fi
+echo "All checks passed."